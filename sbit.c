@@ -0,0 +1,1127 @@
+/*
+ * sbit  --  library to read bitmap-data of a TrueType font
+ *           (a part of sbitget)
+ * Itou Hiroki
+ */
+
+/*
+ * Copyright (c) 2002 ITOU Hiroki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sbit.h"
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h> /* fstat() */
+#include <sys/mman.h> /* mmap() */
+#include <fcntl.h> /* open() */
+#include <unistd.h> /* close() */
+#define USE_MMAP
+#endif
+
+#define uchar unsigned char
+#define ulong unsigned long
+#define ushort unsigned short
+#define ullong unsigned long long
+
+//an indexSubTable of a strike
+typedef struct {
+    sbitrange r;
+    int err; //SBIT_OK, or error code of its glyphs (broken, not supported)
+} rangeinfo;
+
+//a strike and its index
+typedef struct {
+    sbitstrike info;
+    rangeinfo *ranges; //indexSubTables sorted by first glyphID
+    int nrange;
+} strikeinfo;
+
+struct sbitfont_tag {
+    const uchar *top; //on-memory location: top of TrueTypeFile
+    size_t size; //(byte) size of TrueTypeFile
+    int owned; //0==memory of the caller, 1==malloc()ed, 2==mmap()ed
+    sbittables tables; //EBLC and EBDT
+    strikeinfo *strikes;
+    int nstrike;
+};
+
+//reading bits from the most significant bit
+typedef struct {
+    ullong acc; //bits not read yet (from the most significant bit)
+    int nbits;        //number of bits in acc
+    const uchar *p;   //on-memory location to load next
+    const uchar *end; //on-memory location: end of bits
+} bitreader;
+
+//len bytes from p are in the table (top, size) or not
+#define INSIDE(top, size, p, len) \
+    ((p) >= (top) && (ulong)((p) - (top)) <= (ulong)(size) \
+     && (ulong)(len) <= (ulong)(size) - (ulong)((p) - (top)))
+
+//off and len bytes after it are in size bytes or not (without overflow)
+#define INSPAN(off, len, size) \
+    ((ullong)(off) <= (ullong)(size) \
+     && (ullong)(len) <= (ullong)(size) - (ullong)(off))
+
+static ushort rd16(const uchar *p);
+static ulong rd32(const uchar *p);
+static int readfile(const char *fname, sbitfont *font);
+static int see_font(sbitfont *font, int index);
+static int findtable(sbitfont *font, const uchar *dirL, const char *tag1, const char *tag2,
+                     const uchar **tableL, ulong *len);
+static int see_strikes(sbitfont *font);
+static int cmprange(const void *a, const void *b);
+static int getglyph(const sbitfont *font, const strikeinfo *s, unsigned int glyphID,
+                    int nest, sbitglyph *glyph);
+static int compose(const sbitfont *font, const strikeinfo *s, const sbitimage *img,
+                   int nest, sbitglyph *glyph);
+static int checkimage(const sbittables *t, sbitrange *r, int head, unsigned int id,
+                      ulong off, ulong size, char *why);
+static int headsize(int imageFormat, int color);
+static void see_metrics(const uchar *p, int big, sbitglyph *g);
+static void br_init(bitreader *br, const uchar *p, const uchar *end);
+static void br_refill(bitreader *br);
+static uchar br_get(bitreader *br, int n);
+
+/*
+ * reading big-endian numbers
+ * in:  on-memory location
+ * out: the number
+ */
+static ushort rd16(const uchar *p){
+    return (ushort)((p[0]<<8) | p[1]);
+}
+
+static ulong rd32(const uchar *p){
+    return ((ulong)p[0]<<24) | ((ulong)p[1]<<16) | ((ulong)p[2]<<8) | (ulong)p[3];
+}
+
+
+/*
+ * open a font in a file
+ * in:  filename
+ *      number of the font in TTC (0 for TTF)
+ *      (for out) the font
+ * out: SBIT_OK or error code
+ */
+int sbit_open(const char *fname, int index, sbitfont **font){
+    sbitfont *f;
+    int err;
+
+    *font = NULL;
+    if((f=calloc(1, sizeof(sbitfont)))==NULL)
+        return SBIT_ERR_NOMEM;
+    if((err=readfile(fname, f)) != SBIT_OK){
+        free(f);
+        return err;
+    }
+    if((err=see_font(f, index)) != SBIT_OK){
+        sbit_close(f);
+        return err;
+    }
+    *font = f;
+    return SBIT_OK;
+}
+
+
+/*
+ * open a font on memory
+ *   the memory is not copied;  it must be kept until sbit_close()
+ * in:  on-memory location: top of TrueTypeFile
+ *      (byte) size
+ *      number of the font in TTC (0 for TTF)
+ *      (for out) the font
+ * out: SBIT_OK or error code
+ */
+int sbit_open_memory(const void *data, size_t size, int index, sbitfont **font){
+    sbitfont *f;
+    int err;
+
+    *font = NULL;
+    if((f=calloc(1, sizeof(sbitfont)))==NULL)
+        return SBIT_ERR_NOMEM;
+    f->top = data;
+    f->size = size;
+    f->owned = 0;
+    if((err=see_font(f, index)) != SBIT_OK){
+        sbit_close(f);
+        return err;
+    }
+    *font = f;
+    return SBIT_OK;
+}
+
+
+/*
+ * close a font
+ * in:  the font (NULL is OK)
+ * out: nothing
+ */
+void sbit_close(sbitfont *font){
+    int i;
+
+    if(font == NULL)
+        return;
+    for(i=0; i<font->nstrike; i++)
+        free(font->strikes[i].ranges);
+    free(font->strikes);
+#ifdef USE_MMAP
+    if(font->owned == 2)
+        munmap((void *)font->top, font->size);
+#endif
+    if(font->owned == 1)
+        free((void *)font->top);
+    free(font);
+}
+
+
+/*
+ * number of strikes in a font
+ * in:  the font
+ * out: number of strikes
+ */
+int sbit_num_strikes(const sbitfont *font){
+    return font->nstrike;
+}
+
+
+/*
+ * info of a strike
+ * in:  the font
+ *      number of the strike (0 <= i < sbit_num_strikes())
+ *      (for out) info of the strike
+ * out: SBIT_OK or error code
+ */
+int sbit_get_strike(const sbitfont *font, int i, sbitstrike *strike){
+    if(i < 0 || i >= font->nstrike)
+        return SBIT_ERR_NOSTRIKE;
+    *strike = font->strikes[i].info;
+    return SBIT_OK;
+}
+
+
+/*
+ * get a glyph
+ *   the strike is found by ppemX,  the indexSubTable by binary search,
+ *   and the entry directly (index format 1,2,3) or by binary search (4,5)
+ * in:  the font
+ *      pixels per em
+ *      glyphID
+ *      (for out) the glyph: free glyph->bits with sbit_free_glyph()
+ * out: SBIT_OK or error code
+ */
+int sbit_get_glyph(const sbitfont *font, int ppem, unsigned int glyphID, sbitglyph *glyph){
+    int i;
+
+    memset(glyph, 0x00, sizeof(sbitglyph));
+    for(i=0; i<font->nstrike; i++){
+        if(font->strikes[i].info.ppemX == ppem)
+            return getglyph(font, &font->strikes[i], glyphID, 0, glyph);
+    }
+    return SBIT_ERR_NOSTRIKE;
+}
+
+
+/*
+ * get a glyph of a strike
+ * in:  the font
+ *      the strike
+ *      glyphID
+ *      depth of nesting (0==the glyph asked, 1-==a component)
+ *      (for out) the glyph
+ * out: SBIT_OK or error code
+ */
+static int getglyph(const sbitfont *font, const strikeinfo *s, unsigned int glyphID,
+                    int nest, sbitglyph *glyph){
+    const rangeinfo *ri;
+    sbitentry e;
+    sbitimage img;
+    const uchar *rows;
+    ulong rowbits, k, y;
+    int left, right, mid;
+
+    //last indexSubTable whose first <= glyphID
+    left = 0;
+    right = s->nrange;
+    while(left < right){
+        mid = (left + right) / 2;
+        if(s->ranges[mid].r.first <= glyphID)
+            left = mid + 1;
+        else
+            right = mid;
+    }
+    if(left == 0 || glyphID > s->ranges[left-1].r.last)
+        return SBIT_ERR_NOGLYPH;
+    ri = &s->ranges[left-1];
+    if(ri->err != SBIT_OK)
+        return ri->err;
+
+    k = sbit_find_entry(&ri->r, glyphID);
+    if(k >= ri->r.n || !sbit_entry(&ri->r, k, &e) || e.id != glyphID)
+        return SBIT_ERR_NOGLYPH;
+    sbit_image(&font->tables, &ri->r, &e, glyph, &img);
+    glyph->bitDepth = s->info.bitDepth;
+    if(img.kind == SBIT_IMAGE_COMPOSITE)
+        return compose(font, s, &img, nest, glyph);
+
+    /*
+     * copy rows of the image,  each row from a byte boundary
+     *   (a short image is padded with blank)
+     */
+    rowbits = (ulong)glyph->width * glyph->bitDepth;
+    glyph->pitch = (rowbits + 7) / 8;
+    if((glyph->bits=malloc(glyph->pitch * glyph->height + 1))==NULL)
+        return SBIT_ERR_NOMEM;
+    rows = sbit_rows(&img, glyph->width, glyph->height, glyph->bitDepth, glyph->bits);
+    if(rows != glyph->bits)
+        memcpy(glyph->bits, rows, glyph->pitch * glyph->height);
+    //clear padding bits after the last pixel
+    if(rowbits % 8){
+        for(y=0; y<(ulong)glyph->height; y++)
+            glyph->bits[glyph->pitch * (y + 1) - 1] &= (uchar)(0xff << (8 - rowbits % 8));
+    }
+    return SBIT_OK;
+}
+
+
+/*
+ * make the bitmap of a composite glyph from its components
+ * in:  the font
+ *      the strike
+ *      the image of the glyph (components)
+ *      depth of nesting of the glyph
+ *      (for in and out) the glyph (metrics in,  bitmap out)
+ * out: SBIT_OK or error code
+ */
+static int compose(const sbitfont *font, const strikeinfo *s, const sbitimage *img,
+                   int nest, sbitglyph *glyph){
+    sbitglyph comp;
+    unsigned int id;
+    int i, x, y, err;
+
+    if(glyph->bitDepth != 1)
+        return SBIT_ERR_UNSUPPORTED;
+    if(nest >= SBIT_MAXNEST)
+        return SBIT_ERR_BROKEN;
+    glyph->pitch = (glyph->width + 7) / 8;
+    if((glyph->bits=calloc(glyph->pitch * glyph->height + 1, 1))==NULL)
+        return SBIT_ERR_NOMEM;
+    for(i=0; i<img->numComp; i++){
+        sbit_component(img, i, &id, &x, &y);
+        memset(&comp, 0x00, sizeof(sbitglyph));
+        if((err=getglyph(font, s, id, nest + 1, &comp)) != SBIT_OK){
+            sbit_free_glyph(glyph);
+            //a component not in the strike is a broken font
+            return (err == SBIT_ERR_NOGLYPH) ? SBIT_ERR_BROKEN : err;
+        }
+        sbit_blit(glyph->bits, glyph->width, glyph->height,
+                  comp.bits, comp.width, comp.height, x, y);
+        sbit_free_glyph(&comp);
+    }
+    return SBIT_OK;
+}
+
+
+/*
+ * free a glyph
+ * in:  the glyph
+ * out: nothing
+ */
+void sbit_free_glyph(sbitglyph *glyph){
+    free(glyph->bits);
+    glyph->bits = NULL;
+}
+
+
+/*
+ * message of an error code
+ * in:  error code
+ * out: the message
+ */
+const char *sbit_strerror(int err){
+    switch(err){
+    case SBIT_OK:              return "no error";
+    case SBIT_ERR_OPEN:        return "cannot read the file";
+    case SBIT_ERR_NOMEM:       return "cannot allocate memory";
+    case SBIT_ERR_NOTFONT:     return "not a TrueType font";
+    case SBIT_ERR_NOBITMAP:    return "the font has no bitmap-data";
+    case SBIT_ERR_BROKEN:      return "the font is broken";
+    case SBIT_ERR_NOSTRIKE:    return "no strike of the size";
+    case SBIT_ERR_NOGLYPH:     return "no bitmap of the glyph";
+    case SBIT_ERR_UNSUPPORTED: return "format not supported";
+    }
+    return "unknown error";
+}
+
+
+/*
+ * read a file to memory
+ *   use mmap() (read-only) for a regular file,  or read it
+ * in:  filename
+ *      (for out) the font: top, size, owned
+ * out: SBIT_OK or error code
+ */
+static int readfile(const char *fname, sbitfont *font){
+    FILE *fp;
+    uchar *buf;
+    long size;
+
+#ifdef USE_MMAP
+    {
+        int fd;
+        struct stat st;
+        void *p;
+
+        if((fd=open(fname, O_RDONLY))<0)
+            return SBIT_ERR_OPEN;
+        if(fstat(fd, &st)==0 && S_ISREG(st.st_mode) && st.st_size > 0){
+            p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(p != MAP_FAILED){
+                close(fd);
+                madvise(p, st.st_size, MADV_RANDOM);
+                font->top = p;
+                font->size = st.st_size;
+                font->owned = 2;
+                return SBIT_OK;
+            }
+        }
+        close(fd);
+    }
+#endif
+
+    if((fp=fopen(fname, "rb"))==NULL)
+        return SBIT_ERR_OPEN;
+    if(fseek(fp, 0, SEEK_END)!=0 || (size=ftell(fp)) <= 0 || fseek(fp, 0, SEEK_SET)!=0){
+        fclose(fp);
+        return SBIT_ERR_OPEN;
+    }
+    if((buf=malloc(size))==NULL){
+        fclose(fp);
+        return SBIT_ERR_NOMEM;
+    }
+    if(fread(buf, 1, size, fp) != (size_t)size){
+        free(buf);
+        fclose(fp);
+        return SBIT_ERR_OPEN;
+    }
+    fclose(fp);
+    font->top = buf;
+    font->size = size;
+    font->owned = 1;
+    return SBIT_OK;
+}
+
+
+/*
+ * find EBLC/EBDT of a font,  and make the index of strikes
+ * in:  (for in and out) the font
+ *      number of the font in TTC
+ * out: SBIT_OK or error code
+ */
+static int see_font(sbitfont *font, int index){
+    const uchar *dirL = font->top; //on-memory location: table directory
+    int err;
+
+    if(font->size < 12)
+        return SBIT_ERR_NOTFONT;
+    if(rd32(font->top) == 0x74746366){ //'ttcf'
+        ulong numFonts = rd32(font->top + 8);
+
+        if(index < 0 || (ulong)index >= numFonts
+           || !INSIDE(font->top, font->size, font->top + 12, (ulong)(index + 1) * 4))
+            return SBIT_ERR_NOTFONT;
+        dirL = font->top + rd32(font->top + 12 + index * 4);
+        if(!INSIDE(font->top, font->size, dirL, 12))
+            return SBIT_ERR_BROKEN;
+    }else if(index != 0){
+        return SBIT_ERR_NOTFONT;
+    }
+    if(rd32(dirL) != 0x00010000 && rd32(dirL) != 0x74727565) //'true'
+        return SBIT_ERR_NOTFONT;
+
+    if((err=findtable(font, dirL, "EBLC", "bloc", &font->tables.eblcL,
+                      &font->tables.eblcLen)) != SBIT_OK)
+        return err;
+    if((err=findtable(font, dirL, "EBDT", "bdat", &font->tables.ebdtL,
+                      &font->tables.ebdtLen)) != SBIT_OK)
+        return err;
+    return see_strikes(font);
+}
+
+
+/*
+ * find a table in the table directory
+ * in:  the font
+ *      on-memory location: top of the table directory
+ *      name of the table,  and another name of it (Apple)
+ *      (for out) on-memory location: top of the table
+ *      (for out) (byte) length of the table
+ * out: SBIT_OK or error code
+ */
+static int findtable(sbitfont *font, const uchar *dirL, const char *tag1, const char *tag2,
+                     const uchar **tableL, ulong *len){
+    ushort numTable = rd16(dirL + 4);
+    const uchar *recL; //a table record
+    int i;
+
+    //12 = size of the header of table directory,  16 = size of a table record
+    if(!INSIDE(font->top, font->size, dirL + 12, (ulong)numTable * 16))
+        return SBIT_ERR_BROKEN;
+    for(i=0, recL=dirL+12; i<numTable; i++, recL+=16){
+        if(memcmp(recL, tag1, 4)==0 || memcmp(recL, tag2, 4)==0){
+            ulong offset = rd32(recL + 8);
+
+            *len = rd32(recL + 12);
+            if(offset > font->size || *len > font->size - offset)
+                return SBIT_ERR_BROKEN;
+            *tableL = font->top + offset;
+            return SBIT_OK;
+        }
+    }
+    return SBIT_ERR_NOBITMAP;
+}
+
+
+/*
+ * make the index of each strike
+ *   indexSubTables of a strike are checked,  and sorted by glyphID
+ *   so that a glyph is found by binary search
+ *   (glyphs of a broken indexSubTable are SBIT_ERR_BROKEN)
+ * in:  (for in and out) the font
+ * out: SBIT_OK or error code
+ */
+static int see_strikes(sbitfont *font){
+    const uchar *eblcL = font->tables.eblcL;
+    ulong eblcLen = font->tables.eblcLen;
+    ulong numSizes;
+    ulong i, j;
+    char why[SBIT_WHYLEN];
+
+    if(eblcLen < 8)
+        return SBIT_ERR_BROKEN;
+    numSizes = rd32(eblcL + 4);
+    //8 = size of EBLC header, 48 = size of bitmapSizeTable
+    if(numSizes > (eblcLen - 8) / 48)
+        return SBIT_ERR_BROKEN;
+    if(numSizes == 0)
+        return SBIT_ERR_NOBITMAP;
+    if((font->strikes=calloc(numSizes, sizeof(strikeinfo)))==NULL)
+        return SBIT_ERR_NOMEM;
+
+    for(i=0; i<numSizes; i++){
+        const uchar *sizeL = eblcL + 8 + 48 * i; //top of bitmapSizeTable
+        strikeinfo *s = &font->strikes[font->nstrike++];
+        const uchar *arrayL = eblcL + rd32(sizeL); //top of indexSubTableArray
+        ulong numElem = rd32(sizeL + 8);
+
+        s->info.ascender = (signed char)sizeL[16];
+        s->info.descender = (signed char)sizeL[17];
+        s->info.maxWidth = sizeL[18];
+        s->info.startGlyph = rd16(sizeL + 40);
+        s->info.endGlyph = rd16(sizeL + 42);
+        s->info.ppemX = sizeL[44];
+        s->info.ppemY = sizeL[45];
+        s->info.bitDepth = sizeL[46];
+        if(s->info.bitDepth == 0)
+            s->info.bitDepth = 1;
+
+        //8 = size of indexSubTableArray element
+        if(rd32(sizeL) > eblcLen || numElem > (eblcLen - rd32(sizeL)) / 8)
+            return SBIT_ERR_BROKEN;
+        if((s->ranges=calloc(numElem + 1, sizeof(rangeinfo)))==NULL)
+            return SBIT_ERR_NOMEM;
+        for(j=0; j<numElem; j++)
+            s->ranges[j].err = sbit_check_range(&font->tables, arrayL, arrayL + 8*j,
+                                                &s->ranges[j].r, why);
+        s->nrange = numElem;
+        qsort(s->ranges, s->nrange, sizeof(rangeinfo), cmprange);
+    }
+    return SBIT_OK;
+}
+
+
+/*
+ * compare indexSubTables for qsort()
+ * in:  indexSubTables
+ * out: <0, 0, >0
+ */
+static int cmprange(const void *a, const void *b){
+    const rangeinfo *x = a, *y = b;
+
+    return (int)x->r.first - (int)y->r.first;
+}
+
+
+/*
+ * reading an indexSubTableArray element,  and checking its indexSubTable
+ *   and the header of each image once (what sbit_entry(), sbit_find_entry()
+ *   and sbit_image() read),  before glyphs are decoded
+ * in:  EBLC and EBDT
+ *      on-memory location: top of indexSubTableArray
+ *      on-memory location: the element (8 bytes,  in EBLC)
+ *      (for out) the indexSubTable (first and last are set even if broken)
+ *      (for out) why it is broken (SBIT_WHYLEN bytes)
+ * out: SBIT_OK, SBIT_ERR_BROKEN or SBIT_ERR_UNSUPPORTED
+ */
+int sbit_check_range(const sbittables *t, const unsigned char *arrayL,
+                     const unsigned char *elemL, sbitrange *r, char *why){
+    const uchar *p; //on-memory location: body of indexSubTable (after its header)
+    ulong suboff; //(byte) offset from top of EBLC to the indexSubTable
+    ulong avail; //(byte) from the indexSubTable to the end of EBLC
+    ullong need; //(byte) size of the body of indexSubTable
+    ulong i, off, next;
+    int head, empty;
+
+    memset(r, 0x00, sizeof(sbitrange));
+    r->first = rd16(elemL);
+    r->last = rd16(elemL + 2);
+    suboff = (ulong)(arrayL - t->eblcL) + rd32(elemL + 4);
+    //8 = size of indexSubHeader
+    if(suboff > t->eblcLen || t->eblcLen - suboff < 8){
+        strcpy(why, "indexSubTable is out of EBLC");
+        return SBIT_ERR_BROKEN;
+    }
+    avail = t->eblcLen - suboff;
+    r->subL = t->eblcL + suboff;
+    r->indexFormat = rd16(r->subL);
+    r->imageFormat = rd16(r->subL + 2);
+    r->imageOffset = rd32(r->subL + 4);
+    p = r->subL + 8;
+    if(r->indexFormat < 1 || r->indexFormat > 5){
+        snprintf(why, SBIT_WHYLEN, "indexFormat %d is not supported", r->indexFormat);
+        return SBIT_ERR_UNSUPPORTED;
+    }
+    if((head=headsize(r->imageFormat, t->color)) < 0){
+        snprintf(why, SBIT_WHYLEN, "imageFormat %d is not supported", r->imageFormat);
+        return SBIT_ERR_UNSUPPORTED;
+    }
+    if(r->first > r->last){
+        strcpy(why, "firstGlyphIndex is larger than lastGlyphIndex");
+        return SBIT_ERR_BROKEN;
+    }
+    //metrics of these imageFormats are in EBLC
+    if((r->imageFormat == 5 || r->imageFormat == 19)
+       && r->indexFormat != 2 && r->indexFormat != 5){
+        snprintf(why, SBIT_WHYLEN, "imageFormat %d needs indexFormat 2 or 5",
+                 r->imageFormat);
+        return SBIT_ERR_BROKEN;
+    }
+
+    /*
+     * entries in EBLC
+     */
+    r->n = r->last - r->first + 1;
+    switch(r->indexFormat){
+    case 1: //offsets of entries and the end (4 bytes each)
+        need = ((ullong)r->n + 1) * 4;
+        break;
+    case 3: //(2 bytes each)
+        need = ((ullong)r->n + 1) * 2;
+        break;
+    case 4: //numGlyphs, pairs of glyphID and offset (entries and the end)
+        if(avail < 8 + 4){
+            strcpy(why, "indexSubTable is out of EBLC");
+            return SBIT_ERR_BROKEN;
+        }
+        r->n = rd32(p);
+        need = 4 + ((ullong)r->n + 1) * 4;
+        break;
+    case 2: //imageSize, bigGlyphMetrics
+        need = 4 + 8;
+        break;
+    default: //5: imageSize, bigGlyphMetrics, numGlyphs, glyphIdArray
+        if(avail < 8 + 4 + 8 + 4){
+            strcpy(why, "indexSubTable is out of EBLC");
+            return SBIT_ERR_BROKEN;
+        }
+        r->n = rd32(p + 4 + 8);
+        need = 4 + 8 + 4 + (ullong)r->n * 2;
+        break;
+    }
+    if(!INSPAN(8, need, avail)){
+        strcpy(why, "indexSubTable is out of EBLC");
+        return SBIT_ERR_BROKEN;
+    }
+    r->size = 8 + need;
+    r->dataLo = r->dataHi = r->imageOffset;
+
+    /*
+     * images in EBDT
+     *   every image holds its header (metrics, components...)
+     */
+    switch(r->indexFormat){
+    case 1:
+    case 3:
+    case 4:
+        for(i=0; i<r->n; i++){
+            sbitentry e;
+
+            if(!sbit_entry(r, i, &e))
+                continue;
+            off = e.off - r->imageOffset;
+            if(!checkimage(t, r, head, e.id, off, e.size, why))
+                return SBIT_ERR_BROKEN;
+            //widen the images of the indexSubTable to this one
+            empty = (r->dataLo == r->dataHi);
+            next = e.off + e.size;
+            if(empty || e.off < r->dataLo)
+                r->dataLo = e.off;
+            if(empty || next > r->dataHi)
+                r->dataHi = next;
+        }
+        break;
+    default: //2, 5: every image has imageSize bytes
+        {
+            ulong imageSize = rd32(p);
+
+            if(imageSize < (ulong)head){
+                snprintf(why, SBIT_WHYLEN, "imageSize %lu is too short for imageFormat %d",
+                         imageSize, r->imageFormat);
+                return SBIT_ERR_BROKEN;
+            }
+            if(!INSPAN(r->imageOffset, (ullong)imageSize * r->n, t->ebdtLen)){
+                strcpy(why, "glyph data is out of EBDT");
+                return SBIT_ERR_BROKEN;
+            }
+            r->dataHi = r->imageOffset + imageSize * r->n;
+            //components of composite glyphs,  and lengths of PNG images
+            if(r->imageFormat != 8 && r->imageFormat != 9 && !t->color)
+                break;
+            for(i=0; i<r->n; i++){
+                unsigned int id = (r->indexFormat == 5) ? rd16(p + 4 + 8 + 4 + i*2)
+                                                        : r->first + i;
+
+                if(!checkimage(t, r, head, id, imageSize * i, imageSize, why))
+                    return SBIT_ERR_BROKEN;
+            }
+        }
+        break;
+    }
+    return SBIT_OK;
+}
+
+
+/*
+ * checking an image is in EBDT,  and holds its header
+ *   (and the components or PNG image the header tells)
+ * in:  EBLC and EBDT
+ *      the indexSubTable
+ *      (byte) size of the header of an image (headsize())
+ *      glyphID
+ *      (byte) offset of the image from imageOffset
+ *      (byte) size of the image
+ *      (for out) why it is broken (SBIT_WHYLEN bytes)
+ * out: 1==good, 0==broken
+ */
+static int checkimage(const sbittables *t, sbitrange *r, int head, unsigned int id,
+                      ulong off, ulong size, char *why){
+    const uchar *p;
+
+    if(!INSPAN((ullong)r->imageOffset + off, size, t->ebdtLen)){
+        snprintf(why, SBIT_WHYLEN, "glyph %u is out of EBDT", id);
+        return 0;
+    }
+    if(size < (ulong)head){
+        snprintf(why, SBIT_WHYLEN, "glyph %u is shorter than its header", id);
+        return 0;
+    }
+    p = t->ebdtL + r->imageOffset + off;
+    switch(r->imageFormat){
+    case 8:
+    case 9:
+        //numComponents is at the end of the header,  4 bytes a component
+        if(size - head < (ulong)rd16(p + head - 2) * 4){
+            snprintf(why, SBIT_WHYLEN, "components of glyph %u are out of its data", id);
+            return 0;
+        }
+        break;
+    case 17:
+    case 18:
+    case 19:
+        //dataLen is at the end of the header
+        if(size - head < rd32(p + head - 4)){
+            snprintf(why, SBIT_WHYLEN, "PNG image of glyph %u is longer than its data", id);
+            return 0;
+        }
+        break;
+    }
+    return 1;
+}
+
+
+/*
+ * size of the header of an image in EBDT (or CBDT)
+ *   metrics,  and numComponents of composite glyphs,
+ *   or the length of PNG images
+ * in:  imageFormat
+ *      1==CBDT, 0==EBDT
+ * out: (byte) size of the header (-1==not supported)
+ */
+static int headsize(int imageFormat, int color){
+    if(color){
+        switch(imageFormat){
+        case 17: return 5 + 4;  //smallGlyphMetrics, dataLen
+        case 18: return 8 + 4;  //bigGlyphMetrics, dataLen
+        case 19: return 4;      //dataLen
+        }
+        return -1;
+    }
+    switch(imageFormat){
+    case 1:
+    case 2: return 5;          //smallGlyphMetrics
+    case 5: return 0;          //metrics are in EBLC
+    case 6:
+    case 7: return 8;          //bigGlyphMetrics
+    case 8: return 5 + 1 + 2;  //smallGlyphMetrics, pad, numComponents
+    case 9: return 8 + 2;      //bigGlyphMetrics, numComponents
+    }
+    return -1;
+}
+
+
+/*
+ * an entry of an indexSubTable
+ *   (an entry is a glyph,  or an empty place of a glyph)
+ * in:  the indexSubTable (checked)
+ *      number of the entry (0 <= k < r->n)
+ *      (for out) the entry
+ * out: 1==a glyph, 0==an empty place
+ */
+int sbit_entry(const sbitrange *r, unsigned long k, sbitentry *e){
+    const uchar *p = r->subL + 8; //after indexSubHeader
+    ulong off, next;
+
+    switch(r->indexFormat){
+    case 1: //proportional with 4 byte offsets
+        e->id = r->first + k;
+        off = rd32(p + k*4);
+        next = rd32(p + k*4 + 4);
+        break;
+    case 3: //proportional with 2 byte offsets
+        e->id = r->first + k;
+        off = rd16(p + k*2);
+        next = rd16(p + k*2 + 2);
+        break;
+    case 4: //proportional with sparse codes:  numGlyphs, pairs of glyphID and offset
+        p += 4 + k*4;
+        e->id = rd16(p);
+        off = rd16(p + 2);
+        next = rd16(p + 6);
+        break;
+    case 2: //monospaced with close codes:  imageSize
+        e->id = r->first + k;
+        e->size = rd32(p);
+        e->off = r->imageOffset + e->size * k;
+        return 1;
+    default: //5: monospaced with sparse codes:  imageSize, bigGlyphMetrics, numGlyphs
+        e->id = rd16(p + 4 + 8 + 4 + k*2);
+        e->size = rd32(p);
+        e->off = r->imageOffset + e->size * k;
+        return 1;
+    }
+    if(next <= off)
+        return 0;
+    e->off = r->imageOffset + off;
+    e->size = next - off;
+    return 1;
+}
+
+
+/*
+ * finding the first entry of a glyphID or larger
+ *   go straight to the entry (binary search for sparse formats)
+ * in:  the indexSubTable (checked)
+ *      glyphID
+ * out: number of the entry (r->n==all entries are smaller)
+ */
+unsigned long sbit_find_entry(const sbitrange *r, unsigned long glyphID){
+    const uchar *idL; //on-memory location: top of glyphIDs
+    int size; //(byte) distance of glyphIDs
+    ulong left, right, mid;
+
+    switch(r->indexFormat){
+    case 1:
+    case 2:
+    case 3:
+        if(glyphID <= r->first)
+            return 0;
+        return (glyphID - r->first < r->n) ? glyphID - r->first : r->n;
+    case 4:
+        //indexSubHeader, numGlyphs;  a pair of glyphID and offset
+        idL = r->subL + 8 + 4;
+        size = 4;
+        break;
+    default: //5
+        //indexSubHeader, imageSize, bigGlyphMetrics, numGlyphs
+        idL = r->subL + 8 + 4 + 8 + 4;
+        size = 2;
+        break;
+    }
+
+    left = 0;
+    right = r->n;
+    while(left < right){
+        mid = (left + right) / 2;
+        if(rd16(idL + mid*size) < glyphID)
+            left = mid + 1;
+        else
+            right = mid;
+    }
+    return left;
+}
+
+
+/*
+ * the metrics and the image of a glyph
+ * in:  EBLC and EBDT
+ *      the indexSubTable (checked)
+ *      an entry of it (a glyph)
+ *      (for out) metrics of the glyph (bits are not set)
+ *      (for out) the image
+ * out: nothing
+ */
+void sbit_image(const sbittables *t, const sbitrange *r, const sbitentry *e,
+                sbitglyph *glyph, sbitimage *img){
+    const uchar *p = t->ebdtL + e->off;
+    int head = headsize(r->imageFormat, t->color);
+
+    memset(glyph, 0x00, sizeof(sbitglyph));
+    switch(r->imageFormat){
+    case 1: //small metrics, byte-aligned
+    case 2: //small metrics, bit-aligned
+    case 8: //small metrics, pad, components
+    case 17: //small metrics, PNG
+        see_metrics(p, 0, glyph);
+        break;
+    case 6: //big metrics, byte-aligned
+    case 7: //big metrics, bit-aligned
+    case 9: //big metrics, components
+    case 18: //big metrics, PNG
+        see_metrics(p, 1, glyph);
+        break;
+    default: //5, 19: metrics in indexSubTable (after imageSize)
+        see_metrics(r->subL + 8 + 4, 1, glyph);
+        break;
+    }
+
+    img->dataL = p + head;
+    img->len = e->size - head;
+    img->bitAligned = (r->imageFormat == 2 || r->imageFormat == 5 || r->imageFormat == 7);
+    img->numComp = 0;
+    switch(r->imageFormat){
+    case 8:
+    case 9:
+        img->kind = SBIT_IMAGE_COMPOSITE;
+        img->numComp = rd16(p + head - 2);
+        break;
+    case 17:
+    case 18:
+    case 19:
+        img->kind = SBIT_IMAGE_PNG;
+        img->len = rd32(p + head - 4);
+        break;
+    default:
+        img->kind = SBIT_IMAGE_BITMAP;
+        break;
+    }
+}
+
+
+/*
+ * rows of a bitmap,  each row from a byte boundary
+ *   a byte-aligned image is used as it is;  a bit-aligned or short one
+ *   is copied to buf (a short image is padded with blank)
+ * in:  the image (SBIT_IMAGE_BITMAP)
+ *      (pixel) size of the glyph
+ *      bits of a pixel
+ *      (for out) memory of (width*bitDepth+7)/8 * height bytes
+ * out: on-memory location: the rows (the image itself, or buf)
+ */
+const unsigned char *sbit_rows(const sbitimage *img, int width, int height, int bitDepth,
+                               unsigned char *buf){
+    ulong rowbits = (ulong)width * bitDepth;
+    ulong bytes = (rowbits + 7) / 8 * height;
+    uchar *d = buf;
+    bitreader br;
+    ulong x;
+    int y;
+
+    if(!img->bitAligned){
+        if(img->len >= bytes)
+            return img->dataL;
+        memcpy(buf, img->dataL, img->len);
+        memset(buf + img->len, 0x00, bytes - img->len);
+        return buf;
+    }
+    br_init(&br, img->dataL, img->dataL + img->len);
+    for(y=0; y<height; y++){
+        for(x=rowbits; x>=8; x-=8)
+            *d++ = br_get(&br, 8);
+        if(x)
+            *d++ = br_get(&br, x);
+    }
+    return buf;
+}
+
+
+/*
+ * a component of a composite glyph
+ * in:  the image (SBIT_IMAGE_COMPOSITE)
+ *      number of the component (0 <= i < img->numComp)
+ *      (for out) glyphID of the component
+ *      (for out) (pixel) offset of the component from the top-left of the glyph
+ * out: nothing
+ */
+void sbit_component(const sbitimage *img, int i, unsigned int *glyphID, int *x, int *y){
+    const uchar *p = img->dataL + i*4;
+
+    *glyphID = rd16(p);
+    *x = (signed char)p[2];
+    *y = (signed char)p[3];
+}
+
+
+/*
+ * put a bitmap on a bitmap (1 bit a pixel,  rows from byte boundaries)
+ *   parts out of the bitmap are cut
+ * in:  (for in and out) the bitmap to put on
+ *      (pixel) its size
+ *      the bitmap to put
+ *      (pixel) its size
+ *      (pixel) where to put it from the top-left
+ * out: nothing
+ */
+void sbit_blit(unsigned char *dst, int width, int height, const unsigned char *src,
+               int srcWidth, int srcHeight, int x, int y){
+    int pitch = (width + 7) / 8;
+    int srcPitch = (srcWidth + 7) / 8;
+    int i, j;
+
+    for(j=0; j<srcHeight; j++){
+        int ty = y + j;
+
+        if(ty < 0 || ty >= height)
+            continue;
+        for(i=0; i<srcWidth; i++){
+            int tx = x + i;
+
+            if(src[j*srcPitch + i/8] == 0){
+                i |= 7; //a blank byte
+                continue;
+            }
+            if(tx >= 0 && tx < width && (src[j*srcPitch + i/8] & (0x80 >> (i & 7))))
+                dst[ty*pitch + tx/8] |= 0x80 >> (tx & 7);
+        }
+    }
+}
+
+
+/*
+ * reading smallGlyphMetrics or bigGlyphMetrics
+ * in:  on-memory location: the metrics
+ *      1==bigGlyphMetrics, 0==smallGlyphMetrics
+ *      (for out) the glyph
+ * out: nothing
+ */
+static void see_metrics(const uchar *p, int big, sbitglyph *g){
+    g->height = p[0];
+    g->width = p[1];
+    g->bearingX = (signed char)p[2];
+    g->bearingY = (signed char)p[3];
+    g->advance = p[4];
+    if(big){
+        g->vertBearingX = (signed char)p[5];
+        g->vertBearingY = (signed char)p[6];
+        g->vertAdvance = p[7];
+    }
+}
+
+
+/*
+ * prepare to read a bitstream
+ * in:  (for out) bitstream reader
+ *      on-memory location: beginning of bits
+ *      on-memory location: end of bits (bits after this are 0)
+ * out: nothing
+ */
+static void br_init(bitreader *br, const uchar *p, const uchar *end){
+    br->acc = 0;
+    br->nbits = 0;
+    br->p = p;
+    br->end = end;
+}
+
+
+/*
+ * fill the bit buffer to 57 bits or more
+ *   if 8 bytes remain, load them as one big-endian word.
+ *   bits loaded over the count are loaded again next time at the same
+ *   position, so OR-ing them twice is harmless.
+ * in:  bitstream reader
+ * out: nothing
+ */
+static void br_refill(bitreader *br){
+    if(br->end - br->p >= 8){
+        const uchar *q = br->p;
+        ullong w = ((ullong)q[0]<<56)
+            | ((ullong)q[1]<<48) | ((ullong)q[2]<<40)
+            | ((ullong)q[3]<<32) | ((ullong)q[4]<<24)
+            | ((ullong)q[5]<<16) | ((ullong)q[6]<<8)
+            | (ullong)q[7];
+        int n = (63 - br->nbits) >> 3; //whole bytes which fit
+
+        br->acc |= w >> br->nbits;
+        br->p += n;
+        br->nbits += n * 8;
+    }else{
+        while(br->nbits <= 56){
+            ullong b = (br->p < br->end) ? *br->p++ : 0;
+            br->acc |= b << (56 - br->nbits);
+            br->nbits += 8;
+        }
+    }
+}
+
+
+/*
+ * read bits from a bitstream
+ * in:  bitstream reader
+ *      number of bits to read (1-8)
+ * out: the bits at the top of a byte (the rest is 0)
+ */
+static uchar br_get(bitreader *br, int n){
+    uchar v;
+
+    if(br->nbits < n)
+        br_refill(br);
+    v = (uchar)(br->acc >> 56) & (uchar)(0xff00 >> n);
+    br->acc <<= n;
+    br->nbits -= n;
+    return v;
+}
+//end of file
@@ -0,0 +1,199 @@
+/*
+ * sbit  --  library to read bitmap-data of a TrueType font
+ *           (a part of sbitget)
+ * Itou Hiroki
+ */
+
+/*
+ * Copyright (c) 2002 ITOU Hiroki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * usage:
+ *     sbitfont *font;
+ *     sbitglyph g;
+ *     int err;
+ *
+ *     if((err=sbit_open("font.ttf", 0, &font)) != SBIT_OK)
+ *         ... sbit_strerror(err) ...
+ *     if(sbit_get_glyph(font, 16, 100, &g) == SBIT_OK){
+ *         ... g.bits, g.pitch, g.width, g.height ...
+ *         sbit_free_glyph(&g);
+ *     }
+ *     sbit_close(font);
+ *
+ *  Functions don't exit,  and don't write to stdout/stderr.
+ *  A sbitfont is not changed after sbit_open(),  so threads can
+ *  get glyphs from the same font at the same time.
+ */
+
+#ifndef SBIT_H
+#define SBIT_H
+
+#include <stddef.h> /* size_t */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//error codes (functions return them)
+#define SBIT_OK 0
+#define SBIT_ERR_OPEN (-1)        //cannot open or read the file
+#define SBIT_ERR_NOMEM (-2)       //cannot allocate memory
+#define SBIT_ERR_NOTFONT (-3)     //not a TrueType font (or no such font in TTC)
+#define SBIT_ERR_NOBITMAP (-4)    //the font has no EBLC/EBDT
+#define SBIT_ERR_BROKEN (-5)      //a table is out of the file,  etc.
+#define SBIT_ERR_NOSTRIKE (-6)    //no strike of the size
+#define SBIT_ERR_NOGLYPH (-7)     //no bitmap of the glyph in the strike
+#define SBIT_ERR_UNSUPPORTED (-8) //index/image format not supported
+
+//a font (contents are private)
+typedef struct sbitfont_tag sbitfont;
+
+//a strike (bitmapSizeTable): glyphs of a size
+typedef struct {
+    int ppemX;      //pixels per em
+    int ppemY;
+    int bitDepth;   //bits of a pixel (1, 2, 4, 8)
+    int startGlyph; //lowest glyphID in this strike
+    int endGlyph;   //highest glyphID in this strike
+    int ascender;   //horizontal line metrics (pixels)
+    int descender;
+    int maxWidth;
+} sbitstrike;
+
+//a glyph
+typedef struct {
+    int width;      //(pixel) size of the bitmap
+    int height;
+    int bearingX;   //(pixel) horizontal metrics
+    int bearingY;
+    int advance;
+    int vertBearingX; //(pixel) vertical metrics (0 for small metrics)
+    int vertBearingY;
+    int vertAdvance;
+    int bitDepth;   //bits of a pixel
+    int pitch;      //(byte) length of a row: (width*bitDepth + 7) / 8
+    unsigned char *bits; //rows from top,  left pixel in the highest bits
+} sbitglyph;
+
+int sbit_open(const char *fname, int index, sbitfont **font);
+int sbit_open_memory(const void *data, size_t size, int index, sbitfont **font);
+void sbit_close(sbitfont *font);
+int sbit_num_strikes(const sbitfont *font);
+int sbit_get_strike(const sbitfont *font, int i, sbitstrike *strike);
+int sbit_get_glyph(const sbitfont *font, int ppem, unsigned int glyphID, sbitglyph *glyph);
+void sbit_free_glyph(sbitglyph *glyph);
+const char *sbit_strerror(int err);
+
+
+/*
+ * lower level:  reading the indexSubTables of a strike yourself
+ *   (sbitget decodes with these,  and so does sbit_get_glyph())
+ *
+ *     sbittables t = { eblcL, eblcLen, ebdtL, ebdtLen, 0 };
+ *     sbitrange r;
+ *     sbitentry e;
+ *     sbitglyph g;
+ *     sbitimage img;
+ *     char why[SBIT_WHYLEN];
+ *
+ *     if(sbit_check_range(&t, arrayL, elemL, &r, why) == SBIT_OK){
+ *         for(k=0; k<r.n; k++){
+ *             if(!sbit_entry(&r, k, &e))
+ *                 continue;
+ *             sbit_image(&t, &r, &e, &g, &img);
+ *             ... sbit_rows(&img, g.width, g.height, 1, buf) ...
+ *         }
+ *     }
+ *
+ *  An indexSubTable is checked once by sbit_check_range() (its entries,
+ *  and the header of each image);  the others don't check again.
+ */
+
+#define SBIT_WHYLEN 200 //(byte) why an indexSubTable is broken (sbit_check_range())
+#define SBIT_MAXNEST 8  //components of a composite glyph nest this deep at most
+
+//kinds of images
+#define SBIT_IMAGE_BITMAP 0    //rows of pixels
+#define SBIT_IMAGE_COMPOSITE 1 //components (imageFormat 8, 9)
+#define SBIT_IMAGE_PNG 2       //a PNG image (imageFormat 17, 18, 19 of CBDT)
+
+//EBLC and EBDT of a font (or CBLC and CBDT)
+typedef struct {
+    const unsigned char *eblcL; //on-memory location: top of EBLC
+    unsigned long eblcLen;      //(byte) length of EBLC
+    const unsigned char *ebdtL; //on-memory location: top of EBDT
+    unsigned long ebdtLen;      //(byte) length of EBDT
+    int color; //1==CBLC/CBDT (PNG images only),  0==EBLC/EBDT
+} sbittables;
+
+//an indexSubTable: glyphs first..last of a strike
+typedef struct {
+    unsigned int first; //firstGlyphIndex
+    unsigned int last;  //lastGlyphIndex
+    int indexFormat;
+    int imageFormat;
+    unsigned long imageOffset; //(byte) offset from top of EBDT to the images
+    const unsigned char *subL; //on-memory location: top of the indexSubTable
+    unsigned long size;   //(byte) size of the indexSubTable
+    unsigned long n;      //number of entries
+    unsigned long dataLo; //images of the entries:  offsets from top of EBDT
+    unsigned long dataHi; //  (dataLo <= image < dataHi)
+} sbitrange;
+
+//an entry of an indexSubTable
+typedef struct {
+    unsigned int id;    //glyphID
+    unsigned long off;  //(byte) offset from top of EBDT to the image
+    unsigned long size; //(byte) size of the image
+} sbitentry;
+
+//the image of a glyph (after its metrics)
+typedef struct {
+    int kind; //SBIT_IMAGE_BITMAP, SBIT_IMAGE_COMPOSITE, SBIT_IMAGE_PNG
+    const unsigned char *dataL; //on-memory location: the rows, components or PNG image
+    unsigned long len; //(byte) length of the rows or PNG image
+    int bitAligned;    //1==rows are not from byte boundaries
+    int numComp;       //number of components (4 bytes each)
+} sbitimage;
+
+int sbit_check_range(const sbittables *t, const unsigned char *arrayL,
+                     const unsigned char *elemL, sbitrange *r, char *why);
+int sbit_entry(const sbitrange *r, unsigned long k, sbitentry *e);
+unsigned long sbit_find_entry(const sbitrange *r, unsigned long glyphID);
+void sbit_image(const sbittables *t, const sbitrange *r, const sbitentry *e,
+                sbitglyph *glyph, sbitimage *img);
+const unsigned char *sbit_rows(const sbitimage *img, int width, int height, int bitDepth,
+                               unsigned char *buf);
+void sbit_component(const sbitimage *img, int i, unsigned int *glyphID, int *x, int *y);
+void sbit_blit(unsigned char *dst, int width, int height, const unsigned char *src,
+               int srcWidth, int srcHeight, int x, int y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SBIT_H */
@@ -0,0 +1,1149 @@
+/*
+ * sbitbench  --  make test fonts with bitmap-data,  and time
+ *                sbit.c and sbitget on them
+ * Itou Hiroki
+ */
+
+/*
+ * Copyright (c) 2002 ITOU Hiroki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#define PROGNAME "sbitbench"
+#define PROGVERSION "0.1"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h> /* vfprintf() */
+#include <sys/stat.h> /* stat() */
+#include <time.h> /* clock_gettime() */
+#include "sbit.h"
+
+#ifdef _WIN32
+#define DEVNULL "NUL"
+#else
+#define DEVNULL "/dev/null"
+#endif
+
+#define uchar unsigned char
+#define ulong unsigned long
+#define ushort unsigned short
+#define MAXPPEM 127 //bearingY of the largest glyph must be in a signed byte
+#define MAXGLYPHID 65534 //numGlyphs of 'maxp' is 16-bit,  glyphID 0 is .notdef
+#define MAXSEGDATA 65535 //(byte) images of an indexSubTable with 2-byte offsets
+#define MAXCMDCHAR 1024
+#define TMPFONT PROGNAME "-tmp.ttf"
+#define TMPBDF PROGNAME "-tmp.bdf"
+
+//name of a table as a 32-bit number (e.g. TAG('E','B','D','T'))
+#define TAG(a,b,c,d) (((ulong)(a)<<24) | ((ulong)(b)<<16) | ((ulong)(c)<<8) | (ulong)(d))
+
+//indexFormat and imageFormat of indexSubTables which sbitget reads.
+//  index formats 2 and 5 have the metrics in EBLC:  only image format 5
+static const int combos[][2] = {
+    {1,1}, {1,2}, {1,6}, {1,7},
+    {2,5},
+    {3,1}, {3,2}, {3,6}, {3,7},
+    {4,1}, {4,2}, {4,6}, {4,7},
+    {5,5}
+};
+#define NUMCOMBO ((int)(sizeof(combos) / sizeof(combos[0])))
+
+//options
+typedef struct {
+    int nglyph; //glyphs in a strike
+    int nstrike;
+    int ppem; //of the smallest strike (others are +4, +8, ...)
+    int index; //indexFormat to test (0==all)
+    int image; //imageFormat to test (0==all)
+    int runs; //the best of the runs is shown
+    char *sbitget; //path of sbitget (NULL==not timed)
+    char *outname; //write a font,  and don't time (NULL==time)
+    char *basename; //output of an earlier run to compare with (NULL==none)
+    int slower; //(percent) glyphs/s lower than the baseline by more is a regression
+} benchopt;
+
+//a row of an earlier run (-b)
+typedef struct {
+    int indexFormat;
+    int imageFormat;
+    double decode; //glyphs/s of sbit_get_glyph()
+    double sbitget; //glyphs/s of sbitget (negative==not timed)
+} baserow;
+
+//glyphs of a combination:  the same glyphIDs in all strikes
+typedef struct {
+    int indexFormat;
+    int imageFormat;
+    int first; //glyphID of the first glyph
+    int count; //number of glyphs
+    int step; //glyphIDs are first, first+step, ... (2 for sparse formats)
+} block;
+
+//a glyph made for a strike
+typedef struct {
+    int width;
+    int height;
+    int bearingX;
+    int bearingY;
+    int advance;
+    uchar bits[MAXPPEM * ((MAXPPEM + 7) / 8)]; //rows from top,  (width+7)/8 bytes a row
+} glyph;
+
+//growable on-memory output (a table)
+typedef struct {
+    uchar *buf;
+    size_t len;
+    size_t alloc;
+} outbuf;
+
+/* func prototype */
+int main(int argc, char **argv);
+int makeblocks(benchopt *opt, int from, int to, block *blocks);
+void makefont(benchopt *opt, block *blocks, int nblock, outbuf *file);
+void makeglyph(int ppem, int id, int mono, glyph *g);
+void putstrike(int ppem, block *blocks, int nblock, outbuf *eblc, outbuf *ebdt, ulong sizeoff);
+ulong imagesize(glyph *g, int imageFormat);
+void putimage(outbuf *ob, glyph *g, int imageFormat);
+void putbits(outbuf *ob, glyph *g, int bitAligned);
+void putbigmetrics(outbuf *ob, glyph *g);
+void putlinemetrics(outbuf *ob, int ppem);
+void puthead(outbuf *ob, benchopt *opt);
+void putcmap(outbuf *ob, block *blocks, int nblock);
+void putname(outbuf *ob);
+void putsfnt(outbuf *file, outbuf *tables, ulong *tags, int ntable);
+void writefile(char *fname, outbuf *ob);
+int bench(benchopt *opt);
+int readbase(benchopt *opt, baserow *rows);
+int compare(benchopt *opt, baserow *rows, int nrow, block *blk, char *what, double rate);
+double timeopen(outbuf *font, int runs);
+double timedecode(outbuf *font, int runs, long *nglyph, double *nbyte);
+double timesbitget(char *sbitget, int runs, double *nbyte);
+ulong checksum(uchar *p, size_t len);
+double nowsec(void);
+void ob_init(outbuf *ob);
+void ob_reserve(outbuf *ob, size_t n);
+void ob_write(outbuf *ob, const void *s, size_t n);
+void ob_free(outbuf *ob);
+void put8(outbuf *ob, int v);
+void put16(outbuf *ob, ulong v);
+void put32(outbuf *ob, ulong v);
+void set16(outbuf *ob, size_t pos, ulong v);
+void set32(outbuf *ob, size_t pos, ulong v);
+ulong get32(outbuf *ob, size_t pos);
+void pad4(outbuf *ob);
+void errexit(char *fmt, ...);
+
+
+/*
+ * reading options,  and writing a test font or timing all combinations
+ */
+int main(int argc, char **argv){
+    benchopt opt;
+    int i;
+    int err = 0;
+
+    opt.nglyph = 1000;
+    opt.nstrike = 3;
+    opt.ppem = 12;
+    opt.index = 0;
+    opt.image = 0;
+    opt.runs = 3;
+    opt.sbitget = "./sbitget";
+    opt.outname = NULL;
+    opt.basename = NULL;
+    opt.slower = 10;
+    for(i=1; i<argc; i++){
+        if(strcmp(argv[i], "-n")==0 && i+1<argc){
+            opt.nglyph = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "-s")==0 && i+1<argc){
+            opt.nstrike = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "-p")==0 && i+1<argc){
+            opt.ppem = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "-i")==0 && i+1<argc){
+            opt.index = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "-m")==0 && i+1<argc){
+            opt.image = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "-r")==0 && i+1<argc){
+            opt.runs = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "-x")==0 && i+1<argc){
+            opt.sbitget = argv[++i];
+            if(opt.sbitget[0] == '\0')
+                opt.sbitget = NULL;
+        }else if(strcmp(argv[i], "-w")==0 && i+1<argc){
+            opt.outname = argv[++i];
+        }else if(strcmp(argv[i], "-b")==0 && i+1<argc){
+            opt.basename = argv[++i];
+        }else if(strcmp(argv[i], "-t")==0 && i+1<argc){
+            opt.slower = atoi(argv[++i]);
+        }else{
+            err = 1;
+        }
+    }
+    if(err || opt.nglyph < 1 || opt.nglyph > MAXGLYPHID || opt.nstrike < 1
+       || opt.ppem < 4 || opt.ppem + 4 * (opt.nstrike - 1) > MAXPPEM || opt.runs < 1
+       || opt.index < 0 || opt.index > 5 || opt.image < 0 || opt.image > 7
+       || opt.slower < 0 || opt.slower > 100){
+        fprintf(stderr, PROGNAME " version " PROGVERSION " - make test fonts with bitmap-data, and time sbitget\n");
+        fprintf(stderr, "usage:  " PROGNAME " [-n glyphs] [-s strikes] [-p ppem] [-i indexFormat]\n"
+                "                  [-m imageFormat] [-r runs] [-x path-of-sbitget]\n"
+                "                  [-w out.ttf] [-b baseline.txt] [-t percent]\n");
+        exit(1);
+    }
+
+    if(opt.outname != NULL){
+        //one font:  all combinations (or the one) in each strike
+        block blocks[NUMCOMBO];
+        outbuf file;
+        int nblock = makeblocks(&opt, 0, NUMCOMBO, blocks);
+
+        if(nblock == 0)
+            errexit("index format %d with image format %d is not supported",
+                    opt.index, opt.image);
+        makefont(&opt, blocks, nblock, &file);
+        writefile(opt.outname, &file);
+        fprintf(stderr, "  wrote '%s': %d strikes (%d-%dppem) x %d glyphs, "
+                "%d indexSubTable formats, %lu bytes\n",
+                opt.outname, opt.nstrike, opt.ppem, opt.ppem + 4 * (opt.nstrike - 1),
+                opt.nglyph, nblock, (ulong)file.len);
+        ob_free(&file);
+    }else if(bench(&opt) > 0){
+        exit(EXIT_FAILURE); //slower than the baseline
+    }
+    exit(EXIT_SUCCESS);
+}
+
+
+/*
+ * split glyphs of a strike among combinations
+ *   sparse formats (4, 5) skip every other glyphID if glyphIDs are enough
+ * in:  options (glyphs,  and the combination to test)
+ *      combinations [from, to) of combos[]
+ *      (for out) glyphs of each combination
+ * out: number of combinations (0==none matched)
+ */
+int makeblocks(benchopt *opt, int from, int to, block *blocks){
+    int nblock = 0;
+    int span = 0;
+    int sparse = 1;
+    int i, id;
+
+    for(i=from; i<to; i++){
+        if((opt->index == 0 || opt->index == combos[i][0])
+           && (opt->image == 0 || opt->image == combos[i][1])){
+            blocks[nblock].indexFormat = combos[i][0];
+            blocks[nblock].imageFormat = combos[i][1];
+            nblock++;
+        }
+    }
+    for(i=0; i<nblock; i++){
+        blocks[i].count = opt->nglyph / nblock + (i < opt->nglyph % nblock);
+        if(blocks[i].indexFormat == 4 || blocks[i].indexFormat == 5)
+            span += blocks[i].count * 2;
+        else
+            span += blocks[i].count;
+    }
+    if(span > MAXGLYPHID)
+        sparse = 0;
+
+    id = 1;
+    for(i=0; i<nblock; i++){
+        blocks[i].first = id;
+        blocks[i].step = (sparse && (blocks[i].indexFormat == 4 || blocks[i].indexFormat == 5))
+            ? 2 : 1;
+        id += blocks[i].count * blocks[i].step;
+    }
+    return nblock;
+}
+
+
+/*
+ * make a test font on memory
+ * in:  options (strikes)
+ *      glyphs of each combination
+ *      number of combinations
+ *      (for out) the font file
+ * out: nothing
+ */
+void makefont(benchopt *opt, block *blocks, int nblock, outbuf *file){
+    outbuf tables[6]; //sorted by tag
+    ulong tags[6] = {TAG('E','B','D','T'), TAG('E','B','L','C'), TAG('c','m','a','p'),
+                     TAG('h','e','a','d'), TAG('m','a','x','p'), TAG('n','a','m','e')};
+    outbuf *ebdt = &tables[0], *eblc = &tables[1];
+    block *last = &blocks[nblock - 1];
+    int i;
+
+    for(i=0; i<6; i++)
+        ob_init(&tables[i]);
+    put32(ebdt, 0x00020000); //version
+    put32(eblc, 0x00020000); //version
+    put32(eblc, opt->nstrike);
+    for(i=0; i<opt->nstrike; i++)
+        ob_write(eblc, NULL, 48); //bitmapSizeTable (set later)
+    for(i=0; i<opt->nstrike; i++)
+        putstrike(opt->ppem + 4*i, blocks, nblock, eblc, ebdt, 8 + 48*i);
+
+    putcmap(&tables[2], blocks, nblock);
+    puthead(&tables[3], opt);
+    put32(&tables[4], 0x00005000); //maxp version 0.5: only numGlyphs
+    put16(&tables[4], last->first + (last->count - 1) * last->step + 1);
+    putname(&tables[5]);
+    putsfnt(file, tables, tags, 6);
+    for(i=0; i<6; i++)
+        ob_free(&tables[i]);
+}
+
+
+/*
+ * make a glyph
+ *   the same (ppem, glyphID) always makes the same glyph
+ * in:  pixels per em
+ *      glyphID
+ *      1==monospaced (all glyphs of the strike have the same metrics)
+ *      (for out) the glyph
+ * out: nothing
+ */
+void makeglyph(int ppem, int id, int mono, glyph *g){
+    ulong r = ((ulong)id * 2654435761UL) ^ ((ulong)ppem * 40503UL);
+    int rowbytes;
+    int k;
+
+    //linear congruential generator (low bits are not used)
+#define NEXTRAND() (r = (r * 1103515245UL + 12345UL) & 0xffffffffUL, (int)(r >> 16))
+    NEXTRAND();
+    if(mono){
+        g->width = ppem * 3 / 4;
+        g->height = ppem;
+        g->bearingX = 0;
+    }else{
+        g->width = 1 + NEXTRAND() % ppem;
+        g->height = 1 + NEXTRAND() % ppem;
+        g->bearingX = NEXTRAND() % 2;
+    }
+    g->bearingY = g->height - ppem / 5;
+    g->advance = g->bearingX + g->width + 1;
+
+    rowbytes = (g->width + 7) / 8;
+    for(k=0; k<rowbytes * g->height; k++)
+        g->bits[k] = (uchar)NEXTRAND();
+    //pixels right of the width are 0
+    if(g->width & 7){
+        for(k=rowbytes-1; k<rowbytes * g->height; k+=rowbytes)
+            g->bits[k] &= 0xff << (8 - (g->width & 7));
+    }
+#undef NEXTRAND
+}
+
+
+/*
+ * write a strike:  indexSubTables of all combinations,  and images.
+ *   indexSubTables of format 3 and 4 are split at 64KB of images
+ * in:  pixels per em
+ *      glyphs of each combination
+ *      number of combinations
+ *      EBLC
+ *      EBDT
+ *      (byte) offset of the bitmapSizeTable from top of EBLC
+ * out: nothing
+ */
+void putstrike(int ppem, block *blocks, int nblock, outbuf *eblc, outbuf *ebdt, ulong sizeoff){
+    outbuf array; //indexSubTableArray
+    outbuf subs; //indexSubTables
+    outbuf size; //bitmapSizeTable
+    ulong arrayoff = eblc->len; //top of indexSubTableArray
+    int nsub = 0;
+    int b, k, i;
+    glyph g;
+
+    ob_init(&array);
+    ob_init(&subs);
+    for(b=0; b<nblock; b++){
+        block *bl = &blocks[b];
+        int mono = (bl->indexFormat == 2 || bl->indexFormat == 5);
+
+        for(k=0; k<bl->count; ){
+            int from = k; //first glyph of the indexSubTable
+            ulong subtableoff = subs.len;
+            ulong imageoff = ebdt->len;
+            size_t countpos = 0;
+
+            //indexSubHeader
+            put16(&subs, bl->indexFormat);
+            put16(&subs, bl->imageFormat);
+            put32(&subs, imageoff);
+
+            if(mono){
+                makeglyph(ppem, bl->first, 1, &g);
+                put32(&subs, imagesize(&g, 5)); //imageSize
+                putbigmetrics(&subs, &g);
+                if(bl->indexFormat == 5){
+                    put32(&subs, bl->count);
+                    for(i=0; i<bl->count; i++)
+                        put16(&subs, bl->first + i * bl->step);
+                }
+                for(; k<bl->count; k++){
+                    makeglyph(ppem, bl->first + k * bl->step, 1, &g);
+                    putimage(ebdt, &g, 5);
+                }
+            }else{
+                if(bl->indexFormat == 4){
+                    countpos = subs.len;
+                    put32(&subs, 0); //numGlyphs (set later)
+                }
+                for(; k<bl->count; k++){
+                    int id = bl->first + k * bl->step;
+
+                    makeglyph(ppem, id, 0, &g);
+                    if(bl->indexFormat != 1 && k > from
+                       && ebdt->len - imageoff + imagesize(&g, bl->imageFormat) > MAXSEGDATA)
+                        break;
+                    if(bl->indexFormat == 1)
+                        put32(&subs, ebdt->len - imageoff);
+                    else if(bl->indexFormat == 3)
+                        put16(&subs, ebdt->len - imageoff);
+                    else{
+                        put16(&subs, id);
+                        put16(&subs, ebdt->len - imageoff);
+                    }
+                    putimage(ebdt, &g, bl->imageFormat);
+                }
+                //the end of the last image
+                if(bl->indexFormat == 1)
+                    put32(&subs, ebdt->len - imageoff);
+                else if(bl->indexFormat == 3)
+                    put16(&subs, ebdt->len - imageoff);
+                else{
+                    set32(&subs, countpos, k - from);
+                    put16(&subs, 0);
+                    put16(&subs, ebdt->len - imageoff);
+                }
+            }
+            pad4(&subs);
+
+            //indexSubTableArray: firstGlyphIndex, lastGlyphIndex, additionalOffsetToIndexSubtable
+            put16(&array, bl->first + from * bl->step);
+            put16(&array, bl->first + (k - 1) * bl->step);
+            put32(&array, subtableoff); //from top of indexSubTables (fixed below)
+            nsub++;
+        }
+    }
+    for(i=0; i<nsub; i++)
+        set32(&array, 8*i + 4, 8*nsub + get32(&array, 8*i + 4));
+    ob_write(eblc, array.buf, array.len);
+    ob_write(eblc, subs.buf, subs.len);
+    ob_free(&array);
+    ob_free(&subs);
+
+    /*
+     * bitmapSizeTable
+     */
+    ob_init(&size);
+    put32(&size, arrayoff);
+    put32(&size, eblc->len - arrayoff); //indexTablesSize
+    put32(&size, nsub);
+    put32(&size, 0); //colorRef
+    putlinemetrics(&size, ppem); //hori
+    putlinemetrics(&size, ppem); //vert
+    put16(&size, blocks[0].first); //startGlyphIndex
+    put16(&size, blocks[nblock-1].first + (blocks[nblock-1].count - 1) * blocks[nblock-1].step);
+    put8(&size, ppem); //ppemX
+    put8(&size, ppem); //ppemY
+    put8(&size, 1); //bitDepth
+    put8(&size, 1); //flags: horizontal
+    memcpy(eblc->buf + sizeoff, size.buf, 48);
+    ob_free(&size);
+}
+
+
+/*
+ * (byte) size of an image in EBDT
+ * in:  the glyph
+ *      imageFormat
+ * out: the size
+ */
+ulong imagesize(glyph *g, int imageFormat){
+    ulong metrics = 0;
+
+    if(imageFormat == 1 || imageFormat == 2)
+        metrics = 5;
+    else if(imageFormat == 6 || imageFormat == 7)
+        metrics = 8;
+    if(imageFormat == 1 || imageFormat == 6)
+        return metrics + (ulong)(g->width + 7) / 8 * g->height;
+    return metrics + ((ulong)g->width * g->height + 7) / 8;
+}
+
+
+/*
+ * write an image of a glyph in EBDT
+ * in:  EBDT
+ *      the glyph
+ *      imageFormat (1: byte-aligned, small-metric,  2: bit-aligned, small-metric,
+ *                   5: bit-aligned only,
+ *                   6: byte-aligned, big-metric,  7: bit-aligned, big-metric)
+ * out: nothing
+ */
+void putimage(outbuf *ob, glyph *g, int imageFormat){
+    if(imageFormat == 1 || imageFormat == 2){
+        //smallGlyphMetrics
+        put8(ob, g->height);
+        put8(ob, g->width);
+        put8(ob, g->bearingX);
+        put8(ob, g->bearingY);
+        put8(ob, g->advance);
+    }else if(imageFormat == 6 || imageFormat == 7){
+        putbigmetrics(ob, g);
+    }
+    putbits(ob, g, imageFormat != 1 && imageFormat != 6);
+}
+
+
+/*
+ * write a bitmap of a glyph in EBDT
+ * in:  EBDT
+ *      the glyph
+ *      1==bit-aligned (rows follow without padding), 0==byte-aligned
+ * out: nothing
+ */
+void putbits(outbuf *ob, glyph *g, int bitAligned){
+    int rowbytes = (g->width + 7) / 8;
+    ulong acc = 0; //bits not written yet (from the lowest bit)
+    int nbits = 0;
+    int x, y;
+
+    if(!bitAligned){
+        ob_write(ob, g->bits, rowbytes * g->height);
+        return;
+    }
+    for(y=0; y<g->height; y++){
+        uchar *row = g->bits + y * rowbytes;
+
+        for(x=0; x + 8 <= g->width; x+=8){
+            acc = (acc << 8) | row[x/8];
+            put8(ob, (acc >> nbits) & 0xff);
+        }
+        if(x < g->width){
+            int rest = g->width - x;
+
+            acc = (acc << rest) | (row[x/8] >> (8 - rest));
+            nbits += rest;
+            if(nbits >= 8){
+                nbits -= 8;
+                put8(ob, (acc >> nbits) & 0xff);
+            }
+        }
+    }
+    if(nbits > 0)
+        put8(ob, (acc << (8 - nbits)) & 0xff);
+}
+
+
+/*
+ * write bigGlyphMetrics
+ * in:  EBLC or EBDT
+ *      the glyph
+ * out: nothing
+ */
+void putbigmetrics(outbuf *ob, glyph *g){
+    put8(ob, g->height);
+    put8(ob, g->width);
+    put8(ob, g->bearingX);
+    put8(ob, g->bearingY);
+    put8(ob, g->advance);
+    put8(ob, -g->width / 2); //vertBearingX
+    put8(ob, 0); //vertBearingY
+    put8(ob, g->height); //vertAdvance
+}
+
+
+/*
+ * write sbitLineMetrics of a strike
+ *   glyphs of makeglyph() are in the box
+ * in:  bitmapSizeTable
+ *      pixels per em
+ * out: nothing
+ */
+void putlinemetrics(outbuf *ob, int ppem){
+    put8(ob, ppem - ppem / 5); //ascender
+    put8(ob, -(ppem / 5)); //descender
+    put8(ob, ppem + 1); //widthMax
+    put8(ob, 1); //caretSlopeNumerator
+    put8(ob, 0); //caretSlopeDenominator
+    put8(ob, 0); //caretOffset
+    put8(ob, 0); //minOriginSB
+    put8(ob, 1); //minAdvanceSB
+    put8(ob, ppem - ppem / 5); //maxBeforeBL
+    put8(ob, -(ppem / 5)); //minAfterBL
+    put8(ob, 0); //pad1
+    put8(ob, 0); //pad2
+}
+
+
+/*
+ * write 'head' table
+ * in:  'head'
+ *      options (strikes)
+ * out: nothing
+ */
+void puthead(outbuf *ob, benchopt *opt){
+    int big = opt->ppem + 4 * (opt->nstrike - 1);
+    long scale = 2048 / big;
+
+    put32(ob, 0x00010000); //version
+    put32(ob, 0x00010000); //fontRevision
+    put32(ob, 0); //checkSumAdjustment (set in putsfnt())
+    put32(ob, 0x5F0F3CF5); //magicNumber
+    put16(ob, 0x000B); //flags: baseline at y=0, lsb at x=0, integer ppem
+    put16(ob, 2048); //unitsPerEm
+    put32(ob, 0); put32(ob, 0); //created
+    put32(ob, 0); put32(ob, 0); //modified
+    put16(ob, 0); //xMin
+    put16(ob, (ushort)(-(big / 5) * scale)); //yMin
+    put16(ob, (ushort)((big + 1) * scale)); //xMax
+    put16(ob, (ushort)((big - big / 5) * scale)); //yMax
+    put16(ob, 0); //macStyle
+    put16(ob, opt->ppem); //lowestRecPPEM
+    put16(ob, 2); //fontDirectionHint
+    put16(ob, 0); //indexToLocFormat
+    put16(ob, 0); //glyphDataFormat
+}
+
+
+/*
+ * write 'cmap' table:  Unicode format 12
+ *   glyphs have codes from U+F0000 (private use) in order of glyphIDs
+ * in:  'cmap'
+ *      glyphs of each combination
+ *      number of combinations
+ * out: nothing
+ */
+void putcmap(outbuf *ob, block *blocks, int nblock){
+    ulong code = 0xF0000;
+    ulong ngroup = 0;
+    size_t top;
+    int b, k;
+
+    put16(ob, 0); //version
+    put16(ob, 1); //numTables
+    put16(ob, 3); //platformID: Microsoft
+    put16(ob, 10); //encodingID: UCS-4
+    put32(ob, 12); //offset
+
+    top = ob->len;
+    put16(ob, 12); //format
+    put16(ob, 0); //reserved
+    put32(ob, 0); //length (set later)
+    put32(ob, 0); //language
+    put32(ob, 0); //numGroups (set later)
+    for(b=0; b<nblock; b++){
+        //a group for a run of glyphIDs
+        int run = (blocks[b].step == 1) ? blocks[b].count : 1;
+
+        for(k=0; k<blocks[b].count; k+=run){
+            put32(ob, code); //startCharCode
+            put32(ob, code + run - 1); //endCharCode
+            put32(ob, blocks[b].first + k * blocks[b].step); //startGlyphID
+            code += run;
+            ngroup++;
+        }
+    }
+    set32(ob, top + 4, ob->len - top);
+    set32(ob, top + 12, ngroup);
+}
+
+
+/*
+ * write 'name' table:  names of the font (Microsoft, English)
+ * in:  'name'
+ * out: nothing
+ */
+void putname(outbuf *ob){
+    static const struct {
+        int id;
+        const char *s;
+    } names[] = {
+        {1, "SbitBench"}, //family
+        {2, "Regular"}, //subfamily
+        {4, "SbitBench"}, //full fontname
+        {6, "SbitBench"} //fontname (postscript)
+    };
+    int n = sizeof(names) / sizeof(names[0]);
+    ulong off = 0;
+    int i;
+    size_t k;
+
+    put16(ob, 0); //format
+    put16(ob, n);
+    put16(ob, 6 + 12 * n); //offset to string storage
+    for(i=0; i<n; i++){
+        put16(ob, 3); //platformID: Microsoft
+        put16(ob, 1); //encodingID: Unicode BMP
+        put16(ob, 0x0409); //languageID: English
+        put16(ob, names[i].id);
+        put16(ob, strlen(names[i].s) * 2);
+        put16(ob, off);
+        off += strlen(names[i].s) * 2;
+    }
+    for(i=0; i<n; i++){
+        for(k=0; k<strlen(names[i].s); k++)
+            put16(ob, (uchar)names[i].s[k]); //UTF-16BE of ASCII
+    }
+}
+
+
+/*
+ * make a TrueType font file on memory
+ *   table directory,  and tables padded to 4 bytes.
+ *   checkSumAdjustment of 'head' is set
+ * in:  (for out) the file
+ *      tables (sorted by tag)
+ *      tags of tables
+ *      number of tables
+ * out: nothing
+ */
+void putsfnt(outbuf *file, outbuf *tables, ulong *tags, int ntable){
+    ulong range, entry;
+    size_t headoff = 0;
+    int i;
+
+    for(range=1, entry=0; range*2 <= (ulong)ntable; range*=2)
+        entry++;
+    ob_init(file);
+    put32(file, 0x00010000); //version
+    put16(file, ntable);
+    put16(file, range * 16); //searchRange
+    put16(file, entry); //entrySelector
+    put16(file, ntable * 16 - range * 16); //rangeShift
+    ob_write(file, NULL, 16 * ntable);
+
+    for(i=0; i<ntable; i++){
+        size_t off = file->len;
+        size_t len = tables[i].len; //padding is not in the length
+
+        pad4(&tables[i]);
+        set32(file, 12 + 16*i, tags[i]);
+        set32(file, 12 + 16*i + 4, checksum(tables[i].buf, tables[i].len));
+        set32(file, 12 + 16*i + 8, off);
+        set32(file, 12 + 16*i + 12, len);
+        ob_write(file, tables[i].buf, tables[i].len);
+        if(tags[i] == TAG('h','e','a','d'))
+            headoff = off;
+    }
+    set32(file, headoff + 8, (0xB1B0AFBAUL - checksum(file->buf, file->len)) & 0xffffffffUL);
+}
+
+
+/*
+ * write on-memory output to a file
+ * in:  filename
+ *      the output
+ * out: nothing
+ */
+void writefile(char *fname, outbuf *ob){
+    FILE *fp;
+
+    if((fp=fopen(fname, "wb"))==NULL)
+        errexit("cannot open '%s'", fname);
+    if(fwrite(ob->buf, 1, ob->len, fp) != ob->len || fclose(fp) != 0){
+        remove(fname);
+        errexit("cannot write '%s'", fname);
+    }
+}
+
+
+/*
+ * time each combination
+ *   open:    sbit_open_memory() (the index of strikes)
+ *   decode:  sbit_get_glyph() of all glyphIDs of all strikes
+ *   sbitget: BDF of all strikes to a file (-o),  with the process
+ *            started and the font read from the disk cache
+ *   (sbit_get_glyph() decodes with the same functions of sbit.c as sbitget)
+ * in:  options
+ * out: number of regressions from the baseline (-b)
+ */
+int bench(benchopt *opt){
+    baserow base[NUMCOMBO];
+    int nbase = 0, nslow = 0;
+    int nrow = 0;
+    int i;
+
+    if(opt->basename != NULL)
+        nbase = readbase(opt, base);
+
+    fprintf(stdout, "  %d strikes (%d-%dppem) x %d glyphs,  the best of %d runs\n",
+            opt->nstrike, opt->ppem, opt->ppem + 4 * (opt->nstrike - 1),
+            opt->nglyph, opt->runs);
+    fprintf(stdout, "  index image  EBDT(KB)  open(us) |  decode glyphs/s     MB/s"
+            " | sbitget glyphs/s  out MB/s\n");
+    for(i=0; i<NUMCOMBO; i++){
+        block blk;
+        outbuf font;
+        ulong ebdtlen;
+        double opensec, decsec, getsec = 0;
+        double decbyte, outbyte = 0;
+        long nglyph;
+
+        if(makeblocks(opt, i, i+1, &blk) == 0)
+            continue;
+        makefont(opt, &blk, 1, &font);
+        ebdtlen = get32(&font, 12 + 12); //length of EBDT (the first table)
+
+        opensec = timeopen(&font, opt->runs);
+        decsec = timedecode(&font, opt->runs, &nglyph, &decbyte);
+        if(opt->sbitget != NULL){
+            writefile(TMPFONT, &font);
+            getsec = timesbitget(opt->sbitget, opt->runs, &outbyte);
+            remove(TMPFONT);
+            if(getsec < 0){
+                fprintf(stderr, "  Warning: cannot run '%s';  sbitget is not timed\n",
+                        opt->sbitget);
+                opt->sbitget = NULL;
+            }
+        }
+
+        fprintf(stdout, "  %5d %5d %9.1f %9.1f | %15.0f %8.1f",
+                blk.indexFormat, blk.imageFormat, ebdtlen / 1024.0, opensec * 1e6,
+                nglyph / decsec, decbyte / decsec / 1e6);
+        if(opt->sbitget != NULL)
+            fprintf(stdout, " | %16.0f %9.1f\n", nglyph / getsec, outbyte / getsec / 1e6);
+        else
+            fprintf(stdout, " | %16s %9s\n", "-", "-");
+        fflush(stdout);
+        nslow += compare(opt, base, nbase, &blk, "decode", nglyph / decsec);
+        if(opt->sbitget != NULL)
+            nslow += compare(opt, base, nbase, &blk, "sbitget", nglyph / getsec);
+        ob_free(&font);
+        nrow++;
+    }
+    if(nrow == 0)
+        errexit("index format %d with image format %d is not supported", opt->index, opt->image);
+    if(opt->basename != NULL)
+        fprintf(stderr, "  %d regressions (glyphs/s more than %d%% lower than '%s')\n",
+                nslow, opt->slower, opt->basename);
+    return nslow;
+}
+
+
+/*
+ * read the output of an earlier run (-b)
+ *   it must be of the same glyphs and strikes (-n, -s, -p)
+ * in:  options
+ *      (for out) rows of combinations
+ * out: number of rows
+ */
+int readbase(benchopt *opt, baserow *rows){
+    FILE *fp;
+    char line[MAXCMDCHAR];
+    int nrow = 0;
+    int nstrike, from, to, nglyph;
+
+    if((fp=fopen(opt->basename, "r"))==NULL)
+        errexit("cannot open '%s'", opt->basename);
+    while(fgets(line, sizeof(line), fp) != NULL){
+        baserow *r = &rows[nrow];
+        char get[32];
+
+        if(sscanf(line, "%d strikes (%d-%dppem) x %d glyphs",
+                  &nstrike, &from, &to, &nglyph) == 4){
+            if(nstrike != opt->nstrike || from != opt->ppem || nglyph != opt->nglyph)
+                errexit("'%s' was made with other glyphs or strikes (-n %d -s %d -p %d)",
+                        opt->basename, nglyph, nstrike, from);
+            continue;
+        }
+        //index image  EBDT(KB)  open(us) |  decode glyphs/s  MB/s | sbitget glyphs/s  out MB/s
+        if(nrow == NUMCOMBO
+           || sscanf(line, "%d %d %*f %*f | %lf %*f | %31s",
+                     &r->indexFormat, &r->imageFormat, &r->decode, get) != 4)
+            continue;
+        r->sbitget = (strcmp(get, "-")==0) ? -1 : atof(get);
+        nrow++;
+    }
+    fclose(fp);
+    if(nrow == 0)
+        errexit("no results in '%s'", opt->basename);
+    return nrow;
+}
+
+
+/*
+ * compare glyphs/s of a combination with the baseline (-b)
+ * in:  options
+ *      rows of the baseline
+ *      number of rows
+ *      the combination
+ *      "decode" or "sbitget"
+ *      glyphs/s of this run
+ * out: 1==regression,  0==not (or not in the baseline)
+ */
+int compare(benchopt *opt, baserow *rows, int nrow, block *blk, char *what, double rate){
+    int i;
+
+    for(i=0; i<nrow; i++){
+        double old;
+
+        if(rows[i].indexFormat != blk->indexFormat || rows[i].imageFormat != blk->imageFormat)
+            continue;
+        old = (strcmp(what, "decode")==0) ? rows[i].decode : rows[i].sbitget;
+        if(old <= 0 || rate >= old * (100 - opt->slower) / 100)
+            return 0;
+        fprintf(stderr, "  Warning: index %d image %d: %s %.0f glyphs/s,  %.1f%% lower than %.0f\n",
+                blk->indexFormat, blk->imageFormat, what, rate, (old - rate) / old * 100, old);
+        return 1;
+    }
+    return 0;
+}
+
+
+/*
+ * time opening a font
+ * in:  the font
+ *      number of runs
+ * out: (second) the best time
+ */
+double timeopen(outbuf *font, int runs){
+    double best = 0;
+    int i, err;
+
+    for(i=0; i<runs; i++){
+        sbitfont *f;
+        double start = nowsec(), sec;
+
+        if((err=sbit_open_memory(font->buf, font->len, 0, &f)) != SBIT_OK)
+            errexit("sbit_open_memory: %s", sbit_strerror(err));
+        sbit_close(f);
+        sec = nowsec() - start;
+        if(i == 0 || sec < best)
+            best = sec;
+    }
+    return best;
+}
+
+
+/*
+ * time getting all glyphs of a font
+ * in:  the font
+ *      number of runs
+ *      (for out) number of glyphs got
+ *      (for out) (byte) size of their bitmaps
+ * out: (second) the best time
+ */
+double timedecode(outbuf *font, int runs, long *nglyph, double *nbyte){
+    double best = 0;
+    int i, s, err;
+    sbitfont *f;
+
+    if((err=sbit_open_memory(font->buf, font->len, 0, &f)) != SBIT_OK)
+        errexit("sbit_open_memory: %s", sbit_strerror(err));
+    for(i=0; i<runs; i++){
+        double start = nowsec(), sec;
+
+        *nglyph = 0;
+        *nbyte = 0;
+        for(s=0; s<sbit_num_strikes(f); s++){
+            sbitstrike st;
+            int id;
+
+            sbit_get_strike(f, s, &st);
+            for(id=st.startGlyph; id<=st.endGlyph; id++){
+                sbitglyph g;
+
+                err = sbit_get_glyph(f, st.ppemX, id, &g);
+                if(err == SBIT_ERR_NOGLYPH)
+                    continue;
+                if(err != SBIT_OK)
+                    errexit("sbit_get_glyph %d: %s", id, sbit_strerror(err));
+                (*nglyph)++;
+                *nbyte += (double)g.pitch * g.height;
+                sbit_free_glyph(&g);
+            }
+        }
+        sec = nowsec() - start;
+        if(i == 0 || sec < best)
+            best = sec;
+    }
+    sbit_close(f);
+    return best;
+}
+
+
+/*
+ * time sbitget writing BDF of the font TMPFONT
+ * in:  path of sbitget
+ *      number of runs
+ *      (for out) (byte) size of the BDF
+ * out: (second) the best time (negative==cannot run)
+ */
+double timesbitget(char *sbitget, int runs, double *nbyte){
+    char cmd[MAXCMDCHAR];
+    double best = 0;
+    struct stat st;
+    int i;
+
+    snprintf(cmd, sizeof(cmd), "\"%s\" -o " TMPBDF " " TMPFONT " > " DEVNULL " 2>&1", sbitget);
+    for(i=0; i<runs; i++){
+        double start = nowsec(), sec;
+
+        if(system(cmd) != 0 || stat(TMPBDF, &st) != 0){
+            remove(TMPBDF);
+            return -1;
+        }
+        sec = nowsec() - start;
+        if(i == 0 || sec < best)
+            best = sec;
+        *nbyte = st.st_size;
+        remove(TMPBDF);
+    }
+    return best;
+}
+
+
+/*
+ * checksum of a table (sum of big-endian 32-bit numbers)
+ * in:  on-memory location: top of the table
+ *      (byte) length (a multiple of 4)
+ * out: the checksum
+ */
+ulong checksum(uchar *p, size_t len){
+    ulong sum = 0;
+    size_t i;
+
+    for(i=0; i+4<=len; i+=4)
+        sum += ((ulong)p[i]<<24) | ((ulong)p[i+1]<<16) | ((ulong)p[i+2]<<8) | p[i+3];
+    return sum & 0xffffffffUL;
+}
+
+
+/*
+ * time now
+ * out: (second) from some point in the past
+ */
+double nowsec(void){
+#ifndef _WIN32
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+
+/*
+ * on-memory output
+ *   ob_write() with NULL writes zeros
+ */
+void ob_init(outbuf *ob){
+    ob->buf = NULL;
+    ob->len = 0;
+    ob->alloc = 0;
+}
+
+void ob_reserve(outbuf *ob, size_t n){
+    if(ob->len + n <= ob->alloc)
+        return;
+    while(ob->len + n > ob->alloc)
+        ob->alloc = ob->alloc ? ob->alloc * 2 : 4096;
+    if((ob->buf=realloc(ob->buf, ob->alloc))==NULL)
+        errexit("realloc");
+}
+
+void ob_write(outbuf *ob, const void *s, size_t n){
+    ob_reserve(ob, n);
+    if(s != NULL)
+        memcpy(ob->buf + ob->len, s, n);
+    else
+        memset(ob->buf + ob->len, 0x00, n);
+    ob->len += n;
+}
+
+void ob_free(outbuf *ob){
+    free(ob->buf);
+    ob_init(ob);
+}
+
+
+/*
+ * write (and read) big-endian numbers
+ * in:  on-memory output
+ *      (position to overwrite or read)
+ *      the number
+ * out: nothing (the number)
+ */
+void put8(outbuf *ob, int v){
+    ob_reserve(ob, 1);
+    ob->buf[ob->len++] = (uchar)v;
+}
+
+void put16(outbuf *ob, ulong v){
+    put8(ob, (v >> 8) & 0xff);
+    put8(ob, v & 0xff);
+}
+
+void put32(outbuf *ob, ulong v){
+    put16(ob, (v >> 16) & 0xffff);
+    put16(ob, v & 0xffff);
+}
+
+void set16(outbuf *ob, size_t pos, ulong v){
+    ob->buf[pos] = (v >> 8) & 0xff;
+    ob->buf[pos+1] = v & 0xff;
+}
+
+void set32(outbuf *ob, size_t pos, ulong v){
+    set16(ob, pos, (v >> 16) & 0xffff);
+    set16(ob, pos+2, v & 0xffff);
+}
+
+ulong get32(outbuf *ob, size_t pos){
+    return ((ulong)ob->buf[pos]<<24) | ((ulong)ob->buf[pos+1]<<16)
+        | ((ulong)ob->buf[pos+2]<<8) | (ulong)ob->buf[pos+3];
+}
+
+
+/*
+ * pad a table to 4 bytes
+ * in:  on-memory output
+ * out: nothing
+ */
+void pad4(outbuf *ob){
+    while(ob->len & 3)
+        put8(ob, 0);
+}
+
+
+/*
+ * print an error message, and exit
+ */
+void errexit(char *fmt, ...){
+        va_list ap;
+        va_start(ap, fmt);
+        fprintf(stderr, "  Error: ");
+        vfprintf(stderr, fmt, ap);
+        fprintf(stderr, "\n");
+        va_end(ap);
+
+        exit(EXIT_FAILURE);
+}
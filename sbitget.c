@@ -37,533 +37,3975 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h> /* offsetof() */
 #include <sys/stat.h> /* stat() */
 #include <stdarg.h> /* vfprintf() */
 #include <unistd.h>
+#include <setjmp.h> /* setjmp() */
+#include <time.h> /* clock_gettime() */
+#include <errno.h> /* EEXIST */
+#include "sbit.h"
+#ifndef _WIN32
+#include <sys/mman.h> /* mmap() */
+#include <fcntl.h> /* open() */
+#include <pthread.h>
+#define USE_MMAP
+#define USE_THREAD
+#else
+#include <io.h> /* _setmode() */
+#include <fcntl.h> /* _O_BINARY */
+#include <direct.h> /* _mkdir() */
+#define mkdir(dir, mode) _mkdir(dir)
+#endif
+
+#ifdef USE_THREAD
+#define THREADLOCAL __thread
+#else
+#define THREADLOCAL
+#endif
 
 #define uchar unsigned char
 #define ulong unsigned long
 #define ushort unsigned short
-#define BUFSIZE 64
-#define GLYPHBUFSIZE 1000
-#define MAXGLYPHWIDTH 128
-#define TMPFILE "sbit.tmp"
+#define ullong unsigned long long
+#define GLYPHHEADSIZE 128
+#define OUTBUFSIZE 65536
 #define MAXFILENAMECHAR 256
+#define READCHUNK 65536
+#define GLYPHSPERCHUNK 512
 #define MAXSTRINGINBDF 1000
 #define LEVELCOPYRIGHTSTR 4
 #define LEVELFONTNAMESTR 8
 #define STRUNKNOWN "???"
 
-//info of tables
-typedef struct linkedlist_tag{
-    struct linkedlist_tag *next; //next element's on-memory location
+//output formats
+#define FMT_BDF 0
+#define FMT_PCF 1
+#define FMT_ATLAS 2
+#define FMT_PNG 3
+
+#define ATLASGAP 1 //(pixel) space between glyphs in an atlas
+#define ARENABLOCK 65536 //(byte) a block of scratch memory (larger ones for larger requests)
+#define ARENAALIGN 16 //(byte) scratch memory is given out at multiples of this
+#define HASHINIT 14695981039346656037ULL //FNV-1a (64 bit) of nothing
+#define CACHEMAGIC "sbitget-cache 1" //first line of the manifest of --cache
+
+//PCF table types and format bits
+#define PCF_PROPERTIES (1<<0)
+#define PCF_ACCELERATORS (1<<1)
+#define PCF_METRICS (1<<2)
+#define PCF_BITMAPS (1<<3)
+#define PCF_BDF_ENCODINGS (1<<5)
+#define PCF_GLYPH_NAMES (1<<7)
+#define PCF_BDF_ACCELERATORS (1<<8)
+#define PCF_COMPRESSED_METRICS 0x100
+#define PCF_BYTE_MASK (1<<2) //numbers (and bitmap units) are big-endian
+#define PCF_BIT_MASK (1<<3)  //the left pixel is the highest bit
+#define PCF_NUMTABLE 7
+#define PCF_MAXPROP 16
+
+//name of a table as a 32-bit number (e.g. TAG('E','B','D','T'))
+#define TAG(a,b,c,d) (((ulong)(a)<<24) | ((ulong)(b)<<16) | ((ulong)(c)<<8) | (ulong)(d))
+//name of a table at on-memory location p
+#define TAGAT(p) TAG((p)[0], (p)[1], (p)[2], (p)[3])
+
+//table directory of a font
+//  the table records (16 bytes each) are used where they are,
+//  sorted by tag
+typedef struct {
+    uchar *recordL; //on-memory location: top of table records
+    ushort numTable; //number of tables
+    ulong searchRange; //(largest power of 2 <= numTable) * 16
+    int sorted; //1==records are sorted by tag (0==search one by one)
+} tabledir;
+
+//info of a table
+typedef struct {
+    ulong tag; //name of this table
+    ulong checksum;
     ulong offset; //(byte) offset from top of TrueTypeFile to top of this table
-    //    ulong len; //(byte) length of this table
-    char tag[5];     //name of this table (4 characters + '\0')
+    ulong len; //(byte) length of this table
 } tableinfo;
 
 //info of glyph-metric (metric means size)
 typedef struct {
     uchar width;
     uchar height;
-    ulong off;  //offset from top of EBDT to top of glyph data
     uchar advance; // same as DWIDTH(BDF)
     int offsetx;   //offset of boundingbox from origin to point of
                    //most right-under.
                    // that is, the axis of most right-under
     int offsety;
     uchar ppem; //pixel-size in this strike
-    uchar *ebdtL; //on-memory location: top of EBDT
     int imageFormat;
     ushort id; //glyph ID number (index number)
+    long encoding; //character code (Unicode) of this glyph (-1==unknown)
+    int outFormat; //FMT_BDF: write BDF text, others: write glyphrec
+    struct compcache_tag *comps; //glyphs of this strike for composite glyphs
+    int nest; //0==a glyph to write, 1-==a component being decoded
+    struct arena_tag *scratch; //scratch memory of this thread (composed bitmaps)
 } metricinfo;
 
-typedef struct {
-    uchar *subtableL; //location top of indexSubTable (in EBLC)
-    ushort first; //firstGlyphIndex
-    ushort last; //lastGlyphIndex
-    int indexFormat;
-    ulong off; //imageDataOffset from EBDTtop to locationOfGlyphsData
-} indexSubTable_info;
-
 typedef struct {
     uchar *strL;
     ushort slen;
 } str_info;
 
+//a decoded glyph on memory (-f pcf, atlas),  followed by its bitmap:
+//  rows from top,  (width+7)/8 bytes a row,  the left pixel in the highest bit
+typedef struct {
+    long encoding; //character code (-1==none)
+    ushort id; //glyphID
+    uchar width;
+    uchar height;
+    uchar advance;
+    short offsetx;
+    short offsety;
+} glyphrec;
+
+//a glyph of a color strike (-f png):  its PNG image is not copied,
+//  but written from the font when the strike is written
+typedef struct {
+    long encoding; //character code (-1==none)
+    ushort id; //glyphID
+    uchar width;
+    uchar height;
+    uchar advance;
+    short offsetx;
+    short offsety;
+    ulong off; //offset from top of CBDT to top of the PNG image
+    ulong len; //(byte) length of the PNG image
+} pngrec;
+
+//metrics of a glyph in PCF (or bounds of all glyphs)
+typedef struct {
+    int lsb;     //left side bearing
+    int rsb;     //right side bearing
+    int width;   //advance
+    int ascent;
+    int descent;
+} pcfmetric;
+
+//how bitmaps are stored in a PCF font
+typedef struct {
+    int pad;     //(byte) a row of a glyph is padded to this (1, 2, 4, 8)
+    int unit;    //(byte) unit of byte order in a row (1, 2, 4)
+    int bitMSB;  //1==the left pixel is the highest bit of a byte
+    int byteMSB; //1==big-endian numbers and units
+} pcfparam;
+
+//a block of scratch memory,  followed by the memory given out
+typedef struct arenablock_tag {
+    struct arenablock_tag *prev; //block used before this (NULL==first)
+    size_t len;   //(byte) given out
+    size_t alloc; //(byte) size of this block (without this header)
+} arenablock;
+
+//scratch memory of a strike:  given out in order from big blocks,
+//  and released at once (no malloc()/free() for each glyph)
+typedef struct arena_tag {
+    arenablock *cur; //block giving out now (NULL==no block)
+    arenablock *spare; //block released by ar_rewind(),  used again (NULL==none)
+} arena;
+
+//a place in an arena to go back to (ar_mark(), ar_rewind())
+typedef struct {
+    arenablock *b;
+    size_t len;
+} arenamark;
+
+//a decoded glyph (glyphrec and its bitmap) is this size at most:
+//  width and height are 255 at most
+#define MAXGLYPHREC (sizeof(glyphrec) + (size_t)((255 + 7) / 8) * 255)
+
+//decoded glyphs of a strike used as components of composite glyphs
+//  (EBDT format 8, 9),  decoded once for the strike
+typedef struct compcache_tag {
+    sbitrange *subs; //indexSubTables of the strike (checked)
+    int nsub; //number of indexSubTables
+    const sbittables *tables; //EBLC and EBDT of the strike
+    char **memo; //decoded glyph (glyphrec) of each glyphID (NULL==not yet)
+    arena mem; //memory of memo and the decoded glyphs
+#ifdef USE_THREAD
+    pthread_mutex_t lock;
+#endif
+} compcache;
+
+//where a glyph is in an atlas
+typedef struct {
+    char *rec; //on-memory location: the decoded glyph (glyphrec)
+    int w;     //(pixel) size of the glyph
+    int h;
+    int x;     //(pixel) left of the glyph
+    int y;     //(pixel) top of the glyph
+    int same;  //index of the first glyph with the same image
+} atlasplace;
+
+//growable on-memory output (one BDF strike)
+typedef struct {
+    char *buf;    //on-memory location: top of output
+    size_t len;   //(byte) length written
+    size_t alloc; //(byte) allocated size
+} outbuf;
+
+//where to go back when errexit() is called
+typedef struct errtrap_tag {
+    jmp_buf env;
+    char msg[MAXSTRINGINBDF]; //error message
+    struct errtrap_tag *prev; //trap which was set before this
+} errtrap;
+
+//where glyphs come from, and which glyphs are wanted
+typedef struct {
+    uchar *ebdtL;   //on-memory location: top of EBDT
+    ulong ebdtLen;  //(byte) length of EBDT
+    long *encoding; //character code of each glyphID (-1==none),
+                    //  NULL==no cmap
+    uchar *wanted;  //bits of glyphIDs to extract (NULL==all glyphs)
+    struct coderange_tag *ids; //glyphIDs to extract, sorted (NULL==all glyphs)
+    int nid; //number of ranges of glyphIDs
+    int format; //output format (FMT_BDF, FMT_PCF, FMT_ATLAS, FMT_PNG)
+} glyphsource;
+
+//a font in a file (TTC has some fonts)
+typedef struct {
+    uchar *eblcL; //on-memory location: top of EBLC (or CBLC with -f png)
+                  //  (NULL==no bitmap)
+    ulong eblcLen; //(byte) length of EBLC
+    uchar *cmapL; //on-memory location: Unicode subtable of cmap (NULL==none)
+    glyphsource src;
+    int ownsrc; //1==src.encoding/wanted are allocated for this font
+                //0==shared with a font before this
+    char copyright[MAXSTRINGINBDF];
+    char fontname[MAXSTRINGINBDF];
+    ullong sumkey; //hash of checksums of its tables (--cache)
+    ullong datakey; //hash of its 'name' and 'cmap' (--cache)
+    int stale; //1==a checksum in the table directory is not of its table (--cache)
+} faceinfo;
+
+//range of character codes (or glyphIDs, ppems)
+typedef struct coderange_tag {
+    ulong lo;
+    ulong hi;
+} coderange;
+
+//command line options
+typedef struct {
+    int nthread; //number of threads
+    coderange *ranges; //character codes to extract (NULL==all)
+    int nrange; //number of ranges
+    coderange *ids; //glyphIDs to extract (NULL==all)
+    int nid; //number of ranges of glyphIDs
+    coderange *ppems; //sizes to extract (NULL==all)
+    int nppem; //number of ranges of sizes
+    char *outname; //write all fonts to this file (NULL==a file for each, "-"==stdout)
+    FILE *msgfp; //messages about input files (stderr when fonts go to stdout)
+    int format; //output format (FMT_BDF, FMT_PCF, FMT_ATLAS, FMT_PNG)
+    pcfparam pcf; //bitmap layout of PCF
+    int depth; //bits of a pixel in an atlas (1==PBM, 8==PGM)
+    int binmetrics; //1==metrics of an atlas in binary, 0==JSON
+    int stats; //statistics at the end: 0==none, 1==text, 2==JSON (--stats)
+    struct cacheinfo_tag *cache; //manifest of --cache (NULL==extract all)
+} options;
+
+//BDF fonts of all strikes written to one stream (-o),  in order of strikes
+typedef struct {
+    FILE *fp;
+    char *name; //filename ("-"==stdout)
+    int n; //number of strikes
+    int next; //next strike to write
+#ifdef USE_THREAD
+    pthread_mutex_t lock;
+#endif
+} bdfstream;
+
+//glyphs decoded in a strike (--stats)
+typedef struct {
+    ulong byIndex[6]; //number of glyphs of each indexFormat (1-5)
+    ulong byImage[20]; //number of glyphs of each imageFormat (1-9, 17-19)
+    ullong dataBytes; //(byte) glyph data read from EBDT
+    int maxWidth; //(pixel) the largest glyph (by area)
+    int maxHeight;
+    ushort maxId; //its glyphID
+} glyphstat;
+
+//time and bytes of a strike (--stats)
+//  time is of the threads working for the strike:  wall and CPU (second)
+typedef struct {
+    int ppem;
+    double index, indexCpu; //checking indexSubTables and glyph data (and --cache)
+    double decode, decodeCpu; //decoding glyphs
+    double build, buildCpu; //making headers, PCF tables, an atlas...
+    double write, writeCpu; //writing files
+    ullong written; //(byte) written to files
+    glyphstat glyphs;
+} strikestats;
+
+//a strike in the manifest of --cache:  an output file,
+//  and what it was made from
+typedef struct {
+    int index; //number of the bitmapSizeTable
+    ullong key; //hash of the strike's tables and glyph data
+    char *fname; //output file
+} cachestrike;
+
+//an input file in the manifest of --cache
+typedef struct {
+    char *fname; //input file
+    ullong key; //hash of checksums of its tables
+    cachestrike *strikes;
+    int nstrike;
+    int seen; //1==given this time (its new record is written)
+} cachefont;
+
+//manifest of --cache
+typedef struct cacheinfo_tag {
+    char *name; //filename of the manifest
+    ullong optkey; //hash of options which change output files
+    cachefont *fonts; //sorted by fname
+    int nfont;
+} cacheinfo;
+
+//a strike to extract
+typedef struct {
+    uchar *eblcL; //on-memory location: top of EBLC
+    ulong eblcLen; //(byte) length of EBLC
+    glyphsource *src; //glyphs of this strike
+    faceinfo **faces; //fonts which share this strike
+    int nface; //number of fonts which share this strike
+    int index; //number of the bitmapSizeTable
+    int nthread; //number of threads for glyphs in this strike
+    char **fnames; //bdf filename for each font
+    int nwritten; //number of bdf files written
+    int failed; //1==error
+    char msg[MAXSTRINGINBDF]; //error message
+    char *fname; //bdf filename being written
+    FILE *outfp;
+    outbuf heads; //BDF header (PCF header and properties) for each font
+    size_t *headlen; //(byte) length of each font's header in heads
+    outbuf glyphs; //BDF glyphs of this strike (CHARS must precede them),
+                   //  or PCF tables after the properties,  or pixels of an atlas
+    outbuf side; //metrics of an atlas (written next to each image)
+    sbittables tables; //EBLC and EBDT (CBLC and CBDT with -f png)
+    sbitrange *subs; //indexSubTables to read (checked once)
+    int nsub; //number of indexSubTables to read
+    compcache comps; //components of composite glyphs
+    arena scratch; //scratch memory of decoding and building this strike
+    char stat[MAXSTRINGINBDF]; //report of this strike ("" == none)
+    char warn[MAXSTRINGINBDF]; //indexSubTables skipped ("" == none)
+    strikestats stats; //--stats
+    options *opt;
+    bdfstream *stream; //NULL==write bdf files
+    int done; //1==extracted (or failed),  waiting to be streamed
+    cachefont *was; //this file in the manifest of --cache (NULL==new)
+    ullong cachekey; //hash of what this strike is made from (--cache)
+    int cached; //1==output files are up to date (--cache),  not written
+} strikejob;
+
+//a part of a strike: some glyphs of an indexSubTable
+typedef struct {
+    sbitrange st;
+    glyphsource *src; //glyphs of this strike
+    ulong from; //first entry to read
+    ulong to; //(last entry to read) + 1
+    compcache *comps; //components of composite glyphs
+    arena scratch; //scratch memory of decoding this part
+    ushort numGlyphs; //number of glyphs decoded
+    int timed; //1==count glyphs and time (--stats)
+    glyphstat stats; //glyphs decoded
+    double cpu; //(second) CPU time to decode
+    int failed; //1==error
+    char msg[MAXSTRINGINBDF]; //error message
+    outbuf glyphs; //BDF glyphs of this part
+} glyphchunk;
+
+//jobs shared by threads
+typedef struct {
+    void (*fn)(void *arg, int i);
+    void *arg;
+    const int *order; //order to take jobs (NULL==from index 0)
+    int n; //number of jobs
+    int next; //next job to take
+#ifdef USE_THREAD
+    pthread_mutex_t lock;
+#endif
+} workqueue;
+
+//a TrueTypeFile on memory
+typedef struct {
+    uchar *top;  //on-memory location: top of TrueTypeFile
+    size_t size; //(byte) size of TrueTypeFile
+    int mapped;  //1==mmap()ed, 0==read into malloc()ed memory
+} fontfile;
+
+//reading position in a big-endian table
+typedef struct {
+    uchar *p;   //on-memory location to read next
+    uchar *top; //on-memory location: top of the table being read
+} cursor;
+
+//an input file
+typedef struct {
+    char *fname; //filename
+    fontfile ff;
+    int opened; //1==ff is on memory
+    faceinfo *faces; //fonts in this file
+    int numFace; //number of fonts in this file
+    faceinfo **sharing; //fonts grouped by EBLC/EBDT
+    int firstJob; //index of the first strike of this file
+    int numJob; //number of strikes of this file
+    int nwritten; //number of bdf files written
+    int nfailed; //number of strikes which failed
+    double read, readCpu; //(second) reading the file and its tables (--stats)
+    cachefont *was; //this file in the manifest of --cache (NULL==new)
+    ullong cachekey; //hash of checksums of its tables (--cache)
+    int ncached; //number of strikes up to date (--cache)
+    int failed; //1==this file cannot be read
+    char msg[MAXSTRINGINBDF]; //error message
+} fontjob;
+
+//hash table of filenames
+typedef struct {
+    char **names; //NULL==empty
+    size_t alloc; //size of table
+    size_t n; //number of filenames
+} namemap;
+
+//estimated size of a strike
+typedef struct {
+    ulong cost;
+    int index; //index of the strike
+} jobcost;
+
 /* func prototype */
 int main(int argc, char **argv);
-void see_eblc(uchar *eblcL, uchar *ebdtL, char *copyright, char *fontname);
-ushort see_indexSubTable(indexSubTable_info *st, uchar *ebdtL, FILE *outfp);
-void getTableInfo(uchar *p, tableinfo *t);
-void validiateTTF(uchar *p);
-uchar *mread(uchar *p, int size, char *s);
+void openfont(char *fname, fontfile *ff);
+void closefont(fontfile *ff);
+void advisefont(fontfile *ff, uchar *tableL, ulong len, int sequential);
+void see_file(fontjob *fj, strikejob **jobs, int *numJob, namemap *used, options *opt);
+void addFile(char *fname, char ***fnames, int *numFile, int *allocFile);
+void readFileList(char *listname, char ***fnames, int *numFile, int *allocFile);
+void see_face(fontfile *ff, uchar *dirL, faceinfo *face, options *opt);
+void see_eblc(fontjob *fj, strikejob **jobs, int *numJob, namemap *used, options *opt);
+void see_strike(void *arg, int i);
+void putheads(strikejob *job, metricinfo *bbox, int totalglyphs);
+void putpcf(strikejob *job, metricinfo *bbox, int totalglyphs);
+void pcf_props(outbuf *ob, ulong format, faceinfo *face, metricinfo *bbox, int unicode);
+void pcf_accel(outbuf *ob, ulong format, pcfmetric *minb, pcfmetric *maxb,
+               int ascent, int descent, int maxOverlap);
+void pcf_metric(outbuf *ob, pcfmetric *m, int msb);
+void pcf_put(outbuf *ob, ulong v, int size, int msb);
+void pcf_align(outbuf *ob);
+void putatlas(strikejob *job, metricinfo *bbox, int totalglyphs);
+void putpng(strikejob *job, metricinfo *bbox, int totalglyphs);
+ulong packatlas(atlasplace *pl, int n, int *width, int *height, arena *scratch);
+int cmpPlace(const void *a, const void *b);
+void sidename(char *sname, char *fname, const char *ext);
+int dedupglyphs(char **recs, int n, int *same, arena *scratch);
+double nowsec(void);
+double cpusec(int all);
+void lap(double *t, double *c, double *wall, double *cpu);
+void noteglyph(glyphstat *gs, int indexFormat, metricinfo *g, ulong size);
+void addglyphstat(glyphstat *to, glyphstat *from);
+void putstats(FILE *fp, options *opt, fontjob *files, int numFile, strikejob *jobs,
+              double wall, double cpu);
+void json_str(FILE *fp, const char *s);
+void ob_jsonstr(outbuf *ob, const char *s);
+void writefont(FILE *fp, char *head, size_t headlen, outbuf *glyphs, int format);
+void freefonts(strikejob *job);
+void streamfonts(strikejob *jobs, int i);
+void bdfname(char *fname, char *fontname, int ppem, const char *ext);
+void uniqname(namemap *used, char *fname);
+int nm_find(namemap *used, char *fname, size_t *index);
+void nm_remove(namemap *used, char *fname);
+void orderJobs(strikejob *jobs, int numJob, int *order);
+int cmpJobcost(const void *a, const void *b);
+int runjobs(int njob, int nthread, void (*fn)(void *arg, int i), void *arg,
+            const int *order);
+#ifdef USE_THREAD
+void *jobworker(void *arg);
+#endif
+void pushtrap(errtrap *trap);
+void untrap(errtrap *trap);
+ullong hashbytes(ullong h, const uchar *p, size_t n);
+ullong hashnum(ullong h, ullong v);
+ullong hashtable(ullong h, tableinfo *t);
+ulong tablesum(const uchar *p, ulong len);
+void cache_table(faceinfo *face, uchar *ttfL, tableinfo *t);
+ullong optkey(options *opt);
+ullong strikekey(strikejob *job, uchar *sizeL);
+void cache_load(cacheinfo *cache, options *opt);
+void cache_font(cacheinfo *cache, fontjob *fj, strikejob *jobs);
+int cache_stored(strikejob *job, ullong *key);
+void cache_save(cacheinfo *cache, fontjob *files, int numFile, strikejob *jobs);
+void cache_free(cacheinfo *cache);
+long readline(FILE *fp, char **line, size_t *alloc);
+int cmpCachefont(const void *a, const void *b);
+int fileexists(const char *fname);
+ushort see_indexSubTable(sbitrange *st, glyphsource *src, compcache *cc,
+                         arena *scratch, glyphstat *gs, outbuf *ob, ulong from, ulong to);
+int pickglyph(glyphsource *src, metricinfo *glyph);
+void see_chunk(void *arg, int i);
+ushort see_chunks(strikejob *job);
+void checkSubTables(strikejob *job, uchar *arrayL, int numElem);
+int inspan(ullong off, ullong len, ullong size);
+void getTableDir(uchar *p, tabledir *dir);
+int findTable(tabledir *dir, ulong tag, tableinfo *t);
+int checkTable(fontfile *ff, tableinfo *t);
+int validiateTTF(uchar *p, size_t size, FILE *msgfp);
+void cur_init(cursor *c, uchar *top);
+uchar cur_u8(cursor *c);
+signed char cur_i8(cursor *c);
+ushort cur_u16(cursor *c);
+ulong cur_u32(cursor *c);
+void cur_skip(cursor *c, ulong n);
+ulong cur_pos(cursor *c);
 void see_bitmapSizeTable(uchar *p, int *numElem, ulong *arrayOffset, metricinfo *bbox);
-uchar *see_sbitLineMetrics(uchar *p, metricinfo *bbox, int direction);
-void see_indexSubTableArray(uchar *elemL, uchar *arrayL, indexSubTable_info *st);
-int see_indexSubHeader(indexSubTable_info *st);
-void putglyph(metricinfo *glyph, int size, FILE *outfp);
-void setGlyphHead(metricinfo *g, char *s);
-void setGlyphBody_byte(uchar *p, const uchar *end, metricinfo *g, char *s);
-void setGlyphBody_bit(uchar *p, const uchar *end, metricinfo *g, char *s);
+void see_sbitLineMetrics(cursor *c, metricinfo *bbox, int direction);
+void putglyph(metricinfo *glyph, const sbittables *t, sbitrange *st, sbitentry *e,
+              outbuf *ob);
+uchar *setComposite(sbitimage *img, metricinfo *g);
+char *getComponent(compcache *cc, ushort id, int nest, arena *scratch);
+sbitrange *findglyph(compcache *cc, ushort id, sbitentry *e);
+void cc_init(compcache *cc);
+void cc_free(compcache *cc);
+void ob_init(outbuf *ob);
+void ob_reserve(outbuf *ob, size_t n);
+void ob_write(outbuf *ob, const char *s, size_t n);
+void ob_free(outbuf *ob);
+void ar_init(arena *a);
+void *ar_alloc(arena *a, size_t n);
+void ar_mark(arena *a, arenamark *m);
+void ar_rewind(arena *a, arenamark *m);
+void ar_free(arena *a);
+char *setGlyphHead(metricinfo *g, char *d);
+void setGlyphRec(sbitimage *img, metricinfo *g, outbuf *ob);
+void setPngRec(sbitimage *img, const uchar *ebdtL, metricinfo *g, outbuf *ob);
+char *setGlyphBody(const uchar *rows, metricinfo *g, char *d);
+char *bdf_hex(char *d, uchar v);
+char *bdf_int(char *d, int v);
+char *bdf_str(char *d, const char *s, size_t n);
+char *bdf_name(char *d, long encoding, ushort id);
 void errexit(char *fmt, ...);
-uchar *see_glyphMetrics(uchar *p, metricinfo *met, int big);
-void see_name(uchar *nameL, char *copyright, char *fontname);
+void see_name(uchar *nameL, ulong len, char *copyright, char *fontname);
 void copystr(char *dst, uchar *src, ushort len, int forFilename);
+uchar *see_cmap(uchar *cmapL, ulong len);
+int checkCmap(uchar *subL, ulong avail);
+long *makeEncoding(uchar *subL);
+void markCodes(uchar *subL, ulong lo, ulong hi, uchar *wanted);
+ushort cmap4glyph(uchar *subL, int segCount, int seg, ulong code);
+void addRange(char *arg, coderange **ranges, int *nrange, int hex);
+int rangebase(const char *p, int hex);
+void sortRanges(coderange *ranges, int *nrange);
+int cmpRange(const void *a, const void *b);
+int inRanges(coderange *ranges, int nrange, ulong lo, ulong hi);
+int see_idRange(sbitrange *st, glyphsource *src, int r, ulong *from, ulong *to);
 
+//write a string literal in BDF text
+#define bdf_lit(d, lit) bdf_str((d), (lit), sizeof(lit)-1)
+
+//trap for errexit() in this thread (NULL==exit program)
+static THREADLOCAL errtrap *curtrap = NULL;
 
 
 /*
- * reading a TrueType font
+ * reading TrueType fonts
  *   calling functions for 'name', 'EBLC', 'EBDT' tables
+ *   strikes of all files are extracted by the same threads
  */
 int main(int argc, char **argv){
-    uchar *ttfL; //on memory location: top of TrueTypeFile
-    char copyright[MAXSTRINGINBDF] = STRUNKNOWN;
-    char fontname[MAXSTRINGINBDF] = STRUNKNOWN;
-
-
-    if(argc!=2){
+    char **fnames = NULL; //input files
+    int numFile = 0, allocFile = 0;
+    int batch = 0; //1==more than one file, or a list of files
+    options opt;
+    int failed = 0;
+    int i, j;
+    fontjob *files;
+    strikejob *jobs = NULL;
+    int numJob = 0;
+    namemap used; //bdf filenames already used
+    bdfstream stream; //used with -o
+    double start = 0, startCpu = 0; //--stats
+    cacheinfo cache; //--cache
+    int numRun; //number of strikes to extract (not up to date)
+
+    memset(&opt, 0x00, sizeof(opt));
+    opt.nthread = 1;
+    opt.format = FMT_BDF;
+    //the same as bdftopcf on most systems
+    opt.pcf.pad = 4;
+    opt.pcf.unit = 1;
+    opt.pcf.bitMSB = 1;
+    opt.pcf.byteMSB = 1;
+    opt.depth = 8;
+    for(i=1; i<argc; i++){
+        if(strcmp(argv[i], "-j")==0 && i+1<argc){
+            opt.nthread = atoi(argv[++i]);
+        }else if(strncmp(argv[i], "-j", 2)==0 && argv[i][2]!='\0'){
+            opt.nthread = atoi(argv[i]+2);
+        }else if(strcmp(argv[i], "-c")==0 && i+1<argc){
+            addRange(argv[++i], &opt.ranges, &opt.nrange, 1);
+        }else if((strcmp(argv[i], "-g")==0 || strcmp(argv[i], "--glyphs")==0) && i+1<argc){
+            addRange(argv[++i], &opt.ids, &opt.nid, 0);
+        }else if((strcmp(argv[i], "-p")==0 || strcmp(argv[i], "--ppem")==0) && i+1<argc){
+            addRange(argv[++i], &opt.ppems, &opt.nppem, 0);
+        }else if(strcmp(argv[i], "-o")==0 && i+1<argc){
+            opt.outname = argv[++i];
+        }else if((strcmp(argv[i], "-f")==0 || strcmp(argv[i], "--format")==0) && i+1<argc){
+            i++;
+            if(strcmp(argv[i], "bdf")==0)
+                opt.format = FMT_BDF;
+            else if(strcmp(argv[i], "pcf")==0)
+                opt.format = FMT_PCF;
+            else if(strcmp(argv[i], "atlas")==0)
+                opt.format = FMT_ATLAS;
+            else if(strcmp(argv[i], "png")==0)
+                opt.format = FMT_PNG;
+            else
+                opt.format = -1;
+        }else if(strcmp(argv[i], "--depth")==0 && i+1<argc){
+            opt.depth = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "--metrics")==0 && i+1<argc){
+            i++;
+            opt.binmetrics = (strcmp(argv[i], "bin")==0) ? 1 : (strcmp(argv[i], "json")==0) ? 0 : -1;
+        }else if(strcmp(argv[i], "--stats")==0 && i+1<argc){
+            i++;
+            opt.stats = (strcmp(argv[i], "text")==0) ? 1 : (strcmp(argv[i], "json")==0) ? 2 : -1;
+        }else if(strcmp(argv[i], "--pad")==0 && i+1<argc){
+            opt.pcf.pad = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "--unit")==0 && i+1<argc){
+            opt.pcf.unit = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "--bit-order")==0 && i+1<argc){
+            i++;
+            opt.pcf.bitMSB = (strcmp(argv[i], "msb")==0) ? 1 : (strcmp(argv[i], "lsb")==0) ? 0 : -1;
+        }else if(strcmp(argv[i], "--byte-order")==0 && i+1<argc){
+            i++;
+            opt.pcf.byteMSB = (strcmp(argv[i], "msb")==0) ? 1 : (strcmp(argv[i], "lsb")==0) ? 0 : -1;
+        }else if(strcmp(argv[i], "--cache")==0 && i+1<argc){
+            cache.name = argv[++i];
+            opt.cache = &cache;
+        }else if(strcmp(argv[i], "-l")==0 && i+1<argc){
+            readFileList(argv[++i], &fnames, &numFile, &allocFile);
+            batch = 1;
+        }else if(argv[i][0]!='-'){
+            addFile(argv[i], &fnames, &numFile, &allocFile);
+        }else{
+            numFile = 0;
+            break;
+        }
+    }
+    if(numFile==0 || opt.nthread<1 || opt.format<0
+       || (opt.pcf.pad!=1 && opt.pcf.pad!=2 && opt.pcf.pad!=4 && opt.pcf.pad!=8)
+       || (opt.pcf.unit!=1 && opt.pcf.unit!=2 && opt.pcf.unit!=4)
+       || opt.pcf.unit > opt.pcf.pad || opt.pcf.bitMSB<0 || opt.pcf.byteMSB<0
+       || (opt.depth!=1 && opt.depth!=8) || opt.binmetrics<0 || opt.stats<0
+       || ((opt.format==FMT_ATLAS || opt.format==FMT_PNG) && opt.outname!=NULL)
+       || (opt.cache!=NULL && opt.outname!=NULL)){
         fprintf(stderr, PROGNAME " version " PROGVERSION " - extract bitmap-data from a TrueType font\n");
-        fprintf(stderr, "usage:  " PROGNAME " file.ttf\n");
+        fprintf(stderr, "usage:  " PROGNAME " [-j threads] [-c from-to] [-g from-to] [-p ppem]\n"
+                "                [-o out.bdf] [-l listfile] [-f bdf|pcf] [--pad 1|2|4|8]\n"
+                "                [--unit 1|2|4] [--bit-order msb|lsb] [--byte-order msb|lsb]\n"
+                "                [-f atlas|png] [--depth 1|8] [--metrics json|bin]\n"
+                "                [--stats text|json] [--cache manifest] file.ttf ...\n");
         exit(1);
     }
+    //glyphs are written in order of glyphIDs,  once for each
+    sortRanges(opt.ids, &opt.nid);
+    //fonts on stdout must not be mixed with messages
+    opt.msgfp = stdout;
+    if(opt.outname != NULL && strcmp(opt.outname, "-")==0)
+        opt.msgfp = stderr;
+    if(numFile > 1)
+        batch = 1;
+    if(opt.stats){
+        start = nowsec();
+        startCpu = cpusec(1);
+    }
+    if(opt.cache != NULL)
+        cache_load(&cache, &opt);
 
     /*
-     * reading TrueTypeFile to Memory
+     * reading each file
+     *   get fonts in it, and make jobs for its strikes
      */
-    {
-        FILE *fp;
-        size_t ttfsize;
-        struct stat info;
-
-        if((fp=fopen(argv[1],"rb"))==NULL)
-            errexit("cannot open '%s'", argv[1]);
-        if(stat(argv[1], &info) != 0)
-            errexit("stat");
-        ttfsize = info.st_size;
-        if((ttfL=malloc(ttfsize))==NULL)
-            errexit("malloc");
-        if(fread(ttfL, 1, ttfsize, fp)!=ttfsize)
-            errexit("fread");
-        fclose(fp);
+    if((files=calloc(numFile, sizeof(fontjob)))==NULL)
+        errexit("calloc");
+    memset(&used, 0x00, sizeof(used));
+    for(i=0; i<numFile; i++){
+        double t = 0, c = 0; //--stats
+
+        files[i].fname = fnames[i];
+
+        if(batch)
+            fprintf(opt.msgfp, "%s\n", fnames[i]);
+        if(opt.stats){
+            t = nowsec();
+            c = cpusec(0);
+        }
+        see_file(&files[i], &jobs, &numJob, &used, &opt);
+        if(opt.stats)
+            lap(&t, &c, &files[i].read, &files[i].readCpu);
+        //a file which cannot be read is an error only in batch mode
+        if(files[i].failed && !batch)
+            errexit("%s", files[i].msg);
+        if(opt.cache != NULL && !files[i].failed)
+            cache_font(&cache, &files[i], jobs);
     }
 
-    //ckeck this file is TrueType? or not
-    validiateTTF(ttfL);
-
+    /*
+     * extracting strikes
+     *   strikes are independent, so they can be extracted at the same time.
+     *   larger strikes are taken first, so that threads end together
+     */
     {
-        tableinfo table; //store the first table
-                          //dynamically allocate second and after tables
-        tableinfo *t; //loop
-        uchar *eblcL = NULL; //on memory location: top of EBLC table
-        uchar *ebdtL = NULL; //on memory location: top of EBDT table
+        int *order;
 
-        //get locations of tables
-        getTableInfo(ttfL, &table);
-
-        /*
-         * reading name table
-         *   get strings of copyright, fontname
-         */
-        for(t=table.next; t->next!=NULL; t=t->next){
-            if(strcmp("name", t->tag)==0){
-                see_name(ttfL + t->offset, copyright, fontname);
-                break;
+        if((order=malloc(sizeof(int) * (numJob + 1)))==NULL)
+            errexit("malloc");
+        orderJobs(jobs, numJob, order);
+        //strikes up to date (--cache) need no thread
+        numRun = 0;
+        for(i=0; i<numJob; i++)
+            numRun += !jobs[i].cached;
+        for(i=0; i<numJob; i++){
+            //threads not used for strikes are used for glyphs in a strike
+            jobs[i].nthread = (0 < numRun && numRun < opt.nthread) ? opt.nthread / numRun : 1;
+        }
+        if(opt.outname != NULL){
+            /*
+             * all fonts to one stream
+             *   strikes are taken in order of the output,
+             *   so that each one can be written as soon as it is extracted
+             */
+            memset(&stream, 0x00, sizeof(stream));
+            stream.name = opt.outname;
+            stream.n = numJob;
+            if(strcmp(opt.outname, "-")==0){
+                stream.fp = stdout;
+#ifdef _WIN32
+                _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            }else if((stream.fp=fopen(opt.outname, "wb"))==NULL){
+                errexit("cannot open '%s'", opt.outname);
             }
+            setvbuf(stream.fp, NULL, _IOFBF, OUTBUFSIZE);
+#ifdef USE_THREAD
+            pthread_mutex_init(&stream.lock, NULL);
+#endif
+            for(i=0; i<numJob; i++)
+                jobs[i].stream = &stream;
+            runjobs(numJob, opt.nthread, see_strike, jobs, NULL);
+#ifdef USE_THREAD
+            pthread_mutex_destroy(&stream.lock);
+#endif
+            if(fflush(stream.fp)!=0 || (stream.fp!=stdout && fclose(stream.fp)!=0))
+                errexit("cannot write '%s'", opt.outname);
+        }else{
+            runjobs(numJob, opt.nthread, see_strike, jobs, order);
         }
+        free(order);
+    }
+    if(opt.cache != NULL)
+        cache_save(&cache, files, numFile, jobs);
 
-        //EBDT table
-        for(t=table.next; t->next!=NULL; t=t->next){
-            if(strcmp("EBDT", t->tag)==0 || strcmp("bdat", t->tag)==0)
-                ebdtL = ttfL + t->offset;
+    /*
+     * report in order of files and strikes
+     */
+    for(i=0; i<numFile; i++){
+        fontjob *fj = &files[i];
+        int nfailed = 0, nwritten = 0;
+
+        for(j=fj->firstJob; j<fj->firstJob+fj->numJob; j++){
+            int k;
+            for(k=0; k<jobs[j].nwritten; k++){
+                if(opt.outname == NULL)
+                    fprintf(stderr, "  wrote '%s'\n", jobs[j].fnames[k]);
+                else
+                    fprintf(stderr, "  wrote '%s' to %s\n", jobs[j].fnames[k],
+                            strcmp(opt.outname, "-")==0 ? "stdout" : opt.outname);
+            }
+            nwritten += jobs[j].nwritten;
+            if(jobs[j].cached){
+                for(k=0; k<jobs[j].nface; k++)
+                    fprintf(stderr, "  unchanged '%s'\n", jobs[j].fnames[k]);
+                fj->ncached++;
+            }
+            if(jobs[j].stat[0] != '\0')
+                fprintf(stderr, "  %s\n", jobs[j].stat);
+            if(jobs[j].warn[0] != '\0')
+                fprintf(stderr, "  Warning: %s%sstrike %d: %s\n",
+                        batch ? fj->fname : "", batch ? ": " : "",
+                        jobs[j].index, jobs[j].warn);
+            if(jobs[j].failed){
+                fprintf(stderr, "  Error: %s%sstrike %d: %s\n",
+                        batch ? fj->fname : "", batch ? ": " : "",
+                        jobs[j].index, jobs[j].msg);
+                nfailed++;
+            }
+            for(k=0; k<jobs[j].nface; k++)
+                free(jobs[j].fnames[k]);
+            free(jobs[j].fnames);
         }
-        if(ebdtL == NULL)
-            errexit("This font has no bitmap-data.");
-
-        // EBLC table
-        for(t=table.next; t->next!=NULL; t=t->next){
-            if(strcmp("EBLC", t->tag)==0 || strcmp("bloc", t->tag)==0)
-                eblcL = ttfL + t->offset;
+        fj->nwritten = nwritten;
+        fj->nfailed = nfailed;
+        if(nfailed)
+            failed++;
+    }
+    if(batch){
+        fprintf(stderr, "summary:\n");
+        for(i=0; i<numFile; i++){
+            fontjob *fj = &files[i];
+            if(fj->failed){
+                fprintf(stderr, "  failed  %s: %s\n", fj->fname, fj->msg);
+                failed++;
+            }else if(fj->nfailed){
+                fprintf(stderr, "  failed  %s: %d files written, %d strikes failed\n",
+                        fj->fname, fj->nwritten, fj->nfailed);
+            }else if(opt.cache != NULL){
+                fprintf(stderr, "  ok      %s: %d files written, %d strikes unchanged\n",
+                        fj->fname, fj->nwritten, fj->ncached);
+            }else{
+                fprintf(stderr, "  ok      %s: %d files written\n",
+                        fj->fname, fj->nwritten);
+            }
         }
-        if(eblcL == NULL)
-            errexit("This font has no bitmap-data.");
-        see_eblc(eblcL, ebdtL, copyright, fontname);
     }
-
-    exit(EXIT_SUCCESS);
+    if(opt.stats)
+        putstats(stderr, &opt, files, numFile, jobs, nowsec() - start, cpusec(1) - startCpu);
+
+    for(i=0; i<numFile; i++){
+        for(j=0; j<files[i].numFace; j++){
+            if(files[i].faces[j].ownsrc){
+                free(files[i].faces[j].src.encoding);
+                free(files[i].faces[j].src.wanted);
+            }
+        }
+        free(files[i].faces);
+        free(files[i].sharing);
+        if(files[i].opened)
+            closefont(&files[i].ff);
+    }
+    free(files);
+    free(jobs);
+    free(used.names);
+    free(opt.ranges);
+    free(opt.ids);
+    free(opt.ppems);
+    if(opt.cache != NULL)
+        cache_free(&cache);
+    exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
 
 /*
- * reading EBLC table
- * in:  on-memory location: top of EBLC
- *      on-memory location: top of EBDT
- *      strings of copyright
- *      strings of fontname
+ * reading a TrueType font file
+ *   errors in this file don't stop other files
+ * in:  (for in and out) the file
+ *      (for in and out) strikes to extract: strikes of this file are added
+ *      (for in and out) number of strikes
+ *      (for in and out) bdf filenames already used
+ *      command line options
  * out: nothing
  */
-void see_eblc(uchar *eblcL, uchar *ebdtL, char *copyright, char *fontname){
-    char s[BUFSIZE];
-    int numSize; //number of BitmapSizeTable
-    int i,j;
+void see_file(fontjob *fj, strikejob **jobs, int *numJob, namemap *used, options *opt){
+    errtrap trap;
+    uchar *ttfL; //on memory location: top of TrueTypeFile
+    int ttc; //number of fonts in TTC (0==not TTC)
+    int i;
+
+    fj->firstJob = *numJob;
+    fj->numJob = 0;
+    pushtrap(&trap);
+    if(setjmp(trap.env)){
+        //an error occurred in this file
+        //  its bdf filenames are not used:  a file after this can have them
+        untrap(&trap);
+        for(i=fj->firstJob; i<*numJob; i++){
+            strikejob *job = &(*jobs)[i];
+            int f;
+
+            if(job->fnames == NULL)
+                continue;
+            for(f=0; f<job->nface; f++){
+                if(job->fnames[f] != NULL)
+                    nm_remove(used, job->fnames[f]);
+                free(job->fnames[f]);
+            }
+            free(job->fnames);
+        }
+        *numJob = fj->firstJob;
+        fj->failed = 1;
+        strcpy(fj->msg, trap.msg);
+        return;
+    }
 
     /*
-     * reading EBLC header
-     *   get number of bitmapSizeTable
+     * mapping TrueTypeFile to Memory
      */
-    {
-        uchar *p = eblcL;
+    openfont(fj->fname, &fj->ff);
+    fj->opened = 1;
+    ttfL = fj->ff.top;
+
+    //ckeck this file is TrueType? or not
+    ttc = validiateTTF(ttfL, fj->ff.size, opt->msgfp);
+    fj->numFace = ttc ? ttc : 1;
 
-        //version number
-        p = mread(p, sizeof(ulong), s);
+    /*
+     * reading each font (TTC has some fonts in a file)
+     */
+    if((fj->faces=calloc(fj->numFace, sizeof(faceinfo)))==NULL)
+        errexit("calloc");
+    {
+        cursor c;
+        int found = 0;
+
+        //TTC header: tag, version, numFonts, offsets of table directories
+        cur_init(&c, ttfL);
+        cur_skip(&c, 12);
+        for(i=0; i<fj->numFace; i++){
+            ulong diroff = ttc ? cur_u32(&c) : 0;
+            see_face(&fj->ff, ttfL + diroff, &fj->faces[i], opt);
+            if(fj->faces[i].eblcL != NULL)
+                found++;
+            else if(ttc)
+                fprintf(stderr, "  font %d has no bitmap-data.\n", i);
+        }
+        if(found == 0 && opt->format == FMT_PNG)
+            errexit("This font has no color bitmap-data.");
+        if(found == 0)
+            errexit("This font has no bitmap-data.");
+    }
 
-        //number of bitmapSizeTable
-        p = mread(p, sizeof(ulong), s);
-        numSize = (ulong)strtol(s,(char**)NULL,16);
+    //checksums of tables of all fonts,  compared with the manifest (--cache)
+    if(opt->cache != NULL){
+        fj->cachekey = hashnum(HASHINIT, fj->ff.size);
+        for(i=0; i<fj->numFace; i++)
+            fj->cachekey = hashnum(fj->cachekey, fj->faces[i].sumkey);
     }
 
     /*
-     * reading bitmapSizeTables
+     * make the table of glyphID -> character code,
+     *   and glyphIDs of wanted character codes
+     *   (once for fonts sharing a cmap)
      */
-    for(i=0; i<numSize; i++){
-        uchar *arrayL; //on-memory location: top of indexSubTableArray
-        int numElem; //number of indexSubTableArray-elements
-        metricinfo bbox; //strike's bounding box: metric info for strike
-        FILE *outfp;
-        ushort totalglyphs; //this program can handle under 65536 glyphs
-
-        /*
-         * reading a bitmapSizeTable
-         *    get number of indexSubTableArrays
-         *    get location of a first indexSubTableArray
-         *    get info of BoundingBox
-         */
-        {
-            ulong offset; //from EBLCtop to a first indexSubTableArray
-            //8 = size of EBLCheader,  48 = size of one bitmapSizeTable
-            see_bitmapSizeTable(eblcL+8+(48*i), &numElem, &offset, &bbox);
-            arrayL = eblcL + offset;
+    for(i=0; i<fj->numFace; i++){
+        faceinfo *face = &fj->faces[i];
+        int j, k;
+
+        face->src.ids = opt->ids;
+        face->src.nid = opt->nid;
+        face->src.format = opt->format;
+        for(j=0; j<i; j++){
+            if(fj->faces[j].cmapL == face->cmapL)
+                break;
         }
+        if(j < i){
+            face->src.encoding = fj->faces[j].src.encoding;
+            face->src.wanted = fj->faces[j].src.wanted;
+            continue;
+        }
+        face->ownsrc = 1;
+        if(face->cmapL != NULL)
+            face->src.encoding = makeEncoding(face->cmapL);
+        if(opt->ranges != NULL){
+            //without cmap, no glyph is wanted
+            if((face->src.wanted=calloc(65536/8, 1))==NULL)
+                errexit("calloc");
+            for(k=0; face->cmapL != NULL && k<opt->nrange; k++)
+                markCodes(face->cmapL, opt->ranges[k].lo, opt->ranges[k].hi,
+                          face->src.wanted);
+        }
+    }
+    see_eblc(fj, jobs, numJob, used, opt);
+    untrap(&trap);
+}
 
-        /*
-         * prepare to write a tmp file
-         */
-        if((outfp=fopen(TMPFILE,"wb"))==NULL)
-            errexit("fopen");
-        totalglyphs = 0;
 
-        /*
-         * reading indexSubTableArrays and indexSubTables
-         */
-        for(j=0; j<numElem; j++){
-            indexSubTable_info st;
+/*
+ * add a file to the list of input files
+ * in:  filename
+ *      (for in and out) list of files
+ *      (for in and out) number of files
+ *      (for in and out) allocated number of files
+ * out: nothing
+ */
+void addFile(char *fname, char ***fnames, int *numFile, int *allocFile){
+    if(*numFile == *allocFile){
+        *allocFile = *allocFile ? *allocFile * 2 : 16;
+        if((*fnames=realloc(*fnames, sizeof(char *) * *allocFile))==NULL)
+            errexit("realloc");
+    }
+    (*fnames)[(*numFile)++] = fname;
+}
 
-            /*
-             * reading an indexSubTableArray
-             *   get firstGlyphIndex, lastGlyphIndex
-             *   get location of indexSubTable
-             */
-            //8 = size of one indexSubTableArray
-        
-            see_indexSubTableArray(arrayL+(j*8), arrayL, &st);
 
-            /*
-             * reading indexSubTable
-             *   get info of glyphs... read bitmapdata... write to tmpfile...
-             */
-            totalglyphs += see_indexSubTable(&st, ebdtL, outfp);
+/*
+ * reading a list of input files (one filename in a line)
+ * in:  filename of the list ("-"==stdin)
+ *      (for in and out) list of files
+ *      (for in and out) number of files
+ *      (for in and out) allocated number of files
+ * out: nothing
+ */
+void readFileList(char *listname, char ***fnames, int *numFile, int *allocFile){
+    FILE *fp;
+    char line[MAXFILENAMECHAR];
+
+    if(strcmp(listname, "-")==0)
+        fp = stdin;
+    else if((fp=fopen(listname, "r"))==NULL)
+        errexit("cannot open '%s'", listname);
+
+    while(fgets(line, sizeof(line), fp) != NULL){
+        char *fname;
+        size_t len = strlen(line);
+
+        while(len > 0 && (line[len-1]=='\n' || line[len-1]=='\r'))
+            line[--len] = '\0';
+        if(len == 0)
+            continue;
+        if((fname=malloc(len+1))==NULL)
+            errexit("malloc");
+        memcpy(fname, line, len+1);
+        addFile(fname, fnames, numFile, allocFile);
+    }
+    if(fp != stdin)
+        fclose(fp);
+}
+
+
+/*
+ * reading a font in a file
+ *   get strings of copyright, fontname,  and locations of EBLC, EBDT, cmap
+ *   (CBLC, CBDT for color strikes instead of EBLC, EBDT)
+ *   with --cache,  hash checksums of the tables (from the table
+ *   directory,  checked with the tables),  and bytes of 'name' and 'cmap'
+ * in:  info of the file on memory
+ *      on-memory location: top of the table directory of this font
+ *      (for out) info of the font
+ *      command line options (-f png: color strikes)
+ * out: nothing
+ */
+void see_face(fontfile *ff, uchar *dirL, faceinfo *face, options *opt){
+    uchar *ttfL = ff->top;
+    int color = (opt->format == FMT_PNG);
+    int cache = (opt->cache != NULL);
+    tabledir dir;
+    tableinfo t;
+    uchar *eblcL = NULL; //on memory location: top of EBLC table
+    uchar *ebdtL = NULL; //on memory location: top of EBDT table
+    ulong eblcLen = 0, ebdtLen = 0;
+
+    strcpy(face->copyright, STRUNKNOWN);
+    strcpy(face->fontname, STRUNKNOWN);
+    face->src.encoding = NULL;
+    face->src.wanted = NULL;
+    face->ownsrc = 0;
+    face->cmapL = NULL;
+    face->eblcL = face->src.ebdtL = NULL;
+    face->sumkey = face->datakey = HASHINIT;
+    face->stale = 0;
+
+    //get locations of tables
+    //  (offsets are from top of the file, also in TTC)
+    //  12 = size of the offset table,  16 = size of a table record
+    if(!inspan(dirL - ttfL, 12, ff->size)
+       || !inspan(dirL - ttfL + 12, (ullong)((dirL[4]<<8) | dirL[5]) * 16, ff->size)){
+        fprintf(stderr, "  Warning: the table directory is out of the file.\n");
+        return;
+    }
+    getTableDir(dirL, &dir);
+
+    /*
+     * reading name table
+     *   get strings of copyright, fontname
+     */
+    if(findTable(&dir, TAG('n','a','m','e'), &t) && checkTable(ff, &t)){
+        see_name(ttfL + t.offset, t.len, face->copyright, face->fontname);
+        if(cache){
+            cache_table(face, ttfL, &t);
+            face->datakey = hashbytes(face->datakey, ttfL + t.offset, t.len);
         }
+    }
 
-        /*
-         * write to a tmp file
-         */
-        if(fclose(outfp)!=0)
-            errexit("fclose");
+    //EBDT table
+    if((color ? findTable(&dir, TAG('C','B','D','T'), &t)
+        : (findTable(&dir, TAG('E','B','D','T'), &t) || findTable(&dir, TAG('b','d','a','t'), &t)))
+       && checkTable(ff, &t)){
+        ebdtL = ttfL + t.offset;
+        ebdtLen = t.len;
+        //glyphs are read from top to bottom of EBDT
+        advisefont(ff, ebdtL, t.len, 1);
+        if(cache)
+            cache_table(face, ttfL, &t);
+    }
 
-        /*
-         * add some to the tmp file, and write a bdf file
-         */
-        {
-            FILE *infp;
-            char *filebuf;
-            struct stat info;
-            char fname[MAXFILENAMECHAR];
+    // EBLC table (CBLC has the same structure)
+    if((color ? findTable(&dir, TAG('C','B','L','C'), &t)
+        : (findTable(&dir, TAG('E','B','L','C'), &t) || findTable(&dir, TAG('b','l','o','c'), &t)))
+       && checkTable(ff, &t)){
+        eblcL = ttfL + t.offset;
+        eblcLen = t.len;
+        if(cache)
+            cache_table(face, ttfL, &t);
+    }
 
-            if(strcmp(fontname,STRUNKNOWN)==0)
-                sprintf(fname, "sbit-%02dpx.bdf", bbox.ppem);
-            else
-                sprintf(fname, "%s-%02dpx.bdf", fontname, bbox.ppem);
+    // cmap table
+    if(findTable(&dir, TAG('c','m','a','p'), &t) && checkTable(ff, &t)){
+        face->cmapL = see_cmap(ttfL + t.offset, t.len);
+        if(cache){
+            cache_table(face, ttfL, &t);
+            face->datakey = hashbytes(face->datakey, ttfL + t.offset, t.len);
+        }
+    }
 
-            if((outfp=fopen(fname,"wb"))==NULL)
-                errexit("fopen");
+    if(eblcL == NULL || ebdtL == NULL)
+        return;
+    face->eblcL = eblcL;
+    face->eblcLen = eblcLen;
+    face->src.ebdtL = ebdtL;
+    face->src.ebdtLen = ebdtLen;
+}
 
-            //read that tmp file
-            if((infp=fopen(TMPFILE,"rb"))==NULL)
-                errexit("fopen");
-            if(stat(TMPFILE, &info) != 0)
-                errexit("stat");
-            if((filebuf=calloc(info.st_size, sizeof(char)))==NULL)
-                errexit("calloc");
-            if(fread(filebuf,1,info.st_size,infp)!=info.st_size)
-                errexit("fread");
 
-            fprintf(outfp,
-                    "STARTFONT 2.1\n"
-                    "COMMENT extracted with %s %s\n"
-                    "FONT %s\n"
-                    "SIZE %d 75 75\n"
-                    "FONTBOUNDINGBOX %d %d %d %d\n"
-                    "STARTPROPERTIES 1\n"
-                    "COPYRIGHT \"%s\"\n"
-                    "ENDPROPERTIES\n"
-                    "CHARS %d\n"
+/*
+ * mapping a TrueType font to memory
+ *   use mmap() (read-only) for a regular file,
+ *   or read into memory if the file cannot be mapped (pipe, etc.)
+ * in:  filename
+ *      (for out) info of the file on memory
+ * out: nothing
+ */
+void openfont(char *fname, fontfile *ff){
+    FILE *fp;
+    size_t alloc, n;
 
-                    ,PROGNAME, PROGVERSION
-                    ,fontname
-                    ,bbox.ppem
-                    ,bbox.width, bbox.height, bbox.offsetx, bbox.offsety
-                    ,copyright
-                    ,totalglyphs);
+#ifdef USE_MMAP
+    {
+        int fd;
+        struct stat info;
+        void *m;
 
-            if(fwrite(filebuf,1,info.st_size,outfp)!=info.st_size)
-                errexit("fwrite");
-            fprintf(outfp, "ENDFONT\n");
-            fclose(outfp);
-            fprintf(stderr, "  wrote '%s'\n", fname);
+        if((fd=open(fname, O_RDONLY))==-1)
+            errexit("cannot open '%s'", fname);
+        if(fstat(fd, &info) != 0)
+            errexit("stat");
+        if(S_ISREG(info.st_mode) && info.st_size > 0){
+            m = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(m != MAP_FAILED){
+                close(fd);
+                ff->top = m;
+                ff->size = info.st_size;
+                ff->mapped = 1;
+                //only some tables are touched, don't read ahead everything
+                madvise(m, info.st_size, MADV_RANDOM);
+                return;
+            }
+        }
+        close(fd);
+    }
+#endif
 
-            //remove tmp file
-            fclose(infp);
-            if(remove(TMPFILE)!=0)
-                errexit("remove");
+    /*
+     * reading TrueTypeFile to Memory
+     */
+    if((fp=fopen(fname,"rb"))==NULL)
+        errexit("cannot open '%s'", fname);
+    alloc = READCHUNK;
+    ff->size = 0;
+    if((ff->top=malloc(alloc))==NULL)
+        errexit("malloc");
+    while((n=fread(ff->top + ff->size, 1, alloc - ff->size, fp)) > 0){
+        ff->size += n;
+        if(ff->size == alloc){
+            alloc *= 2;
+            if((ff->top=realloc(ff->top, alloc))==NULL)
+                errexit("realloc");
         }
     }
+    if(ferror(fp))
+        errexit("fread");
+    fclose(fp);
+    ff->mapped = 0;
 }
 
 
+/*
+ * release a TrueType font on memory
+ * in:  info of the file on memory
+ * out: nothing
+ */
+void closefont(fontfile *ff){
+#ifdef USE_MMAP
+    if(ff->mapped){
+        munmap(ff->top, ff->size);
+        return;
+    }
+#endif
+    free(ff->top);
+}
+
 
+/*
+ * tell the kernel how a table will be read
+ * in:  info of the file on memory
+ *      on-memory location: top of the table
+ *      (byte) length of the table
+ *      1==read from top to bottom,  0==read at random
+ * out: nothing
+ */
+void advisefont(fontfile *ff, uchar *tableL, ulong len, int sequential){
+#ifdef USE_MMAP
+    size_t pagesize, start, end;
+
+    if(!ff->mapped)
+        return;
+    //madvise() needs a page-aligned address
+    pagesize = sysconf(_SC_PAGESIZE);
+    start = (tableL - ff->top) / pagesize * pagesize;
+    end = tableL - ff->top + len;
+    if(end > ff->size)
+        end = ff->size;
+    if(start >= end)
+        return;
+    madvise(ff->top + start, end - start,
+            sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+#endif
+}
 
 
 /*
- * reading indexSubTable
- * in:  info of indexSubTable
- * out: number of glyphs contained in this indexSubTable
+ * reading EBLC tables of fonts in a file
+ *   fonts in a TTC often share one EBLC/EBDT (and cmap);
+ *   such strikes are decoded once and written for each font
+ * in:  the file
+ *      (for in and out) strikes to extract: strikes of this file are added
+ *      (for in and out) number of strikes
+ *      (for in and out) bdf filenames already used
+ *      command line options
+ * out: nothing
  */
-ushort see_indexSubTable(indexSubTable_info *st, uchar *ebdtL, FILE *outfp){
-    metricinfo glyph;
-    int i;
-    char s[BUFSIZE];
-    uchar *p;
-    ushort numGlyphs = 0;
+void see_eblc(fontjob *fj, strikejob **jobs, int *numJob, namemap *used, options *opt){
+    faceinfo *faces = fj->faces;
+    int numFace = fj->numFace;
+    int i, j, k, f;
+    faceinfo **sharing; //fonts grouped by EBLC/EBDT
+    const char *ext; //extension of output files
+
+    if(opt->format == FMT_PCF)
+        ext = "pcf";
+    else if(opt->format == FMT_ATLAS)
+        ext = (opt->depth == 1) ? "pbm" : "pgm";
+    else if(opt->format == FMT_PNG)
+        ext = "json";
+    else
+        ext = "bdf";
+
+    if((sharing=calloc(numFace, sizeof(faceinfo *)))==NULL)
+        errexit("calloc");
+    fj->sharing = sharing;
 
     /*
-     * reading the header of indexSubTable
-     *   get indexFormat (order of glyphs in EBDT)
-     *   get imageFormat (type of image format of glyphs in EBDT)
-     *   get offset from EBDTtop to locationOfGlyphsData
+     * group fonts which have the same EBLC/EBDT,
+     *   and make a job for each strike of the group
      */
-    glyph.imageFormat = see_indexSubHeader(st);
-    p = st->subtableL + 8; //8 = size of indexSubHeader
-    glyph.ebdtL = ebdtL;
+    k = 0;
+    for(i=0; i<numFace; i++){
+        int numSize; //number of BitmapSizeTable
+        int nshare = 0;
+
+        if(faces[i].eblcL == NULL)
+            continue;
+        for(j=0; j<i; j++){
+            if(faces[j].eblcL == faces[i].eblcL && faces[j].src.ebdtL == faces[i].src.ebdtL
+               && faces[j].cmapL == faces[i].cmapL)
+                break;
+        }
+        if(j < i)
+            continue; //already in a group
+        for(j=i; j<numFace; j++){
+            if(faces[j].eblcL == faces[i].eblcL && faces[j].src.ebdtL == faces[i].src.ebdtL
+               && faces[j].cmapL == faces[i].cmapL)
+                sharing[k + nshare++] = &faces[j];
+        }
 
-    /*
-     * reading the body of indexSubTable
-     */
-    switch (st->indexFormat){
-    case 1: // proportional with 4byte offset
-        {
-            ulong nextoff, curoff; //next glyph's offset, current offset
-            // to know last glyph's length, +1 is needed
-            for(i=st->first; i<= st->last + 1; i++){
-                p = mread(p, sizeof(ulong), s);
-                nextoff = (ulong)strtol(s,(char**)NULL,16);
-                if(i!=st->first && nextoff-curoff>0){
-                    glyph.off =  st->off + curoff;
-                    glyph.id = i-1;
-                    putglyph(&glyph, nextoff-curoff, outfp);
-                    numGlyphs++;
-                }
-                curoff = nextoff;
-            }
+        /*
+         * reading EBLC header
+         *   get number of bitmapSizeTable
+         *   (bitmapSizeTables out of EBLC are not read)
+         */
+        if(faces[i].eblcLen < 8){
+            fprintf(stderr, "  Warning: EBLC is too short (ignored).\n");
+            k += nshare;
+            continue;
         }
-        break;
-    case 3: //proportional with 2byte offset
         {
-            ushort nextoff, curoff;
-            for(i=st->first; i<= st->last + 1; i++){
-                p = mread(p, sizeof(ushort), s);
-                nextoff = (ushort)strtol(s,(char**)NULL,16);
-                if(i!=st->first && nextoff-curoff>0){
-                    glyph.off =  st->off + curoff;
-                    glyph.id = i-1;
-                    putglyph(&glyph, nextoff-curoff, outfp);
-                    numGlyphs++;
-                }
-                curoff = nextoff;
+            cursor c;
+            ulong n;
+            cur_init(&c, faces[i].eblcL);
+
+            //version number
+            cur_skip(&c, 4);
+
+            //number of bitmapSizeTable (48 bytes each)
+            n = cur_u32(&c);
+            if(n > (faces[i].eblcLen - 8) / 48){
+                fprintf(stderr, "  Warning: %lu of %lu bitmapSizeTables are out of EBLC (ignored).\n",
+                        n - (faces[i].eblcLen - 8) / 48, n);
+                n = (faces[i].eblcLen - 8) / 48;
             }
+            numSize = n;
         }
-        break;
-    case 4: // proportional with sparse codes
-        {
-            ulong nGlyphs;
-            ushort nextoff, curoff, nextid, curid; //current ID, nextID
-
-            p = mread(p, sizeof(ulong), s);
-            nGlyphs = (ulong)strtol(s,(char**)NULL,16);
-
-            for(i=0; i<nGlyphs+1; i++){
-                p = mread(p, sizeof(ushort), s);
-                nextid = (ushort)strtol(s,(char**)NULL,16);
-
-                p = mread(p, sizeof(ushort), s);
-                nextoff = (ushort)strtol(s,(char**)NULL,16);
-                if(i!=0 && nextoff-curoff>0){
-                    glyph.off = st->off + curoff;
-                    glyph.id = curid;
-                    putglyph(&glyph, nextoff-curoff, outfp);
-                    numGlyphs++;
-                }
-                curoff = nextoff;
-                curid = nextid;
+
+        if((*jobs=realloc(*jobs, sizeof(strikejob) * (*numJob + numSize + 1)))==NULL)
+            errexit("realloc");
+        for(j=0; j<numSize; j++){
+            strikejob *job;
+            uchar *sizeL = faces[i].eblcL + 8 + 48*j; //top of bitmapSizeTable
+
+            /*
+             * skip strikes not wanted
+             *   40 = offset of startGlyphIndex, 42 = endGlyphIndex,
+             *   44 = ppemX in bitmapSizeTable
+             */
+            if(opt->ppems != NULL && !inRanges(opt->ppems, opt->nppem, sizeL[44], sizeL[44]))
+                continue;
+            if(opt->ids != NULL && !inRanges(opt->ids, opt->nid,
+                                             (sizeL[40]<<8) | sizeL[41],
+                                             (sizeL[42]<<8) | sizeL[43]))
+                continue;
+
+            job = &(*jobs)[(*numJob)++];
+            memset(job, 0x00, sizeof(strikejob));
+            job->eblcL = faces[i].eblcL;
+            job->eblcLen = faces[i].eblcLen;
+            job->src = &faces[i].src;
+            job->tables.eblcL = job->eblcL;
+            job->tables.eblcLen = job->eblcLen;
+            job->tables.ebdtL = job->src->ebdtL;
+            job->tables.ebdtLen = job->src->ebdtLen;
+            job->tables.color = (opt->format == FMT_PNG);
+            job->faces = &sharing[k];
+            job->nface = nshare;
+            job->index = j;
+            job->opt = opt;
+
+            /*
+             * decide bdf filenames now, so that they don't depend on
+             * which thread finishes first
+             *   44 = offset of ppemX in bitmapSizeTable
+             */
+            if((job->fnames=calloc(nshare, sizeof(char *)))==NULL)
+                errexit("calloc");
+            for(f=0; f<nshare; f++){
+                if((job->fnames[f]=malloc(MAXFILENAMECHAR))==NULL)
+                    errexit("malloc");
+                bdfname(job->fnames[f], sharing[k+f]->fontname, sizeL[44], ext);
+                uniqname(used, job->fnames[f]);
             }
         }
-        break;
-    case 2:     //monospaced with close codes
-        {
-            ulong imageSize;
+        k += nshare;
+    }
+    fj->numJob = *numJob - fj->firstJob;
+}
 
-            p = mread(p, sizeof(ulong), s);
-            imageSize = (ulong)strtol(s,(char**)NULL,16);
-            p = see_glyphMetrics(p, &glyph, 1);
 
-            for(i=st->first; i<=st->last; i++){
-                glyph.off = st->off + imageSize * (i - st->first);
-                glyph.id = i;
-                putglyph(&glyph, imageSize, outfp);
-                numGlyphs++;
-            }
+/*
+ * extract a strike (a bitmapSizeTable) to bdf files
+ *   glyphs are decoded once,  and written for each font sharing them.
+ *   errors in this strike don't stop other strikes
+ * in:  array of strikejob
+ *      index of the strike
+ * out: nothing
+ */
+void see_strike(void *arg, int i){
+    strikejob *job = (strikejob *)arg + i;
+    uchar *eblcL = job->eblcL;
+    uchar *arrayL; //on-memory location: top of indexSubTableArray
+    int numElem; //number of indexSubTableArray-elements
+    metricinfo bbox; //strike's bounding box: metric info for strike
+    ushort totalglyphs; //this program can handle under 65536 glyphs
+    errtrap trap;
+    double t = 0, c = 0; //start of the phase being timed (--stats)
+    int j, r;
+
+    if(job->cached)
+        return; //its file is up to date (--cache)
+    if(job->opt->stats){
+        t = nowsec();
+        c = cpusec(0);
+    }
+    job->outfp = NULL;
+    job->heads.buf = NULL;
+    job->headlen = NULL;
+    job->glyphs.buf = NULL;
+    job->side.buf = NULL;
+    cc_init(&job->comps);
+    ar_init(&job->scratch);
+    pushtrap(&trap);
+    if(setjmp(trap.env)){
+        //an error occurred in this strike
+        untrap(&trap);
+        if(job->outfp != NULL){
+            fclose(job->outfp);
+            remove(job->fname); //don't leave a broken bdf file
         }
-        break;
-    case 5:     //monospaced with sparse codes
-        {
-            ulong imageSize, nGlyphs;
+        freefonts(job);
+        cc_free(&job->comps);
+        ar_free(&job->scratch);
+        free(job->subs);
+        job->subs = NULL;
+        job->failed = 1;
+        strcpy(job->msg, trap.msg);
+        if(job->stream != NULL)
+            streamfonts((strikejob *)arg, i); //let strikes after this be written
+        return;
+    }
+
+    /*
+     * reading a bitmapSizeTable
+     *    get number of indexSubTableArrays
+     *    get location of a first indexSubTableArray
+     *    get info of BoundingBox
+     */
+    {
+        ulong offset; //from EBLCtop to a first indexSubTableArray
+        //8 = size of EBLCheader,  48 = size of one bitmapSizeTable
+        see_bitmapSizeTable(eblcL+8+(48*job->index), &numElem, &offset, &bbox);
+        arrayL = eblcL + offset;
+
+        /*
+         * check indexSubTables and glyph data once
+         *   glyphs are decoded from them without checking again
+         *   8 = size of one indexSubTableArray
+         */
+        if(numElem < 0 || !inspan(offset, (ullong)numElem * 8, job->eblcLen))
+            errexit("indexSubTableArray is out of EBLC.");
+        checkSubTables(job, arrayL, numElem);
+    }
+    if(job->opt->cache != NULL){
+        //the same tables and glyph data as the last time: nothing to write
+        ullong key;
+
+        job->cachekey = strikekey(job, eblcL+8+(48*job->index));
+        if(cache_stored(job, &key) && key == job->cachekey){
+            job->cached = 1;
+            untrap(&trap);
+            if(job->opt->stats)
+                lap(&t, &c, &job->stats.index, &job->stats.indexCpu);
+            cc_free(&job->comps);
+            free(job->subs);
+            job->subs = NULL;
+            return;
+        }
+    }
+    if(job->opt->stats)
+        lap(&t, &c, &job->stats.index, &job->stats.indexCpu);
+    job->stats.ppem = bbox.ppem;
+    job->comps.subs = job->subs;
+    job->comps.nsub = job->nsub;
+    job->comps.tables = &job->tables;
+
+    /*
+     * prepare to write glyphs on memory
+     */
+    ob_init(&job->glyphs);
+    totalglyphs = 0;
 
-            p = mread(p, sizeof(ulong), s);
-            imageSize = (ulong)strtol(s,(char**)NULL,16);
-            p = see_glyphMetrics(p, &glyph, 1);
+    /*
+     * reading indexSubTableArrays and indexSubTables
+     */
+    if(job->nthread > 1){
+        //decode parts of this strike with threads
+        totalglyphs = see_chunks(job);
+    }else{
+        for(j=0; j<job->nsub; j++){
+            /*
+             * reading indexSubTable
+             *   get info of glyphs... read bitmapdata... write on memory...
+             *   (only entries of glyphIDs to extract)
+             */
+            for(r=0; r < (job->src->ids ? job->src->nid : 1); r++){
+                ulong from, to;
+
+                if(see_idRange(&job->subs[j], job->src, r, &from, &to))
+                    totalglyphs += see_indexSubTable(&job->subs[j], job->src, &job->comps,
+                                                     &job->scratch,
+                                                     job->opt->stats ? &job->stats.glyphs : NULL,
+                                                     &job->glyphs, from, to);
+            }
+        }
+    }
 
-            p = mread(p, sizeof(ulong), s);
-            nGlyphs = (ulong)strtol(s,(char**)NULL,16);
+    cc_free(&job->comps);
+    free(job->subs);
+    job->subs = NULL;
+    if(job->opt->stats)
+        lap(&t, &c, &job->stats.decode, &job->stats.decodeCpu);
 
-            for(i=0; i<nGlyphs; i++){
-                p = mread(p, sizeof(ushort), s);
-                glyph.id = (ushort)strtol(s,(char**)NULL,16);
-                glyph.off = st->off + imageSize * i;
-                putglyph(&glyph, imageSize, outfp);
-                numGlyphs++;
+    /*
+     * add header to the glyphs, and write a bdf file for each font
+     *   (or write them to the stream in order)
+     */
+    if(job->opt->format == FMT_PCF)
+        putpcf(job, &bbox, totalglyphs);
+    else if(job->opt->format == FMT_ATLAS)
+        putatlas(job, &bbox, totalglyphs);
+    else if(job->opt->format == FMT_PNG)
+        putpng(job, &bbox, totalglyphs);
+    else
+        putheads(job, &bbox, totalglyphs);
+    ar_free(&job->scratch);
+    if(job->opt->stats)
+        lap(&t, &c, &job->stats.build, &job->stats.buildCpu);
+    if(job->stream != NULL){
+        untrap(&trap);
+        streamfonts((strikejob *)arg, i);
+        return;
+    }
+    {
+        char *head = job->heads.buf;
+
+        for(j=0; j<job->nface; j++){
+            job->fname = job->fnames[j];
+            if((job->outfp=fopen(job->fname,"wb"))==NULL)
+                errexit("cannot open '%s'", job->fname);
+            writefont(job->outfp, head, job->headlen[j], &job->glyphs, job->opt->format);
+            job->stats.written += job->headlen[j] + job->glyphs.len
+                + (job->opt->format == FMT_BDF ? 8 : 0); //ENDFONT
+            if(fclose(job->outfp)!=0){
+                job->outfp = NULL;
+                remove(job->fname);
+                errexit("fclose");
+            }
+            job->outfp = NULL;
+            if(job->side.buf != NULL){
+                //metrics of an atlas: name-12px.pgm -> name-12px.json
+                char sname[MAXFILENAMECHAR];
+
+                sidename(sname, job->fnames[j], job->opt->binmetrics ? "bin" : "json");
+                job->fname = sname;
+                if((job->outfp=fopen(sname,"wb"))==NULL)
+                    errexit("cannot open '%s'", sname);
+                if(fwrite(job->side.buf, 1, job->side.len, job->outfp) != job->side.len)
+                    errexit("fwrite");
+                job->stats.written += job->side.len;
+                if(fclose(job->outfp)!=0){
+                    job->outfp = NULL;
+                    remove(sname);
+                    errexit("fclose");
+                }
+                job->outfp = NULL;
             }
+            job->nwritten++;
+            head += job->headlen[j];
         }
-        break;
-    default:
-        errexit("indexFormat %d is not supported.", st->indexFormat);
-        break;
     }
+    freefonts(job);
+    if(job->opt->stats)
+        lap(&t, &c, &job->stats.write, &job->stats.writeCpu);
 
-    //skip padding
-    for(i=0; i<(p - st->subtableL)%4; i++)
-        p = mread(p, sizeof(uchar), s);
+    untrap(&trap);
+}
 
-    return numGlyphs;
+
+/*
+ * make BDF headers of a strike for each font sharing it
+ * in:  the strike
+ *      strike's bounding box
+ *      number of glyphs
+ * out: nothing (headers are in job->heads)
+ */
+void putheads(strikejob *job, metricinfo *bbox, int totalglyphs){
+    int j;
+
+    ob_init(&job->heads);
+    if((job->headlen=calloc(job->nface, sizeof(size_t)))==NULL)
+        errexit("calloc");
+    for(j=0; j<job->nface; j++){
+        faceinfo *face = job->faces[j];
+        int n;
+
+        //fontname and copyright are shorter than MAXSTRINGINBDF
+        ob_reserve(&job->heads, MAXSTRINGINBDF*2 + 512);
+        n = snprintf(job->heads.buf + job->heads.len, MAXSTRINGINBDF*2 + 512,
+                "STARTFONT 2.1\n"
+                "COMMENT extracted with %s %s\n"
+                "FONT %s\n"
+                "SIZE %d 75 75\n"
+                "FONTBOUNDINGBOX %d %d %d %d\n"
+                "STARTPROPERTIES %d\n"
+                "COPYRIGHT \"%s\"\n"
+                "%s"
+                "ENDPROPERTIES\n"
+                "CHARS %d\n"
+
+                ,PROGNAME, PROGVERSION
+                ,face->fontname
+                ,bbox->ppem
+                ,bbox->width, bbox->height, bbox->offsetx, bbox->offsety
+                ,job->src->encoding ? 3 : 1
+                ,face->copyright
+                ,job->src->encoding ? "CHARSET_REGISTRY \"ISO10646\"\n"
+                                      "CHARSET_ENCODING \"1\"\n" : ""
+                ,totalglyphs);
+        job->heads.len += n;
+        job->headlen[j] = n;
+    }
 }
 
 
 /*
- * reading TrueTypefont header
- * in:  on-memory top of truetype font
- *      (for out) info of each table
+ * make PCF fonts of a strike for each font sharing it
+ *   tables after the properties are the same for all fonts, so they are
+ *   made once from the decoded glyphs (and replace them in job->glyphs).
+ *   the header, table of contents and properties of each font are in
+ *   job->heads
+ * in:  the strike
+ *      strike's bounding box
+ *      number of glyphs
  * out: nothing
  */
-void getTableInfo(uchar *p, tableinfo *t){
-    int i;
-    ushort numTable;
-    char s[BUFSIZE];
+void putpcf(strikejob *job, metricinfo *bbox, int totalglyphs){
+    pcfparam *pp = &job->opt->pcf;
+    int msb = pp->byteMSB;
+    ulong format; //format of all tables (byte/bit order, glyph pad, scan unit)
+    char **recs; //on-memory location: each decoded glyph
+    pcfmetric *met; //metrics of each glyph
+    pcfmetric minb, maxb; //bounds of all glyphs
+    int maxOverlap = 0;
+    int compressed = 1; //1==metrics fit in a byte each
+    int ascent = bbox->height + bbox->offsety;
+    int descent = -bbox->offsety;
+    int *same; //index of the first glyph with the same bitmap
+    int nimage; //number of different bitmaps
+    outbuf t; //tables shared by fonts
+    ulong type[PCF_NUMTABLE], tformat[PCF_NUMTABLE], tsize[PCF_NUMTABLE];
+    int ntable = 1; //properties come first, made for each font
+    int i, j, k;
+    size_t start;
+    char *p;
+
+    format = (msb ? PCF_BYTE_MASK : 0) | (pp->bitMSB ? PCF_BIT_MASK : 0);
+    for(k=1; (1<<k) <= pp->pad; k++)
+        format += 1; //glyph pad: 0,1,2,3 for 1,2,4,8 bytes
+    for(k=1; (1<<k) <= pp->unit; k++)
+        format += 1<<4; //scan unit: 0,1,2 for 1,2,4 bytes
+
+    if((recs=ar_alloc(&job->scratch, sizeof(char *) * (totalglyphs + 1)))==NULL)
+        errexit("malloc");
+    if((met=ar_alloc(&job->scratch, sizeof(pcfmetric) * (totalglyphs + 1)))==NULL)
+        errexit("malloc");
+    if((same=ar_alloc(&job->scratch, sizeof(int) * (totalglyphs + 1)))==NULL)
+        errexit("malloc");
 
-    p = mread(p, sizeof(ulong), s); //version
-
-    p = mread(p, sizeof(ushort), s); //number of tables
-    numTable = (ushort)strtol(s,(char**)NULL,16);
+    /*
+     * metrics of glyphs,  and their bounds
+     */
+    memset(&minb, 0x00, sizeof(minb));
+    memset(&maxb, 0x00, sizeof(maxb));
+    p = job->glyphs.buf;
+    for(i=0; i<totalglyphs; i++){
+        glyphrec r;
+        pcfmetric *m = &met[i];
+
+        recs[i] = p;
+        memcpy(&r, p, sizeof(r));
+        p += sizeof(r) + (size_t)((r.width + 7) / 8) * r.height;
+
+        m->lsb = r.offsetx;
+        m->rsb = r.offsetx + r.width;
+        m->width = r.advance;
+        m->ascent = r.offsety + r.height;
+        m->descent = -r.offsety;
+        if(i == 0){
+            minb = maxb = *m;
+            maxOverlap = m->rsb - m->width;
+        }
+#define BOUND(f) if(m->f < minb.f) minb.f = m->f; if(m->f > maxb.f) maxb.f = m->f;
+        BOUND(lsb) BOUND(rsb) BOUND(width) BOUND(ascent) BOUND(descent)
+#undef BOUND
+        if(m->rsb - m->width > maxOverlap)
+            maxOverlap = m->rsb - m->width;
+    }
+    if(minb.lsb < -128 || minb.rsb < -128 || minb.width < -128
+       || minb.ascent < -128 || minb.descent < -128
+       || maxb.lsb > 127 || maxb.rsb > 127 || maxb.width > 127
+       || maxb.ascent > 127 || maxb.descent > 127)
+        compressed = 0;
+    nimage = dedupglyphs(recs, totalglyphs, same, &job->scratch);
 
-    p = mread(p, sizeof(ushort), s); //searchRange
-    p = mread(p, sizeof(ushort), s); //entrySelector
-    p = mread(p, sizeof(ushort), s); //rangeShift
+    ob_init(&t);
 
     /*
-     * assign info of table
+     * accelerators
      */
-    for(i=0; i<numTable; i++){
-        //allocate for a tableinfo (free() don't exist)
-        if( (t->next=malloc(sizeof(tableinfo))) == NULL)
-            errexit("malloc");
-        t = t->next;
+    type[ntable] = PCF_ACCELERATORS;
+    tformat[ntable] = format;
+    start = t.len;
+    pcf_accel(&t, format, &minb, &maxb, ascent, descent, maxOverlap);
+    tsize[ntable++] = t.len - start;
 
-        //a name of table (tag)
-        memset(t->tag, 0x00, 5); // 0 clear
-        memcpy(t->tag, p, 4);
-        p += sizeof(ulong);
+    /*
+     * metrics
+     */
+    type[ntable] = PCF_METRICS;
+    tformat[ntable] = format | (compressed ? PCF_COMPRESSED_METRICS : 0);
+    start = t.len;
+    pcf_put(&t, tformat[ntable], 4, 0);
+    if(compressed){
+        pcf_put(&t, totalglyphs, 2, msb);
+        for(i=0; i<totalglyphs; i++){
+            pcf_put(&t, met[i].lsb + 0x80, 1, msb);
+            pcf_put(&t, met[i].rsb + 0x80, 1, msb);
+            pcf_put(&t, met[i].width + 0x80, 1, msb);
+            pcf_put(&t, met[i].ascent + 0x80, 1, msb);
+            pcf_put(&t, met[i].descent + 0x80, 1, msb);
+        }
+    }else{
+        pcf_put(&t, totalglyphs, 4, msb);
+        for(i=0; i<totalglyphs; i++)
+            pcf_metric(&t, &met[i], msb);
+    }
+    pcf_align(&t);
+    tsize[ntable++] = t.len - start;
+
+    /*
+     * bitmaps
+     *   offsets,  sizes of all bitmaps for each glyph pad,  and bitmaps.
+     *   a bitmap is stored once,  and glyphs with the same bitmap have
+     *   the same offset.  sizes for the other pads are of all glyphs,
+     *   for a reader which repads each glyph into a new buffer
+     */
+    type[ntable] = PCF_BITMAPS;
+    tformat[ntable] = format;
+    start = t.len;
+    pcf_put(&t, format, 4, 0);
+    pcf_put(&t, totalglyphs, 4, msb);
+    {
+        ulong sizes[4] = {0, 0, 0, 0};
+        ulong stored = 0; //(byte) bitmaps stored
+        ulong *offs;
+
+        if((offs=ar_alloc(&job->scratch, sizeof(ulong) * (totalglyphs + 1)))==NULL)
+            errexit("malloc");
+        for(i=0; i<totalglyphs; i++){
+            glyphrec r;
+
+            memcpy(&r, recs[i], sizeof(r));
+            if(same[i] == i){
+                offs[i] = stored;
+                stored += (ulong)(((r.width + 7) / 8 + pp->pad - 1) / pp->pad * pp->pad) * r.height;
+            }else{
+                offs[i] = offs[same[i]];
+            }
+            pcf_put(&t, offs[i], 4, msb);
+            for(k=0; k<4; k++)
+                sizes[k] += (ulong)(((r.width + 7) / 8 + (1<<k) - 1) >> k << k) * r.height;
+        }
+        sizes[format & 3] = stored;
+        for(k=0; k<4; k++)
+            pcf_put(&t, sizes[k], 4, msb);
+        ob_reserve(&t, stored + 4);
+    }
+    for(i=0; i<totalglyphs; i++){
+        glyphrec r;
+        uchar *bits = (uchar *)recs[i] + sizeof(glyphrec);
+        int rowbytes, padded;
+
+        if(same[i] != i)
+            continue;
+        memcpy(&r, recs[i], sizeof(r));
+        rowbytes = (r.width + 7) / 8;
+        padded = (rowbytes + pp->pad - 1) / pp->pad * pp->pad;
+        for(j=0; j<r.height; j++){
+            uchar *d = (uchar *)t.buf + t.len;
+
+            for(k=0; k<rowbytes; k++){
+                uchar v = *bits++;
+                if(!pp->bitMSB){
+                    v = (uchar)((v >> 4) | (v << 4));
+                    v = (uchar)(((v & 0xcc) >> 2) | ((v & 0x33) << 2));
+                    v = (uchar)(((v & 0xaa) >> 1) | ((v & 0x55) << 1));
+                }
+                d[k] = v;
+            }
+            memset(d + rowbytes, 0x00, padded - rowbytes);
+            //bytes in a unit are swapped when the orders differ (as X does)
+            if(pp->unit > 1 && pp->bitMSB != pp->byteMSB){
+                for(k=0; k<padded; k+=pp->unit){
+                    uchar *u = d + k, *v = d + k + pp->unit - 1;
+                    for(; u<v; u++, v--){
+                        uchar x = *u;
+                        *u = *v;
+                        *v = x;
+                    }
+                }
+            }
+            t.len += padded;
+        }
+    }
+    pcf_align(&t);
+    tsize[ntable++] = t.len - start;
+
+    /*
+     * encodings
+     *   a matrix of byte1 (high) x byte2 (low) of character codes;
+     *   a glyph without a code (or over U+FFFF) is not encoded
+     */
+    type[ntable] = PCF_BDF_ENCODINGS;
+    tformat[ntable] = format;
+    start = t.len;
+    {
+        int min1 = 0xff, max1 = 0, min2 = 0xff, max2 = 0;
+        ushort *index;
+        long n;
+
+        for(i=0; i<totalglyphs; i++){
+            long code;
+
+            memcpy(&code, recs[i] + offsetof(glyphrec, encoding), sizeof(code));
+            if(code < 0 || code > 0xffff)
+                continue;
+            if((code >> 8) < min1) min1 = code >> 8;
+            if((code >> 8) > max1) max1 = code >> 8;
+            if((code & 0xff) < min2) min2 = code & 0xff;
+            if((code & 0xff) > max2) max2 = code & 0xff;
+        }
+        if(min1 > max1)
+            min1 = max1 = min2 = max2 = 0;
+        n = (long)(max1 - min1 + 1) * (max2 - min2 + 1);
+        if((index=ar_alloc(&job->scratch, sizeof(ushort) * n))==NULL)
+            errexit("malloc");
+        for(k=0; k<n; k++)
+            index[k] = 0xffff;
+        for(i=0; i<totalglyphs; i++){
+            long code;
+
+            memcpy(&code, recs[i] + offsetof(glyphrec, encoding), sizeof(code));
+            if(code < 0 || code > 0xffff)
+                continue;
+            index[((code >> 8) - min1) * (max2 - min2 + 1) + (code & 0xff) - min2] = i;
+        }
+        pcf_put(&t, format, 4, 0);
+        pcf_put(&t, min2, 2, msb);
+        pcf_put(&t, max2, 2, msb);
+        pcf_put(&t, min1, 2, msb);
+        pcf_put(&t, max1, 2, msb);
+        pcf_put(&t, 0xffff, 2, msb); //default char: none
+        for(k=0; k<n; k++)
+            pcf_put(&t, index[k], 2, msb);
+    }
+    pcf_align(&t);
+    tsize[ntable++] = t.len - start;
+
+    /*
+     * glyph names (the same as STARTCHAR of BDF)
+     */
+    type[ntable] = PCF_GLYPH_NAMES;
+    tformat[ntable] = format;
+    start = t.len;
+    {
+        outbuf names;
+
+        ob_init(&names);
+        pcf_put(&t, format, 4, 0);
+        pcf_put(&t, totalglyphs, 4, msb);
+        for(i=0; i<totalglyphs; i++){
+            glyphrec r;
+            char *d;
+
+            memcpy(&r, recs[i], sizeof(r));
+            pcf_put(&t, names.len, 4, msb);
+            ob_reserve(&names, 32);
+            d = bdf_name(names.buf + names.len, r.encoding, r.id);
+            *d++ = '\0';
+            names.len = d - names.buf;
+        }
+        pcf_put(&t, names.len, 4, msb);
+        ob_write(&t, names.buf, names.len);
+        ob_free(&names);
+    }
+    pcf_align(&t);
+    tsize[ntable++] = t.len - start;
+
+    /*
+     * BDF accelerators (the same as accelerators)
+     */
+    type[ntable] = PCF_BDF_ACCELERATORS;
+    tformat[ntable] = format;
+    start = t.len;
+    pcf_accel(&t, format, &minb, &maxb, ascent, descent, maxOverlap);
+    tsize[ntable++] = t.len - start;
+
+    ob_free(&job->glyphs);
+    job->glyphs = t;
+
+    /*
+     * header,  table of contents and properties for each font
+     */
+    ob_init(&job->heads);
+    if((job->headlen=calloc(job->nface, sizeof(size_t)))==NULL)
+        errexit("calloc");
+    type[0] = PCF_PROPERTIES;
+    tformat[0] = format;
+    for(j=0; j<job->nface; j++){
+        outbuf props;
+        ulong offset;
+
+        ob_init(&props);
+        pcf_props(&props, format, job->faces[j], bbox, job->src->encoding != NULL);
+        tsize[0] = props.len;
+
+        start = job->heads.len;
+        ob_write(&job->heads, "\1fcp", 4);
+        pcf_put(&job->heads, ntable, 4, 0);
+        offset = 8 + 16 * ntable;
+        for(k=0; k<ntable; k++){
+            pcf_put(&job->heads, type[k], 4, 0);
+            pcf_put(&job->heads, tformat[k], 4, 0);
+            pcf_put(&job->heads, tsize[k], 4, 0);
+            pcf_put(&job->heads, offset, 4, 0);
+            offset += tsize[k];
+        }
+        ob_write(&job->heads, props.buf, props.len);
+        ob_free(&props);
+        job->headlen[j] = job->heads.len - start;
+    }
+
+    snprintf(job->stat, sizeof(job->stat),
+             "pcf %dppem: %d glyphs, %d bitmaps (%.1f%% duplicates)",
+             bbox->ppem, totalglyphs, nimage,
+             totalglyphs ? (totalglyphs - nimage) * 100.0 / totalglyphs : 0.0);
+}
+
+
+/*
+ * make the properties table of PCF
+ * in:  on-memory output
+ *      format of tables
+ *      the font
+ *      strike's bounding box
+ *      1==character codes are Unicode
+ * out: nothing
+ */
+void pcf_props(outbuf *ob, ulong format, faceinfo *face, metricinfo *bbox, int unicode){
+    int msb = (format & PCF_BYTE_MASK) != 0;
+    const char *name[PCF_MAXPROP];
+    const char *str[PCF_MAXPROP]; //NULL==number
+    long value[PCF_MAXPROP];
+    int n = 0;
+    int i;
+    ulong off;
+
+#define PROP(nm, s, v) (name[n] = (nm), str[n] = (s), value[n] = (v), n++)
+    PROP("FONT", face->fontname, 0);
+    PROP("COPYRIGHT", face->copyright, 0);
+    if(unicode){
+        PROP("CHARSET_REGISTRY", "ISO10646", 0);
+        PROP("CHARSET_ENCODING", "1", 0);
+    }
+    PROP("PIXEL_SIZE", NULL, bbox->ppem);
+    PROP("POINT_SIZE", NULL, (bbox->ppem * 720 + 37) / 75); //decipoints at 75dpi
+    PROP("RESOLUTION_X", NULL, 75);
+    PROP("RESOLUTION_Y", NULL, 75);
+    PROP("FONT_ASCENT", NULL, bbox->height + bbox->offsety);
+    PROP("FONT_DESCENT", NULL, -bbox->offsety);
+#undef PROP
+
+    pcf_put(ob, format, 4, 0);
+    pcf_put(ob, n, 4, msb);
+    //name offset, 1==string, value (or offset of string)
+    for(i=0, off=0; i<n; i++){
+        pcf_put(ob, off, 4, msb);
+        off += strlen(name[i]) + 1;
+        pcf_put(ob, str[i] != NULL, 1, msb);
+        if(str[i] != NULL){
+            pcf_put(ob, off, 4, msb);
+            off += strlen(str[i]) + 1;
+        }else{
+            pcf_put(ob, value[i], 4, msb);
+        }
+    }
+    for(i=0; i<((n & 3) ? 4 - (n & 3) : 0); i++)
+        pcf_put(ob, 0, 1, msb);
+    pcf_put(ob, off, 4, msb);
+    for(i=0; i<n; i++){
+        ob_write(ob, name[i], strlen(name[i]) + 1);
+        if(str[i] != NULL)
+            ob_write(ob, str[i], strlen(str[i]) + 1);
+    }
+    pcf_align(ob);
+}
+
+
+/*
+ * make an accelerators table of PCF
+ *   flags are decided in the same way as the X server does
+ * in:  on-memory output
+ *      format of tables
+ *      smallest metrics of all glyphs
+ *      largest metrics of all glyphs
+ *      ascent and descent of the font
+ *      max of (right side bearing - width)
+ * out: nothing
+ */
+void pcf_accel(outbuf *ob, ulong format, pcfmetric *minb, pcfmetric *maxb,
+               int ascent, int descent, int maxOverlap){
+    int msb = (format & PCF_BYTE_MASK) != 0;
+    int constantMetrics, terminalFont, constantWidth, inkInside;
+
+    constantMetrics = (minb->ascent == maxb->ascent && minb->descent == maxb->descent
+                       && minb->lsb == maxb->lsb && minb->rsb == maxb->rsb
+                       && minb->width == maxb->width);
+    terminalFont = constantMetrics && maxb->lsb == 0 && maxb->rsb == maxb->width
+        && maxb->ascent == ascent && maxb->descent == descent;
+    constantWidth = (minb->width == maxb->width);
+    inkInside = (minb->lsb >= 0 && maxOverlap <= 0
+                 && minb->ascent >= -descent && maxb->ascent <= ascent
+                 && -minb->descent <= ascent && maxb->descent <= descent);
+
+    pcf_put(ob, format, 4, 0);
+    pcf_put(ob, maxOverlap <= minb->lsb, 1, msb); //noOverlap
+    pcf_put(ob, constantMetrics, 1, msb);
+    pcf_put(ob, terminalFont, 1, msb);
+    pcf_put(ob, constantWidth, 1, msb);
+    pcf_put(ob, inkInside, 1, msb);
+    pcf_put(ob, 0, 1, msb); //inkMetrics: ink is the same as the bitmap
+    pcf_put(ob, 0, 1, msb); //drawDirection: left to right
+    pcf_put(ob, 0, 1, msb); //padding
+    pcf_put(ob, ascent, 4, msb);
+    pcf_put(ob, descent, 4, msb);
+    pcf_put(ob, maxOverlap, 4, msb);
+    pcf_metric(ob, minb, msb);
+    pcf_metric(ob, maxb, msb);
+}
+
+
+/*
+ * write metrics of PCF (not compressed)
+ * in:  on-memory output
+ *      the metrics
+ *      1==big-endian
+ * out: nothing
+ */
+void pcf_metric(outbuf *ob, pcfmetric *m, int msb){
+    pcf_put(ob, m->lsb, 2, msb);
+    pcf_put(ob, m->rsb, 2, msb);
+    pcf_put(ob, m->width, 2, msb);
+    pcf_put(ob, m->ascent, 2, msb);
+    pcf_put(ob, m->descent, 2, msb);
+    pcf_put(ob, 0, 2, msb); //attributes
+}
+
+
+/*
+ * write a number of PCF (or atlas metrics)
+ * in:  on-memory output
+ *      the number (negative numbers are written as two's complement)
+ *      (byte) size (1, 2, 4)
+ *      1==big-endian, 0==little-endian
+ * out: nothing
+ */
+void pcf_put(outbuf *ob, ulong v, int size, int msb){
+    char b[4];
+    int k;
+
+    for(k=0; k<size; k++)
+        b[msb ? k : size-1-k] = (char)(v >> (8 * (size-1-k)));
+    ob_write(ob, b, size);
+}
+
+
+/*
+ * pad a PCF table to 4 bytes
+ * in:  on-memory output
+ * out: nothing
+ */
+void pcf_align(outbuf *ob){
+    while(ob->len & 3)
+        pcf_put(ob, 0, 1, 0);
+}
+
+
+/*
+ * make an atlas of a strike: all glyphs in one image,  and their metrics
+ *   the image (PGM or PBM) and metrics are the same for all fonts sharing
+ *   the strike.  pixels are in job->glyphs,  metrics in job->side
+ * in:  the strike
+ *      strike's bounding box
+ *      number of glyphs
+ * out: nothing
+ */
+void putatlas(strikejob *job, metricinfo *bbox, int totalglyphs){
+    options *opt = job->opt;
+    atlasplace *pl;
+    char **recs; //on-memory location: each decoded glyph
+    int *same; //index of the first glyph with the same image
+    int nimage; //number of different images
+    int width, height;
+    size_t rowbytes; //(byte) a row of the image
+    ulong used; //(pixel) area of glyphs
+    double start, msec;
+    outbuf img;
+    char *p;
+    int i, j, x, y;
+
+    if((pl=ar_alloc(&job->scratch, sizeof(atlasplace) * (totalglyphs + 1)))==NULL)
+        errexit("malloc");
+    if((recs=ar_alloc(&job->scratch, sizeof(char *) * (totalglyphs + 1)))==NULL)
+        errexit("malloc");
+    if((same=ar_alloc(&job->scratch, sizeof(int) * (totalglyphs + 1)))==NULL)
+        errexit("malloc");
+    p = job->glyphs.buf;
+    for(i=0; i<totalglyphs; i++){
+        glyphrec r;
+
+        memcpy(&r, p, sizeof(r));
+        recs[i] = pl[i].rec = p;
+        pl[i].w = r.width;
+        pl[i].h = r.height;
+        p += sizeof(r) + (size_t)((r.width + 7) / 8) * r.height;
+    }
+    //glyphs with the same image share a place in the atlas
+    nimage = dedupglyphs(recs, totalglyphs, same, &job->scratch);
+    for(i=0; i<totalglyphs; i++)
+        pl[i].same = same[i];
+
+    start = nowsec();
+    used = packatlas(pl, totalglyphs, &width, &height, &job->scratch);
+    msec = (nowsec() - start) * 1000;
+
+    /*
+     * pixels of glyphs are 255 (PGM) or 1 (PBM)
+     */
+    rowbytes = (opt->depth == 1) ? (width + 7) / 8 : width;
+    ob_init(&img);
+    ob_reserve(&img, rowbytes * height + 1);
+    memset(img.buf, 0x00, rowbytes * height);
+    img.len = rowbytes * height;
+    for(i=0; i<totalglyphs; i++){
+        uchar *bits = (uchar *)pl[i].rec + sizeof(glyphrec);
+        int rb = (pl[i].w + 7) / 8;
+
+        if(pl[i].same != i)
+            continue;
+        for(y=0; y<pl[i].h; y++){
+            uchar *row = (uchar *)img.buf + (pl[i].y + y) * rowbytes;
+
+            for(x=0; x<pl[i].w; x++){
+                int px = pl[i].x + x;
+
+                if((bits[y*rb + x/8] & (0x80 >> (x & 7))) == 0)
+                    continue;
+                if(opt->depth == 1)
+                    row[px/8] |= 0x80 >> (px & 7);
+                else
+                    row[px] = 0xff;
+            }
+        }
+    }
+
+    /*
+     * metrics of glyphs (in order of glyphIDs)
+     *   bearingY is from the baseline to the top of the glyph
+     */
+    ob_init(&job->side);
+    if(opt->binmetrics){
+        //little-endian: header,  and 20 bytes for each glyph
+        ob_write(&job->side, "SBAT", 4);
+        pcf_put(&job->side, 1, 4, 0); //version
+        pcf_put(&job->side, bbox->ppem, 4, 0);
+        pcf_put(&job->side, width, 4, 0);
+        pcf_put(&job->side, height, 4, 0);
+        pcf_put(&job->side, opt->depth, 4, 0);
+        pcf_put(&job->side, bbox->height + bbox->offsety, 4, 0);
+        pcf_put(&job->side, -bbox->offsety, 4, 0);
+        pcf_put(&job->side, totalglyphs, 4, 0);
+    }else{
+        ob_reserve(&job->side, 256);
+        job->side.len += snprintf(job->side.buf + job->side.len, 256,
+                "{\n"
+                "  \"ppem\": %d,\n"
+                "  \"width\": %d,\n"
+                "  \"height\": %d,\n"
+                "  \"depth\": %d,\n"
+                "  \"ascent\": %d,\n"
+                "  \"descent\": %d,\n"
+                "  \"glyphs\": {\n"
+                ,bbox->ppem, width, height, opt->depth
+                ,bbox->height + bbox->offsety, -bbox->offsety);
+    }
+    for(i=0; i<totalglyphs; i++){
+        glyphrec r;
+        double u0, v0, u1, v1; //place in the atlas (0.0 - 1.0)
+
+        memcpy(&r, pl[i].rec, sizeof(r));
+        if(opt->binmetrics){
+            pcf_put(&job->side, r.id, 2, 0);
+            pcf_put(&job->side, pl[i].x, 2, 0);
+            pcf_put(&job->side, pl[i].y, 2, 0);
+            pcf_put(&job->side, r.width, 1, 0);
+            pcf_put(&job->side, r.height, 1, 0);
+            pcf_put(&job->side, r.offsetx, 2, 0);
+            pcf_put(&job->side, r.offsety + r.height, 2, 0);
+            pcf_put(&job->side, r.advance, 2, 0);
+            pcf_put(&job->side, 0, 2, 0); //reserved
+            pcf_put(&job->side, r.encoding, 4, 0);
+            continue;
+        }
+        //an atlas of blank glyphs has no height:  their u, v are 0
+        u0 = (width > 0) ? (double)pl[i].x / width : 0.0;
+        v0 = (height > 0) ? (double)pl[i].y / height : 0.0;
+        u1 = (width > 0) ? (double)(pl[i].x + r.width) / width : 0.0;
+        v1 = (height > 0) ? (double)(pl[i].y + r.height) / height : 0.0;
+        ob_reserve(&job->side, 512);
+        job->side.len += snprintf(job->side.buf + job->side.len, 512,
+                "    \"%u\": {\"code\": %ld, \"x\": %d, \"y\": %d, \"w\": %d, \"h\": %d, "
+                "\"bearingX\": %d, \"bearingY\": %d, \"advance\": %d, "
+                "\"u0\": %.6f, \"v0\": %.6f, \"u1\": %.6f, \"v1\": %.6f}%s\n"
+                ,r.id, r.encoding, pl[i].x, pl[i].y, r.width, r.height
+                ,r.offsetx, r.offsety + r.height, r.advance
+                ,u0, v0, u1, v1
+                ,(i+1 < totalglyphs) ? "," : "");
+    }
+    if(!opt->binmetrics)
+        ob_write(&job->side, "  }\n}\n", 6);
+
+    ob_free(&job->glyphs);
+    job->glyphs = img;
+
+    /*
+     * PNM header for each font
+     */
+    ob_init(&job->heads);
+    if((job->headlen=calloc(job->nface, sizeof(size_t)))==NULL)
+        errexit("calloc");
+    for(j=0; j<job->nface; j++){
+        int n;
+
+        ob_reserve(&job->heads, 64);
+        if(opt->depth == 1)
+            n = snprintf(job->heads.buf + job->heads.len, 64, "P4\n%d %d\n", width, height);
+        else
+            n = snprintf(job->heads.buf + job->heads.len, 64, "P5\n%d %d\n255\n", width, height);
+        job->heads.len += n;
+        job->headlen[j] = n;
+    }
+
+    snprintf(job->stat, sizeof(job->stat),
+             "atlas %dppem %dx%d: %d glyphs, %d images (%.1f%% duplicates), "
+             "%.1f%% used, packed in %.2f ms",
+             bbox->ppem, width, height, totalglyphs, nimage,
+             totalglyphs ? (totalglyphs - nimage) * 100.0 / totalglyphs : 0.0,
+             (width > 0 && height > 0) ? used * 100.0 / ((double)width * height) : 0.0, msec);
+}
+
+
+/*
+ * write PNG images of a color strike,  and make its metrics
+ *   each image is written from the font as it is (not decoded),
+ *   once for the strike:  into a directory named after the first font
+ *   (name-109px/uni1F600.png).  the metrics (JSON) are the same for all
+ *   fonts sharing the strike: an object in job->heads,  and its glyphs
+ *   in job->glyphs
+ * in:  the strike
+ *      strike's bounding box
+ *      number of glyphs
+ * out: nothing
+ */
+void putpng(strikejob *job, metricinfo *bbox, int totalglyphs){
+    char dir[MAXFILENAMECHAR];
+    char path[MAXFILENAMECHAR + 32]; //directory/uniXXXXXX.png
+    char *dot = strrchr(job->fnames[0], '.');
+    outbuf met; //metrics of glyphs
+    ullong bytes = 0; //(byte) PNG images written
+    char *p;
+    int i, j;
+
+    snprintf(dir, sizeof(dir), "%.*s",
+             dot ? (int)(dot - job->fnames[0]) : (int)strlen(job->fnames[0]), job->fnames[0]);
+    if(mkdir(dir, 0777) != 0 && errno != EEXIST)
+        errexit("cannot make directory '%s'", dir);
+
+    ob_init(&met);
+    p = job->glyphs.buf;
+    for(i=0; i<totalglyphs; i++){
+        pngrec r;
+
+        memcpy(&r, p, sizeof(r));
+        p += sizeof(r);
+
+        if(r.encoding >= 0)
+            snprintf(path, sizeof(path), "%s/uni%04lX.png", dir, (ulong)r.encoding);
+        else
+            snprintf(path, sizeof(path), "%s/gid%u.png", dir, r.id);
+        job->fname = path;
+        if((job->outfp=fopen(path,"wb"))==NULL)
+            errexit("cannot open '%s'", path);
+        if(fwrite(job->src->ebdtL + r.off, 1, r.len, job->outfp) != r.len)
+            errexit("fwrite");
+        if(fclose(job->outfp)!=0){
+            job->outfp = NULL;
+            remove(path);
+            errexit("fclose");
+        }
+        job->outfp = NULL;
+        bytes += r.len;
+        job->stats.written += r.len;
+
+        //bearingY is from the baseline to the top of the glyph
+        //  (the path has the fontname: it is escaped)
+        ob_reserve(&met, 256);
+        met.len += snprintf(met.buf + met.len, 256,
+                "    \"%u\": {\"code\": %ld, \"file\": ", r.id, r.encoding);
+        ob_jsonstr(&met, path);
+        ob_reserve(&met, 256);
+        met.len += snprintf(met.buf + met.len, 256,
+                ", \"w\": %d, \"h\": %d, "
+                "\"bearingX\": %d, \"bearingY\": %d, \"advance\": %d}%s\n"
+                ,r.width, r.height
+                ,r.offsetx, r.offsety + r.height, r.advance
+                ,(i+1 < totalglyphs) ? "," : "");
+    }
+    ob_write(&met, "  }\n}\n", 6);
+    ob_free(&job->glyphs);
+    job->glyphs = met;
+
+    ob_init(&job->heads);
+    if((job->headlen=calloc(job->nface, sizeof(size_t)))==NULL)
+        errexit("calloc");
+    for(j=0; j<job->nface; j++){
+        int n;
+
+        ob_reserve(&job->heads, 256);
+        n = snprintf(job->heads.buf + job->heads.len, 256,
+                "{\n"
+                "  \"ppem\": %d,\n"
+                "  \"ascent\": %d,\n"
+                "  \"descent\": %d,\n"
+                "  \"glyphs\": {\n"
+                ,bbox->ppem, bbox->height + bbox->offsety, -bbox->offsety);
+        job->heads.len += n;
+        job->headlen[j] = n;
+    }
+
+    snprintf(job->stat, sizeof(job->stat),
+             "png %dppem: %d glyphs, %.1f KB of images in '%s/'",
+             bbox->ppem, totalglyphs, bytes / 1024.0, dir);
+}
+
+
+/*
+ * pack glyphs into an atlas (shelf packing)
+ *   glyphs are put in rows (shelves) from the tallest one,  so glyphs
+ *   in a shelf have nearly the same height.  the width of the atlas is
+ *   about the square root of the area (a multiple of 8, for PBM).
+ *   a glyph with the same image as a glyph before it gets its place
+ * in:  (for in and out) glyphs (w, h, same: in,  x, y: out)
+ *      number of glyphs
+ *      (for out) (pixel) size of the atlas
+ *      scratch memory of the strike
+ * out: (pixel) area of glyphs
+ */
+ulong packatlas(atlasplace *pl, int n, int *width, int *height, arena *scratch){
+    atlasplace **order;
+    ulong area = 0, used = 0;
+    int maxw = 0;
+    int x, y, shelf; //shelf: (pixel) height of the current shelf
+    int i, m;
+
+    if((order=ar_alloc(scratch, sizeof(atlasplace *) * (n + 1)))==NULL)
+        errexit("malloc");
+    for(i=0, m=0; i<n; i++){
+        if(pl[i].same != i)
+            continue;
+        order[m++] = &pl[i];
+        area += (ulong)(pl[i].w + ATLASGAP) * (pl[i].h + ATLASGAP);
+        used += (ulong)pl[i].w * pl[i].h;
+        if(pl[i].w > maxw)
+            maxw = pl[i].w;
+    }
+    for(*width=8; (ulong)*width * *width < area; )
+        *width += 8;
+    if(*width < maxw)
+        *width = (maxw + 7) / 8 * 8;
+    qsort(order, m, sizeof(atlasplace *), cmpPlace);
+
+    x = y = shelf = 0;
+    for(i=0; i<m; i++){
+        atlasplace *g = order[i];
+
+        if(g->w == 0 || g->h == 0){
+            g->x = g->y = 0; //blank glyph
+            continue;
+        }
+        if(x + g->w > *width){
+            //next shelf
+            y += shelf + ATLASGAP;
+            x = shelf = 0;
+        }
+        g->x = x;
+        g->y = y;
+        x += g->w + ATLASGAP;
+        if(g->h > shelf)
+            shelf = g->h;
+    }
+    *height = y + shelf;
+    for(i=0; i<n; i++){
+        pl[i].x = pl[pl[i].same].x;
+        pl[i].y = pl[pl[i].same].y;
+    }
+    return used;
+}
+
+
+/*
+ * compare for qsort(): taller glyph first,  then wider,
+ *   then in order of glyphs
+ */
+int cmpPlace(const void *a, const void *b){
+    const atlasplace *x = *(atlasplace * const *)a, *y = *(atlasplace * const *)b;
+
+    if(x->h != y->h)
+        return y->h - x->h;
+    if(x->w != y->w)
+        return y->w - x->w;
+    return (x < y) ? -1 : (x > y);
+}
+
+
+/*
+ * find glyphs with the same image (width, height and bitmap)
+ *   images are put in a hash table,  and a glyph is compared only with
+ *   glyphs of the same hash
+ * in:  decoded glyphs (glyphrec)
+ *      number of glyphs
+ *      (for out) index of the first glyph with the same image
+ *                (itself if it is the first)
+ *      scratch memory of the strike
+ * out: number of different images
+ */
+int dedupglyphs(char **recs, int n, int *same, arena *scratch){
+    int *table; //index of a glyph (-1==empty)
+    ulong size, mask;
+    int nimage = 0;
+    int i;
+
+    for(size=16; size < (ulong)n * 2; )
+        size *= 2;
+    mask = size - 1;
+    if((table=ar_alloc(scratch, sizeof(int) * size))==NULL)
+        errexit("malloc");
+    for(i=0; i<(long)size; i++)
+        table[i] = -1;
+
+    for(i=0; i<n; i++){
+        glyphrec r;
+        size_t len;
+        uchar *q;
+        ulong h = 2166136261UL; //FNV-1a
+        size_t k;
+
+        memcpy(&r, recs[i], sizeof(r));
+        len = (size_t)((r.width + 7) / 8) * r.height;
+        q = (uchar *)recs[i] + sizeof(glyphrec);
+        h = ((h ^ r.width) * 16777619UL) & 0xffffffffUL;
+        h = ((h ^ r.height) * 16777619UL) & 0xffffffffUL;
+        for(k=0; k<len; k++)
+            h = ((h ^ q[k]) * 16777619UL) & 0xffffffffUL;
+
+        for(h&=mask; table[h] >= 0; h=(h+1)&mask){
+            glyphrec s;
+
+            memcpy(&s, recs[table[h]], sizeof(s));
+            if(s.width == r.width && s.height == r.height
+               && memcmp(recs[table[h]] + sizeof(glyphrec), q, len) == 0)
+                break;
+        }
+        if(table[h] >= 0){
+            same[i] = table[h];
+        }else{
+            table[h] = i;
+            same[i] = i;
+            nimage++;
+        }
+    }
+    return nimage;
+}
+
+
+/*
+ * filename of a file next to an output file
+ *   "name-12px.pgm" -> "name-12px.json"
+ * in:  (for out) filename
+ *      output filename
+ *      extension
+ * out: nothing
+ */
+void sidename(char *sname, char *fname, const char *ext){
+    char *dot = strrchr(fname, '.');
+    int len = dot ? (int)(dot - fname) : (int)strlen(fname);
+
+    snprintf(sname, MAXFILENAMECHAR, "%.*s.%s", len, fname, ext);
+}
+
+
+/*
+ * time now
+ * out: (second) from some point in the past
+ */
+double nowsec(void){
+#ifndef _WIN32
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+
+/*
+ * CPU time used
+ * in:  1==by all threads of this program,  0==by this thread
+ * out: (second) from the start of the program (or the thread)
+ */
+double cpusec(int all){
+#if !defined(_WIN32) && defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+
+    clock_gettime(all ? CLOCK_PROCESS_CPUTIME_ID : CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+
+/*
+ * add the time from the start of a phase,  and start the next phase
+ * in:  (for in and out) wall and CPU time at the start of the phase
+ *      (for in and out) wall and CPU time of the phase
+ * out: nothing
+ */
+void lap(double *t, double *c, double *wall, double *cpu){
+    double now = nowsec(), nowCpu = cpusec(0);
+
+    *wall += now - *t;
+    *cpu += nowCpu - *c;
+    *t = now;
+    *c = nowCpu;
+}
+
+
+/*
+ * count a decoded glyph (--stats)
+ * in:  (for in and out) glyphs decoded
+ *      indexFormat of the glyph
+ *      info of the glyph (after decoded)
+ *      (byte) size of the glyph data
+ * out: nothing
+ */
+void noteglyph(glyphstat *gs, int indexFormat, metricinfo *g, ulong size){
+    gs->byIndex[indexFormat]++;
+    if(g->imageFormat > 0 && g->imageFormat < 20)
+        gs->byImage[g->imageFormat]++;
+    gs->dataBytes += size;
+    if(g->width * g->height > gs->maxWidth * gs->maxHeight){
+        gs->maxWidth = g->width;
+        gs->maxHeight = g->height;
+        gs->maxId = g->id;
+    }
+}
+
+
+/*
+ * add glyphs decoded (--stats)
+ * in:  (for in and out) the sum
+ *      glyphs to add
+ * out: nothing
+ */
+void addglyphstat(glyphstat *to, glyphstat *from){
+    int k;
+
+    for(k=0; k<6; k++)
+        to->byIndex[k] += from->byIndex[k];
+    for(k=0; k<20; k++)
+        to->byImage[k] += from->byImage[k];
+    to->dataBytes += from->dataBytes;
+    if(from->maxWidth * from->maxHeight > to->maxWidth * to->maxHeight){
+        to->maxWidth = from->maxWidth;
+        to->maxHeight = from->maxHeight;
+        to->maxId = from->maxId;
+    }
+}
+
+
+/*
+ * print statistics of this run (--stats)
+ *   times of phases are sums over strikes:  with threads,  they are
+ *   longer than the wall time of the program
+ * in:  output (stderr)
+ *      command line options
+ *      input files
+ *      number of input files
+ *      strikes (files[].firstJob...)
+ *      (second) wall time of the program
+ *      (second) CPU time of the program
+ * out: nothing
+ */
+void putstats(FILE *fp, options *opt, fontjob *files, int numFile, strikejob *jobs,
+              double wall, double cpu){
+    glyphstat all;
+    strikestats sum;
+    double read = 0, readCpu = 0;
+    ullong bytesRead = 0;
+    ulong nglyph = 0;
+    const char *maxFile = NULL; //the file and strike of the largest glyph
+    int maxPpem = 0;
+    int json = (opt->stats == 2);
+    int i, j, k, first;
+
+    memset(&all, 0x00, sizeof(all));
+    memset(&sum, 0x00, sizeof(sum));
+    for(i=0; i<numFile; i++){
+        read += files[i].read;
+        readCpu += files[i].readCpu;
+        if(files[i].opened)
+            bytesRead += files[i].ff.size;
+        for(j=files[i].firstJob; j<files[i].firstJob+files[i].numJob; j++){
+            strikestats *st = &jobs[j].stats;
+            int area = all.maxWidth * all.maxHeight;
+
+            addglyphstat(&all, &st->glyphs);
+            if(all.maxWidth * all.maxHeight > area){
+                maxFile = files[i].fname;
+                maxPpem = st->ppem;
+            }
+            sum.index += st->index;
+            sum.indexCpu += st->indexCpu;
+            sum.decode += st->decode;
+            sum.decodeCpu += st->decodeCpu;
+            sum.build += st->build;
+            sum.buildCpu += st->buildCpu;
+            sum.write += st->write;
+            sum.writeCpu += st->writeCpu;
+            sum.written += st->written;
+        }
+    }
+    for(k=1; k<6; k++)
+        nglyph += all.byIndex[k];
+
+    if(!json){
+        fprintf(fp, "stats:\n");
+        fprintf(fp, "  wall %.3f s, cpu %.3f s, %d threads\n", wall, cpu, opt->nthread);
+        fprintf(fp, "  phase     wall(s)    cpu(s)\n");
+        fprintf(fp, "  read    %9.3f %9.3f\n", read, readCpu);
+        fprintf(fp, "  index   %9.3f %9.3f\n", sum.index, sum.indexCpu);
+        fprintf(fp, "  decode  %9.3f %9.3f\n", sum.decode, sum.decodeCpu);
+        fprintf(fp, "  build   %9.3f %9.3f\n", sum.build, sum.buildCpu);
+        fprintf(fp, "  write   %9.3f %9.3f\n", sum.write, sum.writeCpu);
+        fprintf(fp, "  read %.1f KB (glyph data %.1f KB),  wrote %.1f KB\n",
+                bytesRead / 1024.0, all.dataBytes / 1024.0, sum.written / 1024.0);
+        fprintf(fp, "  %lu glyphs: %.0f glyphs/s,  %.2f MB/s written\n",
+                nglyph, wall > 0 ? nglyph / wall : 0.0, wall > 0 ? sum.written / wall / 1e6 : 0.0);
+        fprintf(fp, "  indexFormat");
+        for(k=1; k<6; k++)
+            fprintf(fp, " %d:%lu", k, all.byIndex[k]);
+        fprintf(fp, "\n  imageFormat");
+        for(k=1; k<20; k++){
+            if(all.byImage[k])
+                fprintf(fp, " %d:%lu", k, all.byImage[k]);
+        }
+        fprintf(fp, "\n");
+        if(maxFile != NULL)
+            fprintf(fp, "  largest glyph: %dx%d (glyphID %u, %dppem of '%s')\n",
+                    all.maxWidth, all.maxHeight, all.maxId, maxPpem, maxFile);
+        for(i=0; i<numFile; i++){
+            for(j=files[i].firstJob; j<files[i].firstJob+files[i].numJob; j++){
+                strikestats *st = &jobs[j].stats;
+                ulong n = 0;
+
+                for(k=1; k<6; k++)
+                    n += st->glyphs.byIndex[k];
+                fprintf(fp, "  %s strike %d (%dppem): %lu glyphs, index %.2f ms, "
+                        "decode %.2f ms, build %.2f ms, write %.2f ms, %.1f KB%s\n",
+                        files[i].fname, jobs[j].index, st->ppem, n, st->index * 1000,
+                        st->decode * 1000,
+                        st->build * 1000, st->write * 1000, st->written / 1024.0,
+                        jobs[j].failed ? ", failed" : "");
+            }
+        }
+        return;
+    }
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"wall\": %.6f,\n  \"cpu\": %.6f,\n  \"threads\": %d,\n",
+            wall, cpu, opt->nthread);
+    fprintf(fp, "  \"phases\": {\n"
+            "    \"read\": {\"wall\": %.6f, \"cpu\": %.6f},\n"
+            "    \"index\": {\"wall\": %.6f, \"cpu\": %.6f},\n"
+            "    \"decode\": {\"wall\": %.6f, \"cpu\": %.6f},\n"
+            "    \"build\": {\"wall\": %.6f, \"cpu\": %.6f},\n"
+            "    \"write\": {\"wall\": %.6f, \"cpu\": %.6f}\n"
+            "  },\n",
+            read, readCpu, sum.index, sum.indexCpu, sum.decode, sum.decodeCpu,
+            sum.build, sum.buildCpu, sum.write, sum.writeCpu);
+    fprintf(fp, "  \"bytesRead\": %llu,\n  \"glyphDataBytes\": %llu,\n"
+            "  \"bytesWritten\": %llu,\n  \"glyphs\": %lu,\n",
+            bytesRead, all.dataBytes, sum.written, nglyph);
+    fprintf(fp, "  \"indexFormats\": {");
+    for(k=1; k<6; k++)
+        fprintf(fp, "%s\"%d\": %lu", k > 1 ? ", " : "", k, all.byIndex[k]);
+    fprintf(fp, "},\n  \"imageFormats\": {");
+    for(k=1, first=1; k<20; k++){
+        if(all.byImage[k]){
+            fprintf(fp, "%s\"%d\": %lu", first ? "" : ", ", k, all.byImage[k]);
+            first = 0;
+        }
+    }
+    fprintf(fp, "},\n");
+    if(maxFile != NULL){
+        fprintf(fp, "  \"largestGlyph\": {\"width\": %d, \"height\": %d, \"id\": %u, "
+                "\"ppem\": %d, \"file\": ", all.maxWidth, all.maxHeight, all.maxId, maxPpem);
+        json_str(fp, maxFile);
+        fprintf(fp, "},\n");
+    }
+    fprintf(fp, "  \"strikes\": [");
+    for(i=0, first=1; i<numFile; i++){
+        for(j=files[i].firstJob; j<files[i].firstJob+files[i].numJob; j++){
+            strikestats *st = &jobs[j].stats;
+            ulong n = 0;
+
+            for(k=1; k<6; k++)
+                n += st->glyphs.byIndex[k];
+            fprintf(fp, "%s\n    {\"file\": ", first ? "" : ",");
+            json_str(fp, files[i].fname);
+            fprintf(fp, ", \"strike\": %d, \"ppem\": %d, \"glyphs\": %lu, "
+                    "\"index\": %.6f, \"indexCpu\": %.6f, "
+                    "\"decode\": %.6f, \"decodeCpu\": %.6f, \"build\": %.6f, "
+                    "\"buildCpu\": %.6f, \"write\": %.6f, \"writeCpu\": %.6f, "
+                    "\"bytesWritten\": %llu, \"failed\": %s}",
+                    jobs[j].index, st->ppem, n, st->index, st->indexCpu,
+                    st->decode, st->decodeCpu, st->build,
+                    st->buildCpu, st->write, st->writeCpu, st->written,
+                    jobs[j].failed ? "true" : "false");
+            first = 0;
+        }
+    }
+    fprintf(fp, "%s]\n}\n", first ? "" : "\n  ");
+}
+
+
+/*
+ * write a string in JSON (quoted,  with escapes)
+ * in:  output
+ *      the string
+ * out: nothing
+ */
+void json_str(FILE *fp, const char *s){
+    putc('"', fp);
+    for(; *s; s++){
+        if(*s == '"' || *s == '\\')
+            fprintf(fp, "\\%c", *s);
+        else if((uchar)*s < 0x20)
+            fprintf(fp, "\\u%04x", (uchar)*s);
+        else
+            putc(*s, fp);
+    }
+    putc('"', fp);
+}
+
+
+/*
+ * write a string in JSON on memory (quoted,  with escapes)
+ * in:  (for in and out) output
+ *      the string
+ * out: nothing
+ */
+void ob_jsonstr(outbuf *ob, const char *s){
+    //6 = length of the longest escape (\u00XX)
+    ob_reserve(ob, strlen(s) * 6 + 3);
+    ob->buf[ob->len++] = '"';
+    for(; *s; s++){
+        if(*s == '"' || *s == '\\'){
+            ob->buf[ob->len++] = '\\';
+            ob->buf[ob->len++] = *s;
+        }else if((uchar)*s < 0x20){
+            ob->len += sprintf(ob->buf + ob->len, "\\u%04x", (uchar)*s);
+        }else{
+            ob->buf[ob->len++] = *s;
+        }
+    }
+    ob->buf[ob->len++] = '"';
+}
+
+
+/*
+ * write a BDF (or PCF) font
+ * in:  output file
+ *      header
+ *      (byte) length of header
+ *      glyphs (PCF: tables after the properties)
+ *      FMT_BDF or FMT_PCF
+ * out: nothing
+ */
+void writefont(FILE *fp, char *head, size_t headlen, outbuf *glyphs, int format){
+    if(fwrite(head, 1, headlen, fp) != headlen
+       || fwrite(glyphs->buf, 1, glyphs->len, fp) != glyphs->len
+       || (format == FMT_BDF && fputs("ENDFONT\n", fp) == EOF))
+        errexit("fwrite");
+}
+
+
+/*
+ * release headers and glyphs of a strike
+ * in:  the strike
+ * out: nothing
+ */
+void freefonts(strikejob *job){
+    if(job->heads.buf != NULL)
+        ob_free(&job->heads);
+    if(job->glyphs.buf != NULL)
+        ob_free(&job->glyphs);
+    if(job->side.buf != NULL)
+        ob_free(&job->side);
+    free(job->headlen);
+    job->headlen = NULL;
+}
+
+
+/*
+ * write extracted strikes to the stream in order of strikes
+ *   a strike extracted before the strikes before it waits on memory;
+ *   the thread which extracted the next strike to write writes it
+ *   (and the waiting strikes after it)
+ * in:  array of strikejob
+ *      index of the strike just extracted (or failed)
+ * out: nothing
+ *
+ *  If the stream cannot be written, exit program.
+ */
+void streamfonts(strikejob *jobs, int i){
+    bdfstream *stream = jobs[i].stream;
+
+#ifdef USE_THREAD
+    pthread_mutex_lock(&stream->lock);
+#endif
+    jobs[i].done = 1;
+    while(stream->next < stream->n && jobs[stream->next].done){
+        strikejob *job = &jobs[stream->next++];
+
+        if(!job->failed){
+            char *head = job->heads.buf;
+            double t = 0, c = 0;
+            int j;
+
+            if(job->opt->stats){
+                t = nowsec();
+                c = cpusec(0);
+            }
+            for(j=0; j<job->nface; j++){
+                writefont(stream->fp, head, job->headlen[j], &job->glyphs, job->opt->format);
+                job->stats.written += job->headlen[j] + job->glyphs.len
+                    + (job->opt->format == FMT_BDF ? 8 : 0); //ENDFONT
+                job->nwritten++;
+                head += job->headlen[j];
+            }
+            freefonts(job);
+            if(job->opt->stats)
+                lap(&t, &c, &job->stats.write, &job->stats.writeCpu);
+        }
+    }
+#ifdef USE_THREAD
+    pthread_mutex_unlock(&stream->lock);
+#endif
+}
+
+
+/*
+ * make a bdf (or pcf, pgm...) filename
+ * in:  (for out) filename
+ *      fontname
+ *      pixel size
+ *      extension ("bdf", "pcf", ...)
+ * out: nothing
+ */
+void bdfname(char *fname, char *fontname, int ppem, const char *ext){
+    if(strcmp(fontname,STRUNKNOWN)==0)
+        snprintf(fname, MAXFILENAMECHAR, "sbit-%02dpx.%s", ppem, ext);
+    else
+        snprintf(fname, MAXFILENAMECHAR, "%.200s-%02dpx.%s", fontname, ppem, ext);
+}
+
+
+/*
+ * make a filename different from filenames already used
+ *   "name-12px.bdf" -> "name-12px-2.bdf", "name-12px-3.bdf", ...
+ * in:  (for in and out) filenames already used
+ *      (for in and out) filename
+ * out: nothing
+ */
+void uniqname(namemap *used, char *fname){
+    char base[MAXFILENAMECHAR];
+    size_t h;
+    int n;
+
+    strcpy(base, fname);
+    for(n=2; nm_find(used, fname, &h); n++){
+        char *dot = strrchr(base, '.');
+        int len = dot ? (int)(dot - base) : (int)strlen(base);
+        snprintf(fname, MAXFILENAMECHAR, "%.*s-%d%s", len, base, n, dot ? dot : "");
+    }
+
+    /*
+     * add to the table (keep it half empty)
+     */
+    if(used->n * 2 >= used->alloc){
+        namemap bigger;
+        size_t i;
+
+        bigger.alloc = used->alloc ? used->alloc * 2 : 256;
+        bigger.n = used->n;
+        if((bigger.names=calloc(bigger.alloc, sizeof(char *)))==NULL)
+            errexit("calloc");
+        for(i=0; i<used->alloc; i++){
+            if(used->names[i] != NULL){
+                nm_find(&bigger, used->names[i], &h);
+                bigger.names[h] = used->names[i];
+            }
+        }
+        free(used->names);
+        *used = bigger;
+        nm_find(used, fname, &h);
+    }
+    used->names[h] = fname;
+    used->n++;
+}
+
+
+/*
+ * looking for a filename in a hash table
+ * in:  filenames already used
+ *      filename
+ *      (for out) index where it is, or where it should be
+ * out: 1==found, 0==not found
+ */
+int nm_find(namemap *used, char *fname, size_t *index){
+    size_t h = 5381;
+    char *p;
+
+    if(used->alloc == 0){
+        *index = 0;
+        return 0;
+    }
+    for(p=fname; *p; p++)
+        h = h * 33 + (uchar)*p;
+    for(h%=used->alloc; used->names[h] != NULL; h=(h+1)%used->alloc){
+        if(strcmp(used->names[h], fname)==0){
+            *index = h;
+            return 1;
+        }
+    }
+    *index = h;
+    return 0;
+}
+
+
+/*
+ * remove a filename from the hash table
+ *   filenames after it (until an empty place) are put again,
+ *   so that nm_find() still finds them
+ * in:  (for in and out) filenames already used
+ *      filename (the same pointer as in the table)
+ * out: nothing
+ */
+void nm_remove(namemap *used, char *fname){
+    size_t h, i;
+
+    if(!nm_find(used, fname, &h) || used->names[h] != fname)
+        return;
+    used->names[h] = NULL;
+    used->n--;
+    for(i=(h+1)%used->alloc; used->names[i] != NULL; i=(i+1)%used->alloc){
+        char *name = used->names[i];
+
+        used->names[i] = NULL;
+        nm_find(used, name, &h);
+        used->names[h] = name;
+    }
+}
+
+
+/*
+ * order of strikes to extract: larger one first
+ *   size is estimated by (number of glyphs) x ppem x ppem
+ * in:  strikes
+ *      number of strikes
+ *      (for out) indexes of strikes in order
+ * out: nothing
+ */
+void orderJobs(strikejob *jobs, int numJob, int *order){
+    jobcost *cost;
+    int i;
+
+    if((cost=malloc(sizeof(jobcost) * (numJob + 1)))==NULL)
+        errexit("malloc");
+    for(i=0; i<numJob; i++){
+        cursor c;
+        ushort start, end;
+        uchar ppem;
+
+        //40 = offset of startGlyphIndex in bitmapSizeTable
+        cur_init(&c, jobs[i].eblcL + 8 + 48*jobs[i].index + 40);
+        start = cur_u16(&c);
+        end = cur_u16(&c);
+        ppem = cur_u8(&c);
+        cost[i].cost = (end >= start ? end - start + 1 : 1) * (ulong)ppem * ppem;
+        cost[i].index = i;
+    }
+    qsort(cost, numJob, sizeof(jobcost), cmpJobcost);
+    for(i=0; i<numJob; i++)
+        order[i] = cost[i].index;
+    free(cost);
+}
+
+
+/*
+ * compare for qsort(): larger cost first,  then earlier strike first
+ */
+int cmpJobcost(const void *a, const void *b){
+    const jobcost *x = a, *y = b;
+
+    if(x->cost != y->cost)
+        return (x->cost < y->cost) ? 1 : -1;
+    return x->index - y->index;
+}
+
+
+/*
+ * decode glyphs of a strike with threads
+ *   indexSubTables are divided into chunks of GLYPHSPERCHUNK entries,
+ *   and decoded chunks are joined in order of glyphs
+ *   (so the output is the same as decoding without threads)
+ * in:  the strike (its indexSubTables are checked)
+ * out: number of glyphs
+ */
+ushort see_chunks(strikejob *job){
+    glyphchunk *chunks = NULL;
+    int nchunk = 0, alloc = 0;
+    int threaded; //1==chunks are decoded by other threads
+    ushort totalglyphs = 0;
+    int i, j, r;
+
+    /*
+     * divide indexSubTables into chunks
+     */
+    for(j=0; j<job->nsub; j++){
+        sbitrange st = job->subs[j];
+
+        for(r=0; r < (job->src->ids ? job->src->nid : 1); r++){
+            ulong n, from;
+
+            if(!see_idRange(&st, job->src, r, &from, &n))
+                continue;
+            for(; from<n; from+=GLYPHSPERCHUNK){
+                if(nchunk == alloc){
+                    alloc = alloc ? alloc*2 : 64;
+                    if((chunks=realloc(chunks, sizeof(glyphchunk) * alloc))==NULL)
+                        errexit("realloc");
+                }
+                memset(&chunks[nchunk], 0x00, sizeof(glyphchunk));
+                chunks[nchunk].st = st;
+                chunks[nchunk].src = job->src;
+                chunks[nchunk].comps = &job->comps;
+                chunks[nchunk].timed = job->opt->stats;
+                chunks[nchunk].from = from;
+                chunks[nchunk].to = (n - from > GLYPHSPERCHUNK) ? from + GLYPHSPERCHUNK : n;
+                nchunk++;
+            }
+        }
+    }
+
+    threaded = (runjobs(nchunk, job->nthread, see_chunk, chunks, NULL) > 1);
+
+    /*
+     * join chunks in order
+     */
+    for(i=0; i<nchunk; i++){
+        if(chunks[i].failed)
+            break;
+        ob_write(&job->glyphs, chunks[i].glyphs.buf, chunks[i].glyphs.len);
+        totalglyphs += chunks[i].numGlyphs;
+        if(chunks[i].timed){
+            addglyphstat(&job->stats.glyphs, &chunks[i].stats);
+            //CPU time of this thread is counted by lap() already
+            if(threaded)
+                job->stats.decodeCpu += chunks[i].cpu;
+        }
+    }
+    if(i < nchunk){
+        char msg[MAXSTRINGINBDF];
+        strcpy(msg, chunks[i].msg);
+        for(i=0; i<nchunk; i++){
+            if(chunks[i].glyphs.buf != NULL)
+                ob_free(&chunks[i].glyphs);
+            ar_free(&chunks[i].scratch);
+        }
+        free(chunks);
+        errexit("%s", msg);
+    }
+    for(i=0; i<nchunk; i++){
+        ob_free(&chunks[i].glyphs);
+        ar_free(&chunks[i].scratch);
+    }
+    free(chunks);
+
+    return totalglyphs;
+}
+
+
+/*
+ * run jobs with threads
+ *   each thread takes the next job until no job is left
+ * in:  number of jobs
+ *      number of threads (1==run in this thread)
+ *      function to run a job: fn(arg, index of job)
+ *      argument of fn
+ *      order to take jobs (NULL==from index 0)
+ * out: number of threads which ran the jobs (1==this thread)
+ */
+int runjobs(int njob, int nthread, void (*fn)(void *arg, int i), void *arg,
+            const int *order){
+    workqueue q;
+    int i;
+
+    q.fn = fn;
+    q.arg = arg;
+    q.order = order;
+    q.n = njob;
+    q.next = 0;
+
+#ifdef USE_THREAD
+    if(nthread > 1 && njob > 1){
+        pthread_t *th;
+
+        if(nthread > njob)
+            nthread = njob;
+        if((th=malloc(sizeof(pthread_t) * nthread))==NULL)
+            errexit("malloc");
+        pthread_mutex_init(&q.lock, NULL);
+        for(i=0; i<nthread; i++){
+            if(pthread_create(&th[i], NULL, jobworker, &q)!=0)
+                errexit("pthread_create");
+        }
+        for(i=0; i<nthread; i++)
+            pthread_join(th[i], NULL);
+        pthread_mutex_destroy(&q.lock);
+        free(th);
+        return nthread;
+    }
+#endif
+    for(i=0; i<njob; i++)
+        fn(arg, order ? order[i] : i);
+    return 1;
+}
+
+
+#ifdef USE_THREAD
+/*
+ * a thread of runjobs()
+ * in:  queue of jobs
+ * out: NULL
+ */
+void *jobworker(void *arg){
+    workqueue *q = arg;
+    int i;
+
+    for(;;){
+        pthread_mutex_lock(&q->lock);
+        i = q->next++;
+        pthread_mutex_unlock(&q->lock);
+        if(i >= q->n)
+            break;
+        q->fn(q->arg, q->order ? q->order[i] : i);
+    }
+    return NULL;
+}
+#endif
+
+
+/*
+ * catch errexit() in this thread, instead of exiting this program
+ *   use as:  pushtrap(&trap);
+ *            if(setjmp(trap.env)){ error... }  ...  untrap(&trap);
+ *   (setjmp() must be the whole condition:  C allows nothing more)
+ * in:  (for out) a trap
+ * out: nothing
+ */
+void pushtrap(errtrap *trap){
+    trap->prev = curtrap;
+    curtrap = trap;
+}
+
+
+/*
+ * stop catching errexit() with this trap
+ * in:  a trap
+ * out: nothing
+ */
+void untrap(errtrap *trap){
+    curtrap = trap->prev;
+}
+
+
+/*
+ * FNV-1a hash (64 bit)
+ *   hashbytes: bytes,  hashnum: a number (8 bytes, from the highest)
+ *   hashtable: tag, checksum and length of a table (of the table directory)
+ * in:  hash of what is before
+ *      what to hash
+ * out: hash
+ */
+ullong hashbytes(ullong h, const uchar *p, size_t n){
+    size_t i;
+
+    for(i=0; i<n; i++)
+        h = (h ^ p[i]) * 1099511628211ULL;
+    return h;
+}
+
+ullong hashnum(ullong h, ullong v){
+    int i;
+
+    for(i=56; i>=0; i-=8)
+        h = (h ^ ((v >> i) & 0xff)) * 1099511628211ULL;
+    return h;
+}
+
+ullong hashtable(ullong h, tableinfo *t){
+    h = hashnum(h, t->tag);
+    h = hashnum(h, t->checksum);
+    return hashnum(h, t->len);
+}
+
+
+/*
+ * checksum of a table (sum of ulongs,  zero-padded to 4 bytes)
+ * in:  on-memory location: top of the table
+ *      (byte) length of the table
+ * out: checksum
+ */
+ulong tablesum(const uchar *p, ulong len){
+    ulong sum = 0;
+    ulong i;
+
+    for(i=0; i+4<=len; i+=4)
+        sum += ((ulong)p[i]<<24) | ((ulong)p[i+1]<<16) | (p[i+2]<<8) | p[i+3];
+    if(i < len){
+        ulong last = 0;
+        int k;
+
+        for(k=0; k<4; k++)
+            last = (last << 8) | (i+k < len ? p[i+k] : 0);
+        sum += last;
+    }
+    return sum & 0xffffffffUL;
+}
+
+
+/*
+ * a table of a font,  for --cache:  hash its checksum,  and check the
+ *   checksum with the bytes of the table.  A font edited without
+ *   updating checksums is stale:  its strikes are hashed every time
+ * in:  (for in and out) info of the font
+ *      on-memory location: top of TrueTypeFile
+ *      the table
+ * out: nothing
+ */
+void cache_table(faceinfo *face, uchar *ttfL, tableinfo *t){
+    face->sumkey = hashtable(face->sumkey, t);
+    if(tablesum(ttfL + t->offset, t->len) != t->checksum)
+        face->stale = 1;
+}
+
+
+/*
+ * hash of options which change output files (--cache)
+ *   a manifest made with other options is not used
+ * in:  command line options
+ * out: hash
+ */
+ullong optkey(options *opt){
+    ullong h = hashbytes(HASHINIT, (const uchar *)PROGVERSION, strlen(PROGVERSION));
+    int i;
+
+    h = hashnum(h, opt->format);
+    h = hashnum(h, opt->pcf.pad);
+    h = hashnum(h, opt->pcf.unit);
+    h = hashnum(h, opt->pcf.bitMSB);
+    h = hashnum(h, opt->pcf.byteMSB);
+    h = hashnum(h, opt->depth);
+    h = hashnum(h, opt->binmetrics);
+    //-p is not here:  it chooses strikes,  but doesn't change them
+    h = hashnum(h, opt->ranges != NULL);
+    for(i=0; i<opt->nrange; i++)
+        h = hashnum(hashnum(h, opt->ranges[i].lo), opt->ranges[i].hi);
+    h = hashnum(h, opt->ids != NULL);
+    for(i=0; i<opt->nid; i++)
+        h = hashnum(hashnum(h, opt->ids[i].lo), opt->ids[i].hi);
+    return h;
+}
+
+
+/*
+ * hash of what a strike is made from (--cache)
+ *   'name' and 'cmap' of fonts sharing it,  its bitmapSizeTable,
+ *   indexSubTables,  and glyph data of them in EBDT
+ * in:  the strike (its indexSubTables are checked)
+ *      on-memory location: top of its bitmapSizeTable
+ * out: hash
+ */
+ullong strikekey(strikejob *job, uchar *sizeL){
+    ullong h = HASHINIT;
+    int i;
+
+    for(i=0; i<job->nface; i++)
+        h = hashnum(h, job->faces[i]->datakey);
+    //48 = size of one bitmapSizeTable
+    h = hashbytes(h, sizeL, 48);
+    for(i=0; i<job->nsub; i++){
+        sbitrange *st = &job->subs[i];
+
+        h = hashnum(hashnum(h, st->first), st->last);
+        h = hashbytes(h, st->subL, st->size);
+        h = hashbytes(h, job->src->ebdtL + st->dataLo, st->dataHi - st->dataLo);
+    }
+    return h;
+}
+
+
+/*
+ * reading the manifest of --cache
+ *   a missing manifest,  or one made with other options,  is empty
+ * in:  (for in and out) the manifest (name: in)
+ *      command line options
+ * out: nothing
+ */
+void cache_load(cacheinfo *cache, options *opt){
+    FILE *fp;
+    char *line = NULL; //a line of any length (filenames are not cut)
+    size_t allocLine = 0;
+    long len;
+    cachefont *font = NULL; //the file being read
+    int allocFont = 0, allocStrike = 0;
+
+    cache->optkey = optkey(opt);
+    cache->fonts = NULL;
+    cache->nfont = 0;
+    if((fp=fopen(cache->name, "r"))==NULL)
+        return;
+    if(readline(fp, &line, &allocLine) < 0
+       || strncmp(line, CACHEMAGIC " ", strlen(CACHEMAGIC " ")) != 0
+       || strtoull(line + strlen(CACHEMAGIC " "), NULL, 16) != cache->optkey){
+        free(line);
+        fclose(fp);
+        return;
+    }
+    while((len=readline(fp, &line, &allocLine)) >= 0){
+        unsigned long long key;
+        char *name;
+        int index, n;
+
+        if(sscanf(line, "F %llx %n", &key, &n) == 1){
+            //F hash-of-checksums input-file
+            if(cache->nfont == allocFont){
+                allocFont = allocFont ? allocFont * 2 : 64;
+                if((cache->fonts=realloc(cache->fonts, sizeof(cachefont) * allocFont))==NULL)
+                    errexit("realloc");
+            }
+            font = &cache->fonts[cache->nfont++];
+            memset(font, 0x00, sizeof(cachefont));
+            font->key = key;
+            allocStrike = 0;
+        }else if(font != NULL && sscanf(line, "S %d %llx %n", &index, &key, &n) == 2){
+            //S bitmapSizeTable hash-of-strike output-file
+            cachestrike *cs;
+
+            if(font->nstrike == allocStrike){
+                allocStrike = allocStrike ? allocStrike * 2 : 8;
+                if((font->strikes=realloc(font->strikes, sizeof(cachestrike) * allocStrike))==NULL)
+                    errexit("realloc");
+            }
+            cs = &font->strikes[font->nstrike++];
+            cs->index = index;
+            cs->key = key;
+            cs->fname = NULL;
+        }else{
+            continue; //broken line
+        }
+        if((name=malloc(len - n + 1))==NULL)
+            errexit("malloc");
+        strcpy(name, line + n);
+        if(line[0] == 'F')
+            font->fname = name;
+        else
+            font->strikes[font->nstrike-1].fname = name;
+    }
+    free(line);
+    fclose(fp);
+    qsort(cache->fonts, cache->nfont, sizeof(cachefont), cmpCachefont);
+}
+
+
+/*
+ * compare for qsort(), bsearch(): by the name of the input file
+ */
+int cmpCachefont(const void *a, const void *b){
+    return strcmp(((const cachefont *)a)->fname, ((const cachefont *)b)->fname);
+}
+
+
+/*
+ * find a file in the manifest of --cache
+ *   if checksums of its tables are the same (and right for the bytes of
+ *   the tables),  and its output files are there,  no strike is
+ *   extracted (nothing is hashed)
+ * in:  the manifest
+ *      (for in and out) the file (read by see_file())
+ *      strikes (of all files)
+ * out: nothing
+ */
+void cache_font(cacheinfo *cache, fontjob *fj, strikejob *jobs){
+    cachefont find;
+    int j;
+
+    find.fname = fj->fname;
+    fj->was = bsearch(&find, cache->fonts, cache->nfont, sizeof(cachefont), cmpCachefont);
+    if(fj->was == NULL)
+        return;
+    fj->was->seen = 1;
+    for(j=fj->firstJob; j<fj->firstJob+fj->numJob; j++)
+        jobs[j].was = fj->was;
+    if(fj->was->key != fj->cachekey)
+        return;
+    for(j=0; j<fj->numFace; j++){
+        if(fj->faces[j].stale)
+            return; //checksums can't tell: see_strike() hashes strikes
+    }
+    for(j=fj->firstJob; j<fj->firstJob+fj->numJob; j++){
+        if(!cache_stored(&jobs[j], &jobs[j].cachekey))
+            return;
+    }
+    for(j=fj->firstJob; j<fj->firstJob+fj->numJob; j++)
+        jobs[j].cached = 1;
+}
+
+
+/*
+ * output files of a strike in the manifest of --cache
+ * in:  the strike
+ *      (for out) hash of the strike in the manifest
+ * out: 1==all output files of the strike are in the manifest (with the
+ *      same hash) and there,  0==not
+ */
+int cache_stored(strikejob *job, ullong *key){
+    int f, k;
+
+    if(job->was == NULL)
+        return 0;
+    for(f=0; f<job->nface; f++){
+        for(k=0; k<job->was->nstrike; k++){
+            cachestrike *cs = &job->was->strikes[k];
+
+            if(cs->index == job->index && strcmp(cs->fname, job->fnames[f]) == 0)
+                break;
+        }
+        if(k == job->was->nstrike || !fileexists(job->fnames[f]))
+            return 0;
+        if(f > 0 && job->was->strikes[k].key != *key)
+            return 0;
+        *key = job->was->strikes[k].key;
+    }
+    return 1;
+}
+
+
+/*
+ * writing the manifest of --cache
+ *   files and strikes extracted (or up to date) this time,  and files
+ *   not given this time (as they were)
+ * in:  the manifest (the last one)
+ *      files of this time
+ *      number of files
+ *      strikes (of all files)
+ * out: nothing
+ */
+void cache_save(cacheinfo *cache, fontjob *files, int numFile, strikejob *jobs){
+    FILE *fp;
+    int i, j, k, f;
+
+    if((fp=fopen(cache->name, "w"))==NULL)
+        errexit("cannot open '%s'", cache->name);
+    fprintf(fp, CACHEMAGIC " %016llx\n", (unsigned long long)cache->optkey);
+    for(i=0; i<numFile; i++){
+        fontjob *fj = &files[i];
+
+        if(fj->failed)
+            continue;
+        fprintf(fp, "F %016llx %s\n", (unsigned long long)fj->cachekey, fj->fname);
+        for(j=fj->firstJob; j<fj->firstJob+fj->numJob; j++){
+            if(jobs[j].failed)
+                continue;
+            for(f=0; f<jobs[j].nface; f++)
+                fprintf(fp, "S %d %016llx %s\n", jobs[j].index,
+                        (unsigned long long)jobs[j].cachekey, jobs[j].fnames[f]);
+        }
+        //strikes not chosen this time (-p, -g),  of the same tables
+        if(fj->was == NULL || fj->was->key != fj->cachekey)
+            continue;
+        for(k=0; k<fj->was->nstrike; k++){
+            cachestrike *cs = &fj->was->strikes[k];
+
+            for(j=fj->firstJob; j<fj->firstJob+fj->numJob; j++)
+                if(jobs[j].index == cs->index)
+                    break;
+            if(j == fj->firstJob+fj->numJob)
+                fprintf(fp, "S %d %016llx %s\n", cs->index,
+                        (unsigned long long)cs->key, cs->fname);
+        }
+    }
+    for(i=0; i<cache->nfont; i++){
+        cachefont *font = &cache->fonts[i];
+
+        if(font->seen)
+            continue;
+        fprintf(fp, "F %016llx %s\n", (unsigned long long)font->key, font->fname);
+        for(k=0; k<font->nstrike; k++)
+            fprintf(fp, "S %d %016llx %s\n", font->strikes[k].index,
+                    (unsigned long long)font->strikes[k].key, font->strikes[k].fname);
+    }
+    if(fclose(fp)!=0)
+        errexit("cannot write '%s'", cache->name);
+}
+
+
+/*
+ * release the manifest of --cache
+ * in:  the manifest
+ * out: nothing
+ */
+void cache_free(cacheinfo *cache){
+    int i, k;
+
+    for(i=0; i<cache->nfont; i++){
+        for(k=0; k<cache->fonts[i].nstrike; k++)
+            free(cache->fonts[i].strikes[k].fname);
+        free(cache->fonts[i].strikes);
+        free(cache->fonts[i].fname);
+    }
+    free(cache->fonts);
+}
+
+
+/*
+ * a file is there or not
+ * in:  filename
+ * out: 1==there, 0==not
+ */
+int fileexists(const char *fname){
+    struct stat info;
+
+    return stat(fname, &info) == 0;
+}
+
+
+/*
+ * reading a line of any length (without '\n', '\r')
+ * in:  file
+ *      (for in and out) the line:  grown with realloc() (NULL==none yet)
+ *      (for in and out) allocated bytes of the line
+ * out: length of the line,  -1==end of the file
+ */
+long readline(FILE *fp, char **line, size_t *alloc){
+    size_t len = 0;
+    int ch;
+
+    while((ch=getc(fp)) != EOF && ch != '\n'){
+        if(len + 1 >= *alloc){
+            *alloc = *alloc ? *alloc * 2 : 256;
+            if((*line=realloc(*line, *alloc))==NULL)
+                errexit("realloc");
+        }
+        (*line)[len++] = ch;
+    }
+    if(ch == EOF && len == 0)
+        return -1;
+    if(*line == NULL){
+        if((*line=malloc(*alloc=256))==NULL)
+            errexit("malloc");
+    }
+    while(len > 0 && (*line)[len-1] == '\r')
+        len--;
+    (*line)[len] = '\0';
+    return len;
+}
+
+
+/*
+ * entries of an indexSubTable in a range of glyphIDs to extract
+ *   an indexSubTable out of the range is not read
+ * in:  info of indexSubTable
+ *      glyphs of this strike
+ *      number of the range (0 when all glyphs are extracted)
+ *      (for out) range of entries (from <= entry < to)
+ * out: 1==there are entries in the range, 0==no entry
+ */
+int see_idRange(sbitrange *st, glyphsource *src, int r, ulong *from, ulong *to){
+    if(src->ids == NULL){
+        *from = 0;
+        *to = st->n;
+        return 1;
+    }
+    if(src->ids[r].hi < st->first || src->ids[r].lo > st->last)
+        return 0;
+    *from = sbit_find_entry(st, src->ids[r].lo);
+    *to = sbit_find_entry(st, src->ids[r].hi + 1);
+    return *from < *to;
+}
+
+
+/*
+ * reading indexSubTable
+ *   every entry is read by sbit_entry(),  so every format can go
+ *   straight to the entry 'from'
+ * in:  info of indexSubTable
+ *      glyphs of this strike
+ *      components of composite glyphs in this strike
+ *      scratch memory of this thread
+ *      (for in and out) glyphs decoded (NULL==not counted)
+ *      on-memory output
+ *      range of entries to read (from <= entry < to)
+ * out: number of glyphs contained in this range
+ */
+ushort see_indexSubTable(sbitrange *st, glyphsource *src, compcache *cc,
+                         arena *scratch, glyphstat *gs, outbuf *ob, ulong from, ulong to){
+    metricinfo glyph;
+    sbitentry e;
+    ulong i;
+    ushort numGlyphs = 0;
+
+    glyph.imageFormat = st->imageFormat;
+    glyph.outFormat = src->format;
+    glyph.comps = cc;
+    glyph.nest = 0;
+    glyph.scratch = scratch;
+
+    for(i=from; i<to; i++){
+        if(!sbit_entry(st, i, &e))
+            continue; //an empty place
+        glyph.id = e.id;
+        if(pickglyph(src, &glyph)){
+            putglyph(&glyph, cc->tables, st, &e, ob);
+            numGlyphs++;
+            if(gs != NULL)
+                noteglyph(gs, st->indexFormat, &glyph, e.size);
+        }
+    }
+    return numGlyphs;
+}
+
+
+/*
+ * a glyph is wanted or not,  and set its character code
+ * in:  glyphs of this strike
+ *      (for in and out) info of a glyph
+ * out: 1==wanted, 0==not wanted
+ */
+int pickglyph(glyphsource *src, metricinfo *glyph){
+    if(src->wanted != NULL
+       && (src->wanted[glyph->id >> 3] & (0x80 >> (glyph->id & 7))) == 0)
+        return 0;
+    glyph->encoding = (src->encoding != NULL) ? src->encoding[glyph->id] : -1;
+    return 1;
+}
+
+
+/*
+ * decode a part of a strike on memory
+ *   errors are kept in the chunk, and reported by the strike
+ * in:  array of glyphchunk
+ *      index of the chunk
+ * out: nothing
+ */
+void see_chunk(void *arg, int i){
+    glyphchunk *ch = (glyphchunk *)arg + i;
+    errtrap trap;
+
+    ch->glyphs.buf = NULL;
+    pushtrap(&trap);
+    if(setjmp(trap.env)){
+        untrap(&trap);
+        if(ch->glyphs.buf != NULL)
+            ob_free(&ch->glyphs);
+        ch->failed = 1;
+        strcpy(ch->msg, trap.msg);
+        return;
+    }
+    ob_init(&ch->glyphs);
+    if(ch->timed)
+        ch->cpu = cpusec(0);
+    ch->numGlyphs = see_indexSubTable(&ch->st, ch->src, ch->comps, &ch->scratch,
+                                      ch->timed ? &ch->stats : NULL,
+                                      &ch->glyphs, ch->from, ch->to);
+    if(ch->timed)
+        ch->cpu = cpusec(0) - ch->cpu;
+    untrap(&trap);
+}
+
+
+/*
+ * checking indexSubTables of a strike once,  before glyphs are decoded
+ *   an indexSubTable whose entries or glyph data are out of EBLC/EBDT,
+ *   or whose format is not supported,  is skipped (with a warning);
+ *   glyphs of the others are decoded without checking again
+ *   (sbit_check_range())
+ * in:  the strike
+ *      on-memory location: top of indexSubTableArray (in EBLC)
+ *      number of indexSubTableArray-elements
+ * out: nothing (indexSubTables to read are in job->subs)
+ */
+void checkSubTables(strikejob *job, uchar *arrayL, int numElem){
+    int j, nskip = 0;
+
+    if((job->subs=malloc(sizeof(sbitrange) * (numElem + 1)))==NULL)
+        errexit("malloc");
+    job->nsub = 0;
+    for(j=0; j<numElem; j++){
+        sbitrange *st = &job->subs[job->nsub];
+        char why[SBIT_WHYLEN];
+
+        //8 = size of one indexSubTableArray
+        if(sbit_check_range(&job->tables, arrayL, arrayL+(j*8), st, why) == SBIT_OK){
+            job->nsub++;
+            continue;
+        }
+        if(nskip++ == 0)
+            snprintf(job->warn, sizeof(job->warn), "glyphs %u-%u: %s",
+                     st->first, st->last, why);
+    }
+    if(nskip > 1){
+        size_t len = strlen(job->warn);
+        snprintf(job->warn + len, sizeof(job->warn) - len,
+                 " (%d indexSubTables skipped)", nskip);
+    }
+}
+
+
+/*
+ * reading TrueTypefont header
+ * in:  on-memory top of truetype font (or of a font in TTC)
+ *      (for out) table directory
+ * out: nothing
+ */
+void getTableDir(uchar *p, tabledir *dir){
+    cursor c;
+    int i;
+
+    cur_init(&c, p);
+    cur_skip(&c, 4); //version
+    dir->numTable = cur_u16(&c); //number of tables
+    cur_skip(&c, 2); //searchRange
+    cur_skip(&c, 2); //entrySelector
+    cur_skip(&c, 2); //rangeShift
+    dir->recordL = c.p;
+
+    //searchRange in the header is the same value,
+    //  but it is calculated here not to trust a broken font
+    for(dir->searchRange=16; dir->searchRange*2 <= dir->numTable*16; )
+        dir->searchRange *= 2;
+
+    //the spec says records are sorted by tag;  check it once
+    dir->sorted = 1;
+    for(i=1; i<dir->numTable; i++){
+        if(TAGAT(dir->recordL + i*16) <= TAGAT(dir->recordL + (i-1)*16)){
+            dir->sorted = 0;
+            break;
+        }
+    }
+}
+
+
+/*
+ * finding a table in the table directory
+ *   binary search by searchRange,  like a font rasterizer does
+ * in:  table directory
+ *      name of the table (TAG())
+ *      (for out) info of the table
+ * out: 1==found, 0==not found
+ */
+int findTable(tabledir *dir, ulong tag, tableinfo *t){
+    uchar *recL = dir->recordL; //the table record compared
+    ulong range = dir->searchRange;
+    cursor c;
+    int i;
+
+    if(dir->numTable == 0)
+        return 0;
+
+    if(dir->sorted){
+        //rangeShift = numTable*16 - searchRange
+        if(TAGAT(recL + dir->numTable*16 - range) <= tag)
+            recL += dir->numTable*16 - range;
+        while(range > 16){
+            range /= 2;
+            if(TAGAT(recL + range) <= tag)
+                recL += range;
+        }
+    }else{
+        for(i=0; i<dir->numTable; i++, recL+=16){
+            if(TAGAT(recL) == tag)
+                break;
+        }
+        if(i == dir->numTable)
+            return 0;
+    }
+
+    cur_init(&c, recL);
+    t->tag = cur_u32(&c);
+    if(t->tag != tag)
+        return 0;
+    t->checksum = cur_u32(&c);
+    t->offset = cur_u32(&c);
+    t->len = cur_u32(&c);
+    return 1;
+}
+
+
+/*
+ * checking a table is in the file
+ *   a table out of the file is not used (as if it were not found)
+ * in:  info of the file on memory
+ *      info of the table
+ * out: 1==in the file, 0==out of the file
+ */
+int checkTable(fontfile *ff, tableinfo *t){
+    if(inspan(t->offset, t->len, ff->size))
+        return 1;
+    fprintf(stderr, "  Warning: '%c%c%c%c' table is out of the file (ignored).\n",
+            (int)(t->tag>>24) & 0xff, (int)(t->tag>>16) & 0xff,
+            (int)(t->tag>>8) & 0xff, (int)t->tag & 0xff);
+    return 0;
+}
+
+
+/*
+ * a range of bytes is in a table (or a file) or not
+ * in:  (byte) offset of the range from top of the table
+ *      (byte) length of the range
+ *      (byte) length of the table
+ * out: 1==in the table, 0==(partly) out of the table
+ */
+int inspan(ullong off, ullong len, ullong size){
+    return off <= size && len <= size - off;
+}
+
+
+/*
+ * checking TrueTypefont or not
+ * in:  on-memory location: top of truetype font
+ *      (byte) size of the file
+ *      where to write the kind of the font
+ * out: number of fonts in TTC (0==not TTC)
+ *
+ *  If errors, exit program.
+ */
+int validiateTTF(uchar *p, size_t size, FILE *msgfp){
+    cursor c;
+    ulong version;
+    ulong numFonts;
+
+    //12 = size of the offset table (and of TTC header)
+    if(size < 12)
+        errexit("This file is not a TrueTypeFont.");
+    cur_init(&c, p);
+    version = cur_u32(&c);
+    if(version == 0x00010000){
+        fprintf(msgfp, "  Microsoft TrueType/OpenType\n");
+    }else if(version == 0x74746366){ //'ttcf'
+        cur_skip(&c, 4); //TTC version
+        numFonts = cur_u32(&c);
+        fprintf(msgfp, "  Microsoft TrueTypeCollection (%lu fonts)\n", numFonts);
+        if(numFonts == 0)
+            errexit("This TTC file has no font.");
+        //offsets of table directories (4 bytes each)
+        if(!inspan(12, (ullong)numFonts * 4, size))
+            errexit("TTC header is out of the file.");
+        return numFonts;
+    }else if(version == 0x74727565){ //'true'
+        fprintf(msgfp, "  Apple TrueType\n");
+    }else{
+        errexit("This file is not a TrueTypeFont.");
+    }
+    return 0;
+}
 
-        p += sizeof(ulong); //checksum (not use now)
+/*
+ * set a cursor to the top of a table
+ * in:  (for out) cursor
+ *      on-memory location: top of the table
+ * out: nothing
+ */
+void cur_init(cursor *c, uchar *top){
+    c->p = top;
+    c->top = top;
+}
 
-        //offset
-        p = mread(p, sizeof(ulong), s); //number of tables
-        t->offset = (ulong)strtol(s,(char**)NULL,16);
+/*
+ * reading big-endian numbers, and move the cursor forward
+ * in:  cursor
+ * out: the number
+ */
+uchar cur_u8(cursor *c){
+    return *c->p++;
+}
 
-        p += sizeof(ulong); //length (not use now)
+signed char cur_i8(cursor *c){
+    return (signed char)*c->p++;
+}
 
-    }
-    t->next = NULL;
+ushort cur_u16(cursor *c){
+    ushort v = (ushort)((c->p[0]<<8) | c->p[1]);
+    c->p += 2;
+    return v;
 }
 
+ulong cur_u32(cursor *c){
+    ulong v = ((ulong)c->p[0]<<24) | ((ulong)c->p[1]<<16)
+        | ((ulong)c->p[2]<<8) | (ulong)c->p[3];
+    c->p += 4;
+    return v;
+}
 
 /*
- * checking TrueTypefont or not
- * in:  on-memory location: top of truetype font
+ * skip bytes which are not used
+ * in:  cursor
+ *      byte size to skip
  * out: nothing
- *
- *  If errors, exit program.
  */
-void validiateTTF(uchar *p){
-    char s[BUFSIZE];
-
-    p = mread(p, sizeof(ulong), s); //version
-    if(strcmp(s,"0x00010000")==0){
-        printf("  Microsoft TrueType/OpenType\n");
-    }else if(strcmp(s, "0x74746366")==0){
-        printf("  Microsoft TrueTypeCollection\n");
-        errexit("TTC file is not supported yet.");
-    }else if(strcmp(s, "0x74727565")==0){
-        printf("  Apple TrueType\n");
-    }else{
-        errexit("This file is not a TrueTypeFont.");
-    }
+void cur_skip(cursor *c, ulong n){
+    c->p += n;
 }
 
 /*
- * reading given bytes, return to string & pointer
- * in:  on-memory location to read
- *      byte size to read
- *      (for out) string pointer to assign
- * out: on-memory location to read next
+ * position of a cursor
+ * in:  cursor
+ * out: (byte) offset from top of the table
  */
-uchar *mread(uchar *p, int size, char *s){
-    int i;
-    memset(s, 0x00, BUFSIZE); //zero clear
-    sprintf(s, "0x"); //add '0x' for make indentified as hexadecimal
-
-    for(i=0; i<size; i++){
-        sprintf(s+(i*2)+2, "%02x", *p);
-        p++;
-    }
-    return p;
+ulong cur_pos(cursor *c){
+    return c->p - c->top;
 }
 
 
@@ -577,48 +4019,47 @@ uchar *mread(uchar *p, int size, char *s){
  * out: nothing
  */
 void see_bitmapSizeTable(uchar *p, int *numElem, ulong *arrayOffset, metricinfo *bbox){
-    char s[BUFSIZE]; //stored string
+    cursor c;
+
+    cur_init(&c, p);
 
     //offset from EBLCtop to indexSubTableArray
-    p = mread(p, sizeof(ulong), s);
-    *arrayOffset = (ulong)strtol(s,(char**)NULL,16);
+    *arrayOffset = cur_u32(&c);
 
     //indexSubTable size (byte) (not use)
-    p = mread(p, sizeof(ulong), s);
+    cur_skip(&c, 4);
 
     //number of indexSubTableArray-elements (= number of indexSubTables)
-    p = mread(p, sizeof(ulong), s);
-    *numElem = (ulong)strtol(s,(char**)NULL,16);
+    *numElem = cur_u32(&c);
 
     //colorRef (always 0)
-    p = mread(p, sizeof(ulong), s);
+    cur_skip(&c, 4);
 
     //sbitLineMetrics: hori
     //info of metric about all glyphs in a strike
-    p = see_sbitLineMetrics(p, bbox, 1); // 1 means direction==horizontal
+    see_sbitLineMetrics(&c, bbox, 1); // 1 means direction==horizontal
 
 
     //sbitLineMetrics: vert  (not use)
-    p = see_sbitLineMetrics(p, NULL, 0); // 0 means direction==vertical
+    see_sbitLineMetrics(&c, NULL, 0); // 0 means direction==vertical
 
     //start glyphIndex for this size
-    p = mread(p, sizeof(ushort), s);
+    cur_skip(&c, 2);
 
     //end glyphIndex for this size
-    p = mread(p, sizeof(ushort), s);
+    cur_skip(&c, 2);
 
     //ppemX (the strike's boundingbox width (pixel))
-    p = mread(p, sizeof(uchar), s);
-    bbox->ppem = (uchar)strtol(s,(char**)NULL,16);
+    bbox->ppem = cur_u8(&c);
 
     //ppemY
-    p = mread(p, sizeof(uchar), s);
+    cur_skip(&c, 1);
 
     //bitDepth (always 1)
-    p = mread(p, sizeof(uchar), s);
+    cur_skip(&c, 1);
 
     //flags (1=horizontal, 2=vertical)
-    p = mread(p, sizeof(char), s);
+    cur_skip(&c, 1);
 
     return;
 }
@@ -626,53 +4067,49 @@ void see_bitmapSizeTable(uchar *p, int *numElem, ulong *arrayOffset, metricinfo
 
 /*
  * reading info of metric
- * in:  on-memory location:  top of metric-info
+ * in:  cursor at top of metric-info (moved just after metric-info)
  *      directionHori: 1=horizontal,  0=vertical
- * out: on-memory location:  just after metric-info
+ * out: nothing
  */
-uchar *see_sbitLineMetrics(uchar *p, metricinfo *bbox, int directionHori){
-    char s[BUFSIZE];
-    char widthMax, maxBeforeBL, minAfterBL, minOriginSB;
+void see_sbitLineMetrics(cursor *c, metricinfo *bbox, int directionHori){
+    uchar widthMax;
+    signed char maxBeforeBL, minAfterBL, minOriginSB;
 
     //ascender: distance from baseline to upper-line (px)
-    p = mread(p, sizeof(char), s);
+    cur_skip(c, 1);
 
     //descender: distance from baseline to bottom-line (px)
-    p = mread(p, sizeof(char), s);
+    cur_skip(c, 1);
 
     //widthMax
-    p = mread(p, sizeof(uchar), s);
-    widthMax = (char)strtol(s,(char**)NULL,16);
+    widthMax = cur_u8(c);
 
     //caratSlopeNumerator
-    p = mread(p, sizeof(char), s);
+    cur_skip(c, 1);
 
     //caratSlopeDenominator
-    p = mread(p, sizeof(char), s);
+    cur_skip(c, 1);
 
     //caratOffset
-    p = mread(p, sizeof(char), s);
+    cur_skip(c, 1);
 
     //minOriginSB
-    p = mread(p, sizeof(char), s);
-    minOriginSB = (char)strtol(s,(char**)NULL,16);
+    minOriginSB = cur_i8(c);
 
     //minAdvanceSB
-    p = mread(p, sizeof(char), s);
+    cur_skip(c, 1);
 
     //maxBeforeBL
-    p = mread(p, sizeof(char), s);
-    maxBeforeBL = (char)strtol(s,(char**)NULL,16);
+    maxBeforeBL = cur_i8(c);
 
     //minAfterBL
-    p = mread(p, sizeof(char), s);
-    minAfterBL = (char)strtol(s,(char**)NULL,16);
+    minAfterBL = cur_i8(c);
 
     //pad1
-    p = mread(p, sizeof(char), s);
+    cur_skip(c, 1);
 
     //pad2
-    p = mread(p, sizeof(char), s);
+    cur_skip(c, 1);
 
     //if direction==hori, assign metric-info
     //elseif direction==vert, don't assign
@@ -682,241 +4119,611 @@ uchar *see_sbitLineMetrics(uchar *p, metricinfo *bbox, int directionHori){
         bbox->offsetx = minOriginSB;
         bbox->offsety = minAfterBL;
     }
-
-    return p;
 }
 
 
 
 /*
- * reading an indexSubTableArray
- * in:  on-memery location: top of indexSubTableArray-elements
- *      on-memery location: top of indexSubTableArray
- *      (for out) info of indexSubTable
+ * read one glyph, and put to on-memory output
+ *   the glyph is written straight into the output at its end
+ * in:  info of a glyph (id, encoding, output format...)
+ *      EBLC and EBDT
+ *      info of indexSubTable
+ *      the entry of the glyph
+ *      on-memory output
  * out: nothing
  */
-void see_indexSubTableArray(uchar *elemL, uchar *arrayL, indexSubTable_info *st){
-    char s[BUFSIZE];
-    uchar *p = elemL;
+void putglyph(metricinfo *glyph, const sbittables *t, sbitrange *st, sbitentry *e,
+              outbuf *ob){
+    sbitglyph m;
+    sbitimage img;
+    const uchar *rows;
+    uchar *bits; //rows of a bit-aligned or composite glyph (in scratch memory)
+    arenamark mark; //scratch memory before bits
+    int rowbytes;
+    char *d;
+
+    sbit_image(t, st, e, &m, &img);
+    glyph->width = m.width;
+    glyph->height = m.height;
+    glyph->offsetx = m.bearingX;
+    glyph->offsety = m.bearingY - m.height;
+    glyph->advance = m.advance;
+    if(img.kind == SBIT_IMAGE_PNG){
+        setPngRec(&img, t->ebdtL, glyph, ob);
+        return;
+    }
+    if(glyph->outFormat != FMT_BDF && img.kind == SBIT_IMAGE_BITMAP){
+        setGlyphRec(&img, glyph, ob);
+        return;
+    }
+
+    /*
+     * rows of the glyph from byte boundaries
+     *   (a composite glyph is composed of its components)
+     */
+    rowbytes = (glyph->width + 7) / 8;
+    ar_mark(glyph->scratch, &mark);
+    if(img.kind == SBIT_IMAGE_COMPOSITE){
+        rows = setComposite(&img, glyph);
+    }else if(!img.bitAligned && img.len >= (size_t)rowbytes * glyph->height){
+        rows = img.dataL; //the rows in EBDT as they are
+    }else{
+        if((bits=ar_alloc(glyph->scratch, (size_t)rowbytes * glyph->height + 1))==NULL)
+            errexit("malloc");
+        rows = sbit_rows(&img, glyph->width, glyph->height, 1, bits);
+    }
+    if(glyph->outFormat != FMT_BDF){
+        //a composite glyph as a glyphrec
+        img.kind = SBIT_IMAGE_BITMAP;
+        img.dataL = rows;
+        img.len = (size_t)rowbytes * glyph->height;
+        img.bitAligned = 0;
+        setGlyphRec(&img, glyph, ob);
+        ar_rewind(glyph->scratch, &mark);
+        return;
+    }
+
+    /*
+     * make room for the whole glyph
+     *   (2 hex characters x bytes + '\n') x rows
+     */
+    ob_reserve(ob, GLYPHHEADSIZE + (size_t)glyph->height * (2 * rowbytes + 1) + 8);
+    d = ob->buf + ob->len;
+    d = setGlyphHead(glyph, d);
+    d = setGlyphBody(rows, glyph, d);
+    d = bdf_lit(d, "ENDCHAR\n");
+    ob->len = d - ob->buf;
+    ar_rewind(glyph->scratch, &mark);
+}
 
-    //firstGlyphIndex
-    p = mread(p, sizeof(ushort), s);
-    st->first = (ushort)strtol(s,(char**)NULL,16);
 
-    //lastGlyphIndex
-    p = mread(p, sizeof(ushort), s);
-    st->last = (ushort)strtol(s,(char**)NULL,16);
+/*
+ * make the bitmap of a composite glyph
+ *   components are put at their offsets from the top-left of the glyph
+ *   (parts out of the glyph are cut)
+ * in:  the image of the composite glyph (components)
+ *      info of the glyph (width, height)
+ * out: bitmap:  rows from byte boundaries (in scratch memory of the glyph)
+ */
+uchar *setComposite(sbitimage *img, metricinfo *g){
+    int rowbytes = (g->width + 7) / 8;
+    uchar *bits;
+    int i;
 
-    //location of indexSubTable
-    p = mread(p, sizeof(ulong), s);
-    st->subtableL = arrayL + (ulong)strtol(s,(char**)NULL,16);
+    if((bits=ar_alloc(g->scratch, (size_t)rowbytes * g->height + 1))==NULL)
+        errexit("malloc");
+    memset(bits, 0x00, (size_t)rowbytes * g->height + 1);
+    for(i=0; i<img->numComp; i++){
+        unsigned int id;
+        int xoff, yoff;
+        char *rec;
+        glyphrec r;
+
+        sbit_component(img, i, &id, &xoff, &yoff);
+        rec = getComponent(g->comps, id, g->nest + 1, g->scratch);
+        memcpy(&r, rec, sizeof(r));
+        sbit_blit(bits, g->width, g->height, (uchar *)rec + sizeof(glyphrec),
+                  r.width, r.height, xoff, yoff);
+    }
+    return bits;
 }
 
 
 /*
- * raeding header of an indexSubTable
- * in:  (for in and out) info of indexSubTable
- * out: imageFormat
+ * a component glyph,  decoded once for a strike
+ *   threads may decode the same component at the same time;
+ *   then the first one is kept
+ *   it is decoded in scratch memory of this thread,  and copied to
+ *   memory of the strike
+ * in:  components of this strike
+ *      glyphID
+ *      depth of nesting (1==a component of a glyph to write)
+ *      scratch memory of this thread
+ * out: on-memory location: the decoded glyph (glyphrec and its bitmap)
  */
-int see_indexSubHeader(indexSubTable_info *st){
-    char s[BUFSIZE];
-    char *p = st->subtableL;
-    int imageFormat;
+char *getComponent(compcache *cc, ushort id, int nest, arena *scratch){
+    metricinfo m;
+    sbitrange *st;
+    sbitentry e;
+    outbuf ob;
+    arenamark mark;
+    char *rec;
+
+    if(nest > SBIT_MAXNEST)
+        errexit("composite glyphs nest too deep (glyph %d).", id);
+#ifdef USE_THREAD
+    pthread_mutex_lock(&cc->lock);
+#endif
+    if(cc->memo == NULL){
+        if((cc->memo=ar_alloc(&cc->mem, sizeof(char *) * 65536))==NULL){
+#ifdef USE_THREAD
+            pthread_mutex_unlock(&cc->lock);
+#endif
+            errexit("malloc");
+        }
+        memset(cc->memo, 0x00, sizeof(char *) * 65536);
+    }
+    rec = cc->memo[id];
+#ifdef USE_THREAD
+    pthread_mutex_unlock(&cc->lock);
+#endif
+    if(rec != NULL)
+        return rec;
+
+    memset(&m, 0x00, sizeof(metricinfo));
+    if((st=findglyph(cc, id, &e))==NULL)
+        errexit("component glyph %d is not in this strike.", id);
+    m.imageFormat = st->imageFormat;
+    m.id = id;
+    m.encoding = -1;
+    m.outFormat = FMT_PCF; //as a glyphrec
+    m.comps = cc;
+    m.nest = nest;
+    m.scratch = scratch;
+
+    //a glyph of 255x255 pixels at most:  ob is never made larger
+    ar_mark(scratch, &mark);
+    if((ob.buf=ar_alloc(scratch, MAXGLYPHREC))==NULL)
+        errexit("malloc");
+    ob.len = 0;
+    ob.alloc = MAXGLYPHREC;
+    putglyph(&m, cc->tables, st, &e, &ob);
+
+#ifdef USE_THREAD
+    pthread_mutex_lock(&cc->lock);
+#endif
+    if(cc->memo[id] == NULL && (cc->memo[id]=ar_alloc(&cc->mem, ob.len)) != NULL)
+        memcpy(cc->memo[id], ob.buf, ob.len);
+    rec = cc->memo[id];
+#ifdef USE_THREAD
+    pthread_mutex_unlock(&cc->lock);
+#endif
+    ar_rewind(scratch, &mark);
+    if(rec == NULL)
+        errexit("malloc");
+    return rec;
+}
 
-    //indexFormat
-    p = mread(p, sizeof(ushort), s);
-    st->indexFormat = strtol(s,(char**)NULL,16);
 
-    //imageFormat
-    p = mread(p, sizeof(ushort), s);
-    imageFormat = (ushort)strtol(s,(char**)NULL,16);
+/*
+ * finding a glyph in a strike
+ *   the indexSubTable of the glyph,  then its entry
+ * in:  components of this strike (where the strike is)
+ *      glyphID
+ *      (for out) the entry of the glyph
+ * out: the indexSubTable of the glyph (NULL==not found)
+ */
+sbitrange *findglyph(compcache *cc, ushort id, sbitentry *e){
+    sbitrange *st = NULL;
+    ulong k;
+    int j;
+
+    for(j=0; j<cc->nsub; j++){
+        if(cc->subs[j].first <= id && id <= cc->subs[j].last){
+            st = &cc->subs[j];
+            break;
+        }
+    }
+    if(st == NULL)
+        return NULL;
+
+    k = sbit_find_entry(st, id);
+    if(k >= st->n || !sbit_entry(st, k, e) || e->id != id)
+        return NULL;
+    return st;
+}
 
-    //imageDataOffset
-    p = mread(p, sizeof(ulong), s);
-    st->off = (ulong)strtol(s,(char**)NULL,16);
 
-    return imageFormat;
+/*
+ * prepare components of composite glyphs of a strike
+ *   (location of the strike is set after this)
+ * in:  (for out) components
+ * out: nothing
+ */
+void cc_init(compcache *cc){
+    memset(cc, 0x00, sizeof(compcache));
+    ar_init(&cc->mem);
+#ifdef USE_THREAD
+    pthread_mutex_init(&cc->lock, NULL);
+#endif
 }
 
 
 /*
- * read one glyph, and put to file
- * in:  info of a glyph (type of EBDT-imageFormat,... )
- *      size of bitmapdata
- *      writing-file pointer
+ * release components of composite glyphs of a strike
+ *   (can be called twice)
+ * in:  components
  * out: nothing
  */
-void putglyph(metricinfo *glyph, int size, FILE *outfp){
-    uchar *glyphL = glyph->ebdtL + glyph->off;
-    uchar *p = glyphL;
-    char s[GLYPHBUFSIZE];
-    memset(s, 0x00, GLYPHBUFSIZE);
-
-    switch (glyph->imageFormat){
-    case 1:
-        //EBDT format 1: byte-aligned, small-metric
-        p = see_glyphMetrics(p, glyph, 0);
-        setGlyphHead(glyph, s);
-        setGlyphBody_byte(p, glyphL+size, glyph, s);
-        break;
-    case 2:
-        //EBDT format 2: bit-aligned, small-metric
-        p = see_glyphMetrics(p, glyph, 0);
-        setGlyphHead(glyph, s);
-        setGlyphBody_bit(p, glyphL+size, glyph, s);
-        break;
-    case 5:
-        //EBDT format 5: bit-aligned, EBLC-metric
-        setGlyphHead(glyph, s);
-        setGlyphBody_bit(p, glyphL+size, glyph, s);
-        break;
-    case 6:
-        //EBDT format 6: byte-aligned, big-metric
-        p = see_glyphMetrics(p, glyph, 1);
-        setGlyphHead(glyph, s);
-        setGlyphBody_byte(p, glyphL+size, glyph, s);
-        break;
-    case 7:
-        //EBDT format 7: bit-aligned, big-metric
-        p = see_glyphMetrics(p, glyph, 1);
-        setGlyphHead(glyph, s);
-        setGlyphBody_bit(p, glyphL+size, glyph, s);
-        break;
-    default:
-        errexit("imageFormat %d is not supported.", glyph->imageFormat);
-        break;
-    }
-
-    fprintf(outfp, "%sENDCHAR\n", s);
-}
-
-
-/*
- * set header of a BDF glyph to string
- * in:  info of glyph(glyph's boudingbox)
- *      (for out) string pointer
+void cc_free(compcache *cc){
+    ar_free(&cc->mem);
+    cc->memo = NULL;
+#ifdef USE_THREAD
+    if(cc->tables != NULL)
+        pthread_mutex_destroy(&cc->lock);
+#endif
+    cc->tables = NULL;
+}
+
+
+/*
+ * prepare an empty on-memory output
+ * in:  (for out) on-memory output
  * out: nothing
  */
-void setGlyphHead(metricinfo *g, char *s){
-    sprintf(s,
-            "STARTCHAR glyphID:%04x\n"
-            "ENCODING %d\n"
-            "DWIDTH %d\n"
-            "BBX %d %d %d %d\n"
-            "BITMAP\n",
-            g->id, -1, g->advance,
-            g->width, g->height, g->offsetx, g->offsety
-            );
+void ob_init(outbuf *ob){
+    ob->alloc = OUTBUFSIZE;
+    ob->len = 0;
+    if((ob->buf=malloc(ob->alloc))==NULL)
+        errexit("malloc");
 }
 
 
+/*
+ * make room to write more
+ * in:  on-memory output
+ *      (byte) size to be written
+ * out: nothing
+ */
+void ob_reserve(outbuf *ob, size_t n){
+    if(ob->len + n <= ob->alloc)
+        return;
+    while(ob->len + n > ob->alloc)
+        ob->alloc *= 2;
+    if((ob->buf=realloc(ob->buf, ob->alloc))==NULL)
+        errexit("realloc");
+}
+
+
+/*
+ * append bytes to an on-memory output
+ * in:  on-memory output
+ *      bytes to write
+ *      (byte) size to write
+ * out: nothing
+ */
+void ob_write(outbuf *ob, const char *s, size_t n){
+    ob_reserve(ob, n);
+    memcpy(ob->buf + ob->len, s, n);
+    ob->len += n;
+}
+
+
+/*
+ * release an on-memory output
+ * in:  on-memory output
+ * out: nothing
+ */
+void ob_free(outbuf *ob){
+    free(ob->buf);
+    ob->buf = NULL;
+    ob->len = ob->alloc = 0;
+}
+
 
 /*
- * set bitmap of a BDF glyph: byte-aligned
- * in:  on-memory location: beginning of bitmapdata in EBDT
- *      on-memory location: end of bitmapdata in EBDT
- *      info of glyph (width)
- *      (for out) string pointer
+ * prepare empty scratch memory
+ *   (no block is allocated until memory is needed)
+ * in:  (for out) scratch memory
  * out: nothing
  */
-void setGlyphBody_byte(uchar *p, const uchar *end, metricinfo *g, char *s){
-    int cnt = 0; //counter: print newline or not
-    char str[GLYPHBUFSIZE];
-    memset(str, 0x00, GLYPHBUFSIZE);
-
-    while(p < end){
-        //read one byte, change to 2 characters of hexadecimal
-        sprintf(str, "%x%x", (*p)>>4, (*p)&0x0f);
-        strcat(s, str);
-        //not print '\n' if cnt < glyph.width-(int)1)/8
-        if( (g->width-(int)1)/8 <= cnt){
-            strcat(s, "\n");
-            cnt = 0;
+void ar_init(arena *a){
+    a->cur = NULL;
+    a->spare = NULL;
+}
+
+
+/*
+ * give out scratch memory
+ *   it is not released one by one,  but by ar_rewind() or ar_free()
+ * in:  scratch memory
+ *      (byte) size
+ * out: on-memory location (NULL==cannot allocate, like malloc())
+ */
+void *ar_alloc(arena *a, size_t n){
+    //ARENAALIGN rounded up: the memory given out after the header
+    const size_t head = (sizeof(arenablock) + ARENAALIGN - 1) / ARENAALIGN * ARENAALIGN;
+    arenablock *b = a->cur;
+    char *p;
+
+    n = (n + ARENAALIGN - 1) / ARENAALIGN * ARENAALIGN;
+    if(b == NULL || b->alloc - b->len < n){
+        size_t alloc = (n > ARENABLOCK) ? n : ARENABLOCK;
+
+        if(a->spare != NULL && a->spare->alloc >= n){
+            b = a->spare;
+            a->spare = NULL;
+        }else if((b=malloc(head + alloc))==NULL){
+            return NULL;
         }else{
-            cnt++;
+            b->alloc = alloc;
         }
-        p++;
+        b->prev = a->cur;
+        b->len = 0;
+        a->cur = b;
     }
+    p = (char *)b + head + b->len;
+    b->len += n;
+    return p;
 }
 
 
+/*
+ * remember where scratch memory is given out now
+ * in:  scratch memory
+ *      (for out) the place
+ * out: nothing
+ */
+void ar_mark(arena *a, arenamark *m){
+    m->b = a->cur;
+    m->len = (a->cur != NULL) ? a->cur->len : 0;
+}
+
 
+/*
+ * release scratch memory given out after ar_mark()
+ *   the largest block allocated after it is kept as the spare,
+ *   so that memory for each glyph is not allocated again
+ * in:  scratch memory
+ *      the place
+ * out: nothing
+ */
+void ar_rewind(arena *a, arenamark *m){
+    while(a->cur != m->b){
+        arenablock *b = a->cur;
+
+        a->cur = b->prev;
+        if(a->spare == NULL || a->spare->alloc < b->alloc){
+            free(a->spare);
+            a->spare = b;
+        }else{
+            free(b);
+        }
+    }
+    if(a->cur != NULL)
+        a->cur->len = m->len;
+}
 
 
 /*
- * set bitmap of a BDF glyph: bit-aligned
- * in:  on-memory location: beginning of bitmapdata in EBDT
- *      on-memory location: end of bitmapdata in EBDT
- *      info of glyph (width, height)
- *      (for out) string pointer
+ * release all scratch memory
+ *   (can be called twice)
+ * in:  scratch memory
  * out: nothing
  */
-void setGlyphBody_bit(uchar *p, const uchar *end, metricinfo *g, char *s){
-    uchar *b, *mem, *binline, pad;
-    int i,j,k;
-    static char *hex2bin[]= {
-        "0000","0001","0010","0011","0100","0101","0110","0111",
-        "1000","1001","1010","1011","1100","1101","1110","1111"
-    };
-    char str[GLYPHBUFSIZE];
-    memset(str, 0x00, GLYPHBUFSIZE);
+void ar_free(arena *a){
+    arenamark m;
+
+    m.b = NULL;
+    m.len = 0;
+    ar_rewind(a, &m);
+    free(a->spare);
+    a->spare = NULL;
+}
 
-    /*
-     * write binary number without padding
-     */
-    mem = malloc(MAXGLYPHWIDTH * MAXGLYPHWIDTH); //width x height
-    memset(mem, '0', MAXGLYPHWIDTH * MAXGLYPHWIDTH);
-    b = mem;
 
-    while(p < end){
-        //read one byte, change to 2 characters of hexadecimal
-        memcpy(b, hex2bin[(*p)>>4], 4);
-        b+=4;
-        memcpy(b, hex2bin[(*p)&0x0f], 4);
-        b+=4;
-        p++;
+/*
+ * set header of a BDF glyph
+ * in:  info of glyph(glyph's boudingbox)
+ *      (for out) location to write (GLYPHHEADSIZE bytes at most)
+ * out: location just after written
+ */
+char *setGlyphHead(metricinfo *g, char *d){
+    d = bdf_lit(d, "STARTCHAR ");
+    d = bdf_name(d, g->encoding, g->id);
+    if(g->encoding >= 0){
+        d = bdf_lit(d, "\nENCODING ");
+        d = bdf_int(d, (int)g->encoding);
+    }else{
+        d = bdf_lit(d, "\nENCODING -1");
     }
+    d = bdf_lit(d, "\nDWIDTH ");
+    d = bdf_int(d, g->advance);
+    d = bdf_lit(d, "\nBBX ");
+    d = bdf_int(d, g->width);
+    *d++ = ' ';
+    d = bdf_int(d, g->height);
+    *d++ = ' ';
+    d = bdf_int(d, g->offsetx);
+    *d++ = ' ';
+    d = bdf_int(d, g->offsety);
+    d = bdf_lit(d, "\nBITMAP\n");
+    return d;
+}
 
-    /*
-     * set padding for hori
-     */
-    binline = malloc(MAXGLYPHWIDTH);
-    memset(binline, '0', MAXGLYPHWIDTH);
-    pad = ((g->width+7)/8*8) - g->width;
+
+
+/*
+ * set bitmap of a BDF glyph
+ * in:  rows of the bitmap from byte boundaries (sbit_rows())
+ *      info of glyph (width, height)
+ *      (for out) location to write
+ * out: location just after written
+ */
+char *setGlyphBody(const uchar *rows, metricinfo *g, char *d){
+    int rowbytes = (g->width + 7) / 8;
+    int i, j;
 
     for(i=0; i<g->height; i++){
-        for(j=0; j<g->width; j++){
-            *(binline+j) = *(mem + (i*g->width) + j);
-        }
-        for( ; j<g->width+pad; j++){
-            *(binline+j) = '0';
-        }
+        //a byte as 2 characters of hexadecimal,  a row in a line
+        for(j=0; j<rowbytes; j++)
+            d = bdf_hex(d, *rows++);
+        *d++ = '\n';
+    }
+    return d;
+}
 
-        /*
-         * change back to hexadecimal
-         */
-        for(j=0; j<g->width+pad; j+=4){
-            for(k=0x0; k<=0xf; k++){
-                if(strncmp(binline+j,hex2bin[k],4)==0){
-                    sprintf(str, "%x", k);
-                    strcat(s, str);
-                }
-            }
-        }
-        strcat(s, "\n");
+
+/*
+ * writing pieces of BDF text
+ *   bdf_hex: a byte as 2 characters of hexadecimal
+ *   bdf_int: a decimal number (printf("%d") without printf)
+ *   bdf_str: a string of given length
+ * in:  location to write
+ *      what to write
+ * out: location just after written
+ */
+char *bdf_hex(char *d, uchar v){
+    static const char hexpair[] =
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+    d[0] = hexpair[v*2];
+    d[1] = hexpair[v*2+1];
+    return d + 2;
+}
+
+char *bdf_int(char *d, int v){
+    char tmp[12];
+    int n = 0;
+    unsigned int u = (v < 0) ? -(unsigned int)v : (unsigned int)v;
+
+    if(v < 0)
+        *d++ = '-';
+    do{
+        tmp[n++] = '0' + u % 10;
+        u /= 10;
+    }while(u);
+    while(n)
+        *d++ = tmp[--n];
+    return d;
+}
+
+char *bdf_str(char *d, const char *s, size_t n){
+    memcpy(d, s, n);
+    return d + n;
+}
+
+
+/*
+ * name of a glyph (at most 16 characters)
+ *   with character code: uniXXXX (or uXXXXX over U+FFFF)
+ *   without:             glyphID:xxxx
+ * in:  location to write
+ *      character code (-1==none)
+ *      glyphID
+ * out: location just after written
+ */
+char *bdf_name(char *d, long encoding, ushort id){
+    static const char hexupper[] = "0123456789ABCDEF";
+
+    if(encoding >= 0){
+        int n = (encoding > 0xffff) ? ((encoding > 0xfffff) ? 6 : 5) : 4;
+
+        if(n == 4)
+            d = bdf_lit(d, "uni");
+        else
+            d = bdf_lit(d, "u");
+        while(n--)
+            *d++ = hexupper[(encoding >> (n*4)) & 0x0f];
+    }else{
+        d = bdf_lit(d, "glyphID:");
+        d = bdf_hex(d, id >> 8);
+        d = bdf_hex(d, id & 0xff);
     }
-    free(mem);
-    free(binline);
+    return d;
+}
+
+
+/*
+ * put a glyph of a color strike on memory (for -f png)
+ *   a pngrec: metrics,  and where its PNG image is in CBDT
+ * in:  the image of the glyph (SBIT_IMAGE_PNG)
+ *      on-memory location: top of CBDT
+ *      info of glyph
+ *      on-memory output
+ * out: nothing
+ */
+void setPngRec(sbitimage *img, const uchar *ebdtL, metricinfo *g, outbuf *ob){
+    pngrec r;
+
+    r.len = img->len;
+    r.off = img->dataL - ebdtL;
+    r.encoding = g->encoding;
+    r.id = g->id;
+    r.width = g->width;
+    r.height = g->height;
+    r.advance = g->advance;
+    r.offsetx = g->offsetx;
+    r.offsety = g->offsety;
+    ob_write(ob, (char *)&r, sizeof(r));
 }
 
+
+/*
+ * put a decoded glyph on memory (for PCF)
+ *   a glyphrec,  and rows of the bitmap from byte boundaries
+ * in:  the image of the glyph (SBIT_IMAGE_BITMAP)
+ *      info of glyph
+ *      on-memory output
+ * out: nothing
+ */
+void setGlyphRec(sbitimage *img, metricinfo *g, outbuf *ob){
+    glyphrec r;
+    int rowbytes = (g->width + 7) / 8;
+    size_t bytes = (size_t)rowbytes * g->height;
+    const uchar *rows;
+    uchar *d;
+
+    r.encoding = g->encoding;
+    r.id = g->id;
+    r.width = g->width;
+    r.height = g->height;
+    r.advance = g->advance;
+    r.offsetx = g->offsetx;
+    r.offsety = g->offsety;
+    ob_reserve(ob, sizeof(r) + bytes);
+    memcpy(ob->buf + ob->len, &r, sizeof(r));
+    d = (uchar *)ob->buf + ob->len + sizeof(r);
+    ob->len += sizeof(r) + bytes;
+
+    //rows are decoded straight into the output
+    if((rows=sbit_rows(img, g->width, g->height, 1, d)) != d)
+        memcpy(d, rows, bytes);
+}
+
+
 /*
  * display error messages, and exit this program
+ *   (if a trap is set, go back to it instead of exiting)
  * in:  variable arguments to print
  * out: nothing
  */
 void errexit(char *fmt, ...){
         va_list ap;
         va_start(ap, fmt);
+        if(curtrap != NULL){
+            errtrap *trap = curtrap;
+            vsnprintf(trap->msg, sizeof(trap->msg), fmt, ap);
+            va_end(ap);
+            longjmp(trap->env, 1);
+        }
         //        fprintf(stderr, "%s: ", PROGNAME);
         fprintf(stderr, "  Error: ");
         vfprintf(stderr, fmt, ap);
@@ -927,59 +4734,17 @@ void errexit(char *fmt, ...){
 }
 
 
-/*
- * reading BigGlyphMetrics/SmallGlyphMetrics in EBLC
- * in:  on-memory location: top of Big/Small GlyphMetrics
- *      (for out) info of glyph
- *      Big or Small (1==big, 0==small)
- * out: on-memory location: just after Big/Small GlyphMetrics
- */
-uchar *see_glyphMetrics(uchar *p, metricinfo *met, int big){
-    char s[BUFSIZE];
-
-    //height
-    p = mread(p, sizeof(uchar), s);
-    met->height = (uchar)strtol(s,(char**)NULL,16);
-
-    //width
-    p = mread(p, sizeof(uchar), s);
-    met->width = (uchar)strtol(s,(char**)NULL,16);
-
-    //horiBearingX
-    p = mread(p, sizeof(char), s);
-    met->offsetx = (char)strtol(s,(char**)NULL,16);
-
-    //horiBearingY
-    p = mread(p, sizeof(char), s);
-    met->offsety = (char)strtol(s,(char**)NULL,16) - met->height;
-
-    //horiAdvance
-    p = mread(p, sizeof(uchar), s);
-    met->advance = (uchar)strtol(s,(char**)NULL,16);
-
-    if(big){
-        //vertBearingX
-        p = mread(p, sizeof(char), s);
-
-        //vertBearingY
-        p = mread(p, sizeof(char), s);
-
-        //vertAdvance
-        p = mread(p, sizeof(uchar), s);
-    }
-    return p;
-}
-
 /*
  * reading 'name' table
+ *   records and strings out of the table are not used
  *   in:  on-memory location: top of 'name'
+ *        (byte) length of 'name'
  *        (for out) strings of copyright
  *        (for out) strings of fontname
  *   out: nothing
  */
-void see_name(uchar *nameL, char *copyright, char *fontname){
-    char s[BUFSIZE];
-    char *p = nameL;
+void see_name(uchar *nameL, ulong len, char *copyright, char *fontname){
+    cursor c;
     ushort numRecord, storageoff;
     int i, j;
     //make copyright/fontname string have priority(level).
@@ -993,16 +4758,22 @@ void see_name(uchar *nameL, char *copyright, char *fontname){
 
     /*
      * reading header of 'name' table
+     *   6 = size of the header
      */
-    p = mread(p, sizeof(ushort), s); //format selector
+    if(len < 6)
+        return;
+    cur_init(&c, nameL);
+    cur_skip(&c, 2); //format selector
 
     //number of name records
-    p = mread(p, sizeof(ushort), s);
-    numRecord = (ushort)strtol(s,(char**)NULL,16);
+    numRecord = cur_u16(&c);
 
     //offset from 'name'top to string storage
-    p = mread(p, sizeof(ushort), s);
-    storageoff =  (ushort)strtol(s,(char**)NULL,16);
+    storageoff = cur_u16(&c);
+
+    //12 = size of a nameRecord
+    if(numRecord > (len - 6) / 12)
+        numRecord = (len - 6) / 12;
 
     /*
      * reading nameRecords
@@ -1011,29 +4782,25 @@ void see_name(uchar *nameL, char *copyright, char *fontname){
         ushort platformid, specificid, langid, nameid, slen, soff;
 
         //PlatformID
-        p = mread(p, sizeof(ushort), s);
-        platformid = (ushort)strtol(s,(char**)NULL,16);
+        platformid = cur_u16(&c);
 
         //Platform-specificID
-        p = mread(p, sizeof(ushort), s);
-        specificid = (ushort)strtol(s,(char**)NULL,16);
+        specificid = cur_u16(&c);
 
         //LanguageID
-        p = mread(p, sizeof(ushort), s);
-        langid = (ushort)strtol(s,(char**)NULL,16);
+        langid = cur_u16(&c);
 
         //NameID
-        p = mread(p, sizeof(ushort), s);
-        nameid = (ushort)strtol(s,(char**)NULL,16);
+        nameid = cur_u16(&c);
 
         //String Length
-        p = mread(p, sizeof(ushort), s);
-        slen = (ushort)strtol(s,(char**)NULL,16);
+        slen = cur_u16(&c);
 
         //string storage offset from start of storage area
-        p = mread(p, sizeof(ushort), s);
-        soff = (ushort)strtol(s,(char**)NULL,16);
+        soff = cur_u16(&c);
 
+        if(!inspan((ulong)storageoff + soff, slen, len))
+            continue;
 
 
         if(platformid==1 && langid==0){
@@ -1143,4 +4910,390 @@ void copystr(char *dst, uchar *src, ushort len, int forFilename){
     }
     *dst='\0';
 }
+
+
+/*
+ * reading 'cmap' table
+ *   choose a Unicode subtable
+ *   (priority: full Unicode format 12,  then BMP format 4)
+ *   a subtable out of 'cmap' is not chosen,  so that the chosen one
+ *   is read without checking again
+ * in:  on-memory location: top of 'cmap'
+ *      (byte) length of 'cmap'
+ * out: on-memory location: top of the subtable (NULL==not found)
+ */
+uchar *see_cmap(uchar *cmapL, ulong len){
+    cursor c;
+    ushort numTables;
+    uchar *best = NULL;
+    int bestlevel = 0; //larger is better
+    int bad = 0; //number of broken Unicode subtables
+    int i;
+
+    //4 = size of the header,  8 = size of an encoding record
+    if(len < 4)
+        return NULL;
+    cur_init(&c, cmapL);
+    cur_skip(&c, 2); //version
+    numTables = cur_u16(&c);
+    if(numTables > (len - 4) / 8)
+        numTables = (len - 4) / 8;
+
+    for(i=0; i<numTables; i++){
+        ushort platformid, specificid, format;
+        ulong suboff;
+        uchar *subL;
+        int level = 0;
+
+        platformid = cur_u16(&c);
+        specificid = cur_u16(&c);
+        suboff = cur_u32(&c);
+        if(!inspan(suboff, 2, len))
+            continue;
+        subL = cmapL + suboff;
+        format = (subL[0]<<8) | subL[1];
+
+        if(platformid==3 && specificid==10 && format==12)
+            level = 4; //Microsoft, UCS-4
+        else if(platformid==0 && format==12)
+            level = 3; //Unicode
+        else if(platformid==3 && specificid==1 && format==4)
+            level = 2; //Microsoft, Unicode BMP
+        else if(platformid==0 && format==4)
+            level = 1; //Unicode
+        if(level > bestlevel){
+            if(!checkCmap(subL, len - suboff)){
+                bad++;
+                continue;
+            }
+            best = subL;
+            bestlevel = level;
+        }
+    }
+    if(bad)
+        fprintf(stderr, "  Warning: %d Unicode subtable%s of 'cmap' %s broken (ignored).\n",
+                bad, bad > 1 ? "s" : "", bad > 1 ? "are" : "is");
+    return best;
+}
+
+
+/*
+ * checking a cmap subtable (format 4 or 12) is in 'cmap'
+ *   all of what makeEncoding(), markCodes() read is checked here
+ * in:  on-memory location: top of the subtable
+ *      (byte) length from the subtable to the end of 'cmap'
+ * out: 1==good, 0==broken
+ */
+int checkCmap(uchar *subL, ulong avail){
+    if(((subL[0]<<8) | subL[1]) == 4){
+        int segCount, i;
+
+        //14 = offset of endCode[]
+        if(avail < 14)
+            return 0;
+        segCount = ((subL[6]<<8) | subL[7]) / 2;
+        //endCode, reservedPad, startCode, idDelta, idRangeOffset
+        if(!inspan(14, 2 + segCount*8, avail))
+            return 0;
+        for(i=0; i<segCount; i++){
+            ulong end = (subL[14+i*2]<<8) | subL[15+i*2];
+            ulong start = (subL[16+segCount*2+i*2]<<8) | subL[17+segCount*2+i*2];
+            ulong rangeAt = 16 + segCount*6 + i*2; //offset of idRangeOffset[i]
+            ulong rangeoff = (subL[rangeAt]<<8) | subL[rangeAt+1];
+
+            //codes read are start..end (but not 0xffff)
+            if(end >= 0xffff)
+                end = 0xfffe;
+            if(rangeoff == 0 || start > end)
+                continue;
+            //glyphIdArray is addressed from the place of idRangeOffset[i]
+            if(!inspan(rangeAt + rangeoff, (end - start + 1) * 2, avail))
+                return 0;
+        }
+    }else{
+        ulong numGroups;
+
+        //16 = size of format 12 header,  12 = size of a group
+        if(avail < 16)
+            return 0;
+        numGroups = ((ulong)subL[12]<<24) | ((ulong)subL[13]<<16)
+            | ((ulong)subL[14]<<8) | (ulong)subL[15];
+        if(!inspan(16, (ullong)numGroups * 12, avail))
+            return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * make the table of glyphID -> character code
+ *   if some codes have the same glyph,  the smallest code is used
+ * in:  on-memory location: top of cmap subtable (format 4 or 12)
+ * out: character code of each glyphID (-1==none), 65536 elements
+ */
+long *makeEncoding(uchar *subL){
+    long *enc;
+    cursor c;
+    ulong i, code;
+
+    if((enc=malloc(sizeof(long) * 65536))==NULL)
+        errexit("malloc");
+    for(i=0; i<65536; i++)
+        enc[i] = -1;
+
+    cur_init(&c, subL);
+    if(cur_u16(&c) == 4){
+        int segCount, seg;
+
+        cur_skip(&c, 4); //length, language
+        segCount = cur_u16(&c) / 2;
+        for(seg=0; seg<segCount; seg++){
+            //endCode[seg], startCode[seg]  (16 = size of format 4 header)
+            ulong end = (subL[14+seg*2]<<8) | subL[15+seg*2];
+            ulong start = (subL[16+segCount*2+seg*2]<<8) | subL[17+segCount*2+seg*2];
+
+            for(code=start; code<=end && code<0xffff; code++){
+                ushort gid = cmap4glyph(subL, segCount, seg, code);
+                if(gid != 0 && enc[gid] < 0)
+                    enc[gid] = code;
+            }
+        }
+    }else{
+        ulong numGroups;
+
+        cur_skip(&c, 2 + 4 + 4); //reserved, length, language
+        numGroups = cur_u32(&c);
+        for(i=0; i<numGroups; i++){
+            ulong start = cur_u32(&c);
+            ulong end = cur_u32(&c);
+            ulong gid = cur_u32(&c);
+
+            for(code=start; code<=end && code<=0x10ffff; code++, gid++){
+                if(gid > 0xffff)
+                    break;
+                if(gid != 0 && (enc[gid] < 0 || (long)code < enc[gid]))
+                    enc[gid] = code;
+            }
+        }
+    }
+    return enc;
+}
+
+
+/*
+ * mark glyphIDs of a range of character codes
+ *   the first segment in the range is found by binary search,
+ *   so only segments in the range are read
+ * in:  on-memory location: top of cmap subtable (format 4 or 12)
+ *      first character code
+ *      last character code
+ *      (for in and out) bits of glyphIDs
+ * out: nothing
+ */
+void markCodes(uchar *subL, ulong lo, ulong hi, uchar *wanted){
+    cursor c;
+    ulong code;
+    long left, right, mid;
+
+    cur_init(&c, subL);
+    if(cur_u16(&c) == 4){
+        int segCount;
+
+        cur_skip(&c, 4); //length, language
+        segCount = cur_u16(&c) / 2;
+
+        //first segment whose endCode >= lo
+        left = 0;
+        right = segCount;
+        while(left < right){
+            mid = (left + right) / 2;
+            if(((ulong)(subL[14+mid*2]<<8) | subL[15+mid*2]) < lo)
+                left = mid + 1;
+            else
+                right = mid;
+        }
+        for(; left<segCount; left++){
+            ulong end = (subL[14+left*2]<<8) | subL[15+left*2];
+            ulong start = (subL[16+segCount*2+left*2]<<8) | subL[17+segCount*2+left*2];
+
+            if(start > hi)
+                break;
+            for(code=(start>lo ? start : lo); code<=end && code<=hi && code<0xffff; code++){
+                ushort gid = cmap4glyph(subL, segCount, left, code);
+                if(gid != 0)
+                    wanted[gid>>3] |= 0x80 >> (gid & 7);
+            }
+        }
+    }else{
+        ulong numGroups;
+        uchar *groupL; //top of groups
+
+        cur_skip(&c, 2 + 4 + 4); //reserved, length, language
+        numGroups = cur_u32(&c);
+        groupL = c.p;
+
+        //first group whose endCharCode >= lo  (12 = size of a group)
+        left = 0;
+        right = numGroups;
+        while(left < right){
+            mid = (left + right) / 2;
+            cur_init(&c, groupL + mid*12 + 4);
+            if(cur_u32(&c) < lo)
+                left = mid + 1;
+            else
+                right = mid;
+        }
+        for(; (ulong)left<numGroups; left++){
+            ulong start, end, gid;
+
+            cur_init(&c, groupL + left*12);
+            start = cur_u32(&c);
+            end = cur_u32(&c);
+            gid = cur_u32(&c);
+            if(start > hi)
+                break;
+            for(code=start; code<=end && code<=hi; code++, gid++){
+                if(gid > 0xffff)
+                    break;
+                if(code >= lo && gid != 0)
+                    wanted[gid>>3] |= 0x80 >> (gid & 7);
+            }
+        }
+    }
+}
+
+
+/*
+ * glyphID of a character code in a segment of cmap format 4
+ * in:  on-memory location: top of cmap subtable
+ *      number of segments
+ *      index of the segment
+ *      character code (in the segment)
+ * out: glyphID (0==missing glyph)
+ */
+ushort cmap4glyph(uchar *subL, int segCount, int seg, ulong code){
+    uchar *deltaL = subL + 16 + segCount*4 + seg*2;  //idDelta[seg]
+    uchar *rangeL = deltaL + segCount*2;             //idRangeOffset[seg]
+    ushort start = (subL[16+segCount*2+seg*2]<<8) | subL[17+segCount*2+seg*2];
+    ushort delta = (deltaL[0]<<8) | deltaL[1];
+    ushort rangeoff = (rangeL[0]<<8) | rangeL[1];
+    ushort gid;
+
+    if(rangeoff == 0)
+        return (ushort)(code + delta);
+
+    //glyphIdArray is addressed from the place of idRangeOffset[seg]
+    rangeL += rangeoff + (code - start) * 2;
+    gid = (rangeL[0]<<8) | rangeL[1];
+    if(gid == 0)
+        return 0;
+    return (ushort)(gid + delta);
+}
+
+
+/*
+ * add a range to extract
+ *   hexadecimal: "3000-30ff", "U+3042", "0x4e00-0x9fff" (character codes)
+ *   decimal:     "100-200", "12", "0x100-0x1ff" (glyphIDs, ppems)
+ * in:  argument of -c, -g or -p
+ *      (for in and out) ranges
+ *      (for in and out) number of ranges
+ *      1==hexadecimal, 0==decimal
+ * out: nothing
+ */
+void addRange(char *arg, coderange **ranges, int *nrange, int hex){
+    coderange r;
+    char *p = arg, *end;
+
+    if(hex && (strncmp(p, "U+", 2)==0 || strncmp(p, "u+", 2)==0))
+        p += 2;
+    r.lo = strtoul(p, &end, rangebase(p, hex));
+    if(end == p)
+        errexit("bad range '%s'", arg);
+    r.hi = r.lo;
+    if(*end == '-'){
+        p = end + 1;
+        if(hex && (strncmp(p, "U+", 2)==0 || strncmp(p, "u+", 2)==0))
+            p += 2;
+        r.hi = strtoul(p, &end, rangebase(p, hex));
+        if(end == p)
+            errexit("bad range '%s'", arg);
+    }
+    if(*end != '\0' || r.hi < r.lo)
+        errexit("bad range '%s'", arg);
+
+    if((*ranges=realloc(*ranges, sizeof(coderange) * (*nrange+1)))==NULL)
+        errexit("realloc");
+    (*ranges)[(*nrange)++] = r;
+}
+
+
+/*
+ * base of a number in a range:  decimal ranges take "0x" for hexadecimal,
+ *   but a leading '0' is not octal ("08" is 8)
+ * in:  the number
+ *      1==hexadecimal, 0==decimal
+ * out: base for strtoul()
+ */
+int rangebase(const char *p, int hex){
+    if(hex || (p[0]=='0' && (p[1]=='x' || p[1]=='X')))
+        return 16;
+    return 10;
+}
+
+
+/*
+ * sort ranges,  and join ranges which overlap
+ * in:  (for in and out) ranges
+ *      (for in and out) number of ranges
+ * out: nothing
+ */
+void sortRanges(coderange *ranges, int *nrange){
+    int i, n;
+
+    if(*nrange == 0)
+        return;
+    qsort(ranges, *nrange, sizeof(coderange), cmpRange);
+    for(i=1, n=1; i<*nrange; i++){
+        if(ranges[i].lo <= ranges[n-1].hi + 1){
+            if(ranges[i].hi > ranges[n-1].hi)
+                ranges[n-1].hi = ranges[i].hi;
+        }else{
+            ranges[n++] = ranges[i];
+        }
+    }
+    *nrange = n;
+}
+
+
+/*
+ * compare ranges for qsort()
+ * in:  ranges
+ * out: <0, 0, >0
+ */
+int cmpRange(const void *a, const void *b){
+    const coderange *x = a, *y = b;
+
+    if(x->lo != y->lo)
+        return (x->lo < y->lo) ? -1 : 1;
+    return 0;
+}
+
+
+/*
+ * some of lo..hi is in the ranges or not
+ * in:  ranges
+ *      number of ranges
+ *      first and last
+ * out: 1==yes, 0==no
+ */
+int inRanges(coderange *ranges, int nrange, ulong lo, ulong hi){
+    int i;
+
+    for(i=0; i<nrange; i++){
+        if(ranges[i].lo <= hi && lo <= ranges[i].hi)
+            return 1;
+    }
+    return 0;
+}
 //end of file
@@ -0,0 +1,1281 @@
+/*
+ * sbitput  --  make bitmap-data of a TrueType font from BDF files
+ *              (the inverse of sbitget)
+ * Itou Hiroki
+ */
+
+/*
+ * Copyright (c) 2002 ITOU Hiroki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#define PROGNAME "sbitput"
+#define PROGVERSION "0.1"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h> /* vfprintf() */
+
+#define uchar unsigned char
+#define ulong unsigned long
+#define ushort unsigned short
+#define MAXFILENAMECHAR 256
+#define MAXSTRINGINBDF 1000
+#define MAXLINECHAR 4096
+#define STRUNKNOWN "???"
+#define UNITSPEREM 2048
+#define MAXSEGDATA 65535 //(byte) images of an indexSubTable with 2-byte offsets
+
+//name of a table as a 32-bit number (e.g. TAG('E','B','D','T'))
+#define TAG(a,b,c,d) (((ulong)(a)<<24) | ((ulong)(b)<<16) | ((ulong)(c)<<8) | (ulong)(d))
+
+//(byte) size of an indexSubTable of each format without its entries:
+//  indexSubTableArray element, indexSubHeader,  and the last offset
+//  (1, 3, 4),  or imageSize and bigGlyphMetrics (2, 5)
+#define COST_FIX1 (8 + 8 + 4)
+#define COST_FIX2 (8 + 8 + 4 + 8)
+#define COST_FIX3 (8 + 8 + 2)
+#define COST_FIX4 (8 + 8 + 4 + 4)
+#define COST_FIX5 (8 + 8 + 4 + 8 + 4)
+
+//a glyph read from a BDF file
+typedef struct {
+    long encoding; //character code (-1==none)
+    char *name; //STARTCHAR (glyphs without a code are matched by it)
+    int width;
+    int height;
+    int offsetx; //BBX: from origin to the left-bottom of the glyph
+    int offsety;
+    int advance; //DWIDTH
+    uchar *bits; //rows from top,  (width+7)/8 bytes a row
+    ushort id; //glyphID in the font
+} bdfglyph;
+
+//a strike: glyphs of a BDF file
+typedef struct {
+    char *fname;
+    char fontname[MAXSTRINGINBDF];
+    char copyright[MAXSTRINGINBDF];
+    int ppem;
+    int bbw, bbh, bbx, bby; //FONTBOUNDINGBOX
+    bdfglyph *glyphs; //in order of glyphIDs (after numberGlyphs())
+    int n; //number of glyphs
+} bdfstrike;
+
+//an indexSubTable to write: glyphs [from, to) of a strike
+typedef struct {
+    int from;
+    int to;
+    int indexFormat;
+    int imageFormat;
+} subtable;
+
+//growable on-memory output (a table)
+typedef struct {
+    uchar *buf;
+    size_t len;
+    size_t alloc;
+} outbuf;
+
+//a key of a glyph: its character code,  or its name
+typedef struct {
+    long encoding;
+    char *name;
+    ushort id;
+} glyphkey;
+
+/* func prototype */
+int main(int argc, char **argv);
+void readbdf(char *fname, bdfstrike *s);
+char *nextword(char **p);
+int numberGlyphs(bdfstrike *strikes, int nstrike, glyphkey **keys);
+int cmpKey(const void *a, const void *b);
+int cmpGlyph(const void *a, const void *b);
+int cmpStrike(const void *a, const void *b);
+int chooseFormats(bdfstrike *s, subtable **subs);
+int sameMetrics(bdfglyph *a, bdfglyph *b);
+ulong bitsize(bdfglyph *g);
+ulong bytesize(bdfglyph *g);
+void putstrike(bdfstrike *s, subtable *subs, int nsub, outbuf *eblc, outbuf *ebdt,
+               ulong sizeoff, ulong *naive);
+void putimage(outbuf *ob, bdfglyph *g, int imageFormat);
+void putbits(outbuf *ob, bdfglyph *g, int bitAligned);
+void putbigmetrics(outbuf *ob, bdfglyph *g);
+void putlinemetrics(outbuf *ob, bdfstrike *s);
+void puthead(outbuf *ob, bdfstrike *strikes, int nstrike);
+void putcmap(outbuf *ob, glyphkey *keys, int nkey);
+void putname(outbuf *ob, bdfstrike *s);
+void putnamestr(outbuf *rec, outbuf *str, int nameid, const char *s);
+void writesfnt(char *fname, outbuf *tables, ulong *tags, int ntable);
+ulong checksum(uchar *p, size_t len);
+void ob_init(outbuf *ob);
+void ob_reserve(outbuf *ob, size_t n);
+void ob_write(outbuf *ob, const void *s, size_t n);
+void ob_free(outbuf *ob);
+void put8(outbuf *ob, int v);
+void put16(outbuf *ob, ulong v);
+void put32(outbuf *ob, ulong v);
+void set16(outbuf *ob, size_t pos, ulong v);
+void set32(outbuf *ob, size_t pos, ulong v);
+void pad4(outbuf *ob);
+int int8(int v, const char *what, bdfglyph *g);
+void errexit(char *fmt, ...);
+
+
+/*
+ * reading BDF files,  and writing a TrueType font with their glyphs
+ *   as strikes (EBLC/EBDT) and a minimal set of other tables
+ */
+int main(int argc, char **argv){
+    char *outname = NULL;
+    char defname[MAXFILENAMECHAR];
+    bdfstrike *strikes;
+    int nstrike = 0;
+    glyphkey *keys;
+    int nkey;
+    outbuf tables[6]; //sorted by tag
+    ulong tags[6] = {TAG('E','B','D','T'), TAG('E','B','L','C'), TAG('c','m','a','p'),
+                     TAG('h','e','a','d'), TAG('m','a','x','p'), TAG('n','a','m','e')};
+    outbuf *ebdt = &tables[0], *eblc = &tables[1];
+    ulong naive = 0; //(byte) EBLC/EBDT with one indexSubTable of format 1 a strike
+    ulong size;
+    int i, j;
+
+    if((strikes=calloc(argc, sizeof(bdfstrike)))==NULL)
+        errexit("calloc");
+    for(i=1; i<argc; i++){
+        if(strcmp(argv[i], "-o")==0 && i+1<argc){
+            outname = argv[++i];
+        }else if(argv[i][0]!='-'){
+            strikes[nstrike++].fname = argv[i];
+        }else{
+            nstrike = 0;
+            break;
+        }
+    }
+    if(nstrike == 0){
+        fprintf(stderr, PROGNAME " version " PROGVERSION " - make bitmap-data of a TrueType font from BDF files\n");
+        fprintf(stderr, "usage:  " PROGNAME " [-o out.ttf] file.bdf ...\n");
+        exit(1);
+    }
+    if(outname == NULL){
+        //first.bdf -> first.ttf
+        char *dot = strrchr(strikes[0].fname, '.');
+        int len = dot ? (int)(dot - strikes[0].fname) : (int)strlen(strikes[0].fname);
+
+        snprintf(defname, sizeof(defname), "%.*s.ttf", len, strikes[0].fname);
+        outname = defname;
+    }
+
+    /*
+     * reading BDF files (a strike each)
+     */
+    for(i=0; i<nstrike; i++)
+        readbdf(strikes[i].fname, &strikes[i]);
+    qsort(strikes, nstrike, sizeof(bdfstrike), cmpStrike);
+    for(i=1; i<nstrike; i++){
+        if(strikes[i].ppem == strikes[i-1].ppem)
+            errexit("'%s' and '%s' are both %dppem.",
+                    strikes[i-1].fname, strikes[i].fname, strikes[i].ppem);
+    }
+    nkey = numberGlyphs(strikes, nstrike, &keys);
+
+    /*
+     * EBLC and EBDT
+     *   the header and bitmapSizeTables first,  indexSubTables after them
+     */
+    for(i=0; i<6; i++)
+        ob_init(&tables[i]);
+    put32(ebdt, 0x00020000); //version
+    put32(eblc, 0x00020000); //version
+    put32(eblc, nstrike);
+    for(i=0; i<nstrike; i++)
+        ob_write(eblc, NULL, 48); //bitmapSizeTable (set later)
+    for(i=0; i<nstrike; i++){
+        subtable *subs;
+        int nsub;
+        int count[6] = {0, 0, 0, 0, 0, 0};
+
+        nsub = chooseFormats(&strikes[i], &subs);
+        putstrike(&strikes[i], subs, nsub, eblc, ebdt, 8 + 48*i, &naive);
+        for(j=0; j<nsub; j++)
+            count[subs[j].indexFormat]++;
+        fprintf(stderr, "  %dppem: %d glyphs, %d indexSubTables "
+                "(format 1:%d 2:%d 3:%d 4:%d 5:%d)\n",
+                strikes[i].ppem, strikes[i].n, nsub,
+                count[1], count[2], count[3], count[4], count[5]);
+        free(subs);
+    }
+    naive += 8 + 4; //headers of EBLC, EBDT
+
+    /*
+     * other tables
+     */
+    putcmap(&tables[2], keys, nkey);
+    puthead(&tables[3], strikes, nstrike);
+    put32(&tables[4], 0x00005000); //maxp version 0.5: only numGlyphs
+    put16(&tables[4], nkey + 1);
+    putname(&tables[5], &strikes[0]);
+    writesfnt(outname, tables, tags, 6);
+
+    size = eblc->len + ebdt->len;
+    fprintf(stderr, "  wrote '%s'\n", outname);
+    fprintf(stderr, "  EBLC+EBDT: %lu bytes (naive layout %lu bytes, %ld bytes = %.1f%% saved)\n",
+            size, naive, (long)naive - (long)size,
+            naive ? ((double)naive - size) * 100.0 / naive : 0.0);
+
+    for(i=0; i<6; i++)
+        ob_free(&tables[i]);
+    for(i=0; i<nstrike; i++){
+        for(j=0; j<strikes[i].n; j++){
+            free(strikes[i].glyphs[j].bits);
+            free(strikes[i].glyphs[j].name);
+        }
+        free(strikes[i].glyphs);
+    }
+    free(strikes);
+    free(keys);
+    exit(EXIT_SUCCESS);
+}
+
+
+/*
+ * reading a BDF file
+ *   ppem is PIXEL_SIZE (or the point size of SIZE,  as sbitget writes it)
+ * in:  filename
+ *      (for out) the strike
+ * out: nothing
+ */
+void readbdf(char *fname, bdfstrike *s){
+    FILE *fp;
+    char line[MAXLINECHAR];
+    int alloc = 0;
+    int pixelsize = 0;
+    bdfglyph *g = NULL; //glyph being read
+    int row = -1; //row of BITMAP being read (-1==not in BITMAP)
+
+    if((fp=fopen(fname, "r"))==NULL)
+        errexit("cannot open '%s'", fname);
+    strcpy(s->fontname, STRUNKNOWN);
+    strcpy(s->copyright, STRUNKNOWN);
+
+    while(fgets(line, sizeof(line), fp) != NULL){
+        char *p = line;
+        char *key;
+
+        if(row >= 0 && row < g->height){
+            //a row of the bitmap:  hex digits,  the left pixel first
+            int rowbytes = (g->width + 7) / 8;
+            int k;
+
+            for(k=0; k<rowbytes && p[0] && p[1]; k++, p+=2){
+                unsigned int v;
+
+                if(sscanf(p, "%2x", &v) != 1)
+                    errexit("%s: broken BITMAP of '%s'", fname, g->name);
+                g->bits[row*rowbytes + k] = v;
+            }
+            //pixels right of the width are cut
+            if(g->width & 7)
+                g->bits[row*rowbytes + rowbytes-1] &= 0xff << (8 - (g->width & 7));
+            row++;
+            continue;
+        }
+
+        key = nextword(&p);
+        if(key == NULL)
+            continue;
+        if(strcmp(key, "FONT")==0){
+            char *name = nextword(&p);
+
+            if(name != NULL && name[0] == '-'){
+                //XLFD: -foundry-family-...
+                char *family = name + 1;
+                char *end = strchr(family, '-');
+
+                if(end != NULL)
+                    *end = '\0';
+                name = family;
+            }
+            if(name != NULL)
+                snprintf(s->fontname, sizeof(s->fontname), "%s", name);
+        }else if(strcmp(key, "SIZE")==0){
+            char *w = nextword(&p);
+            if(w != NULL)
+                s->ppem = atoi(w);
+        }else if(strcmp(key, "PIXEL_SIZE")==0){
+            char *w = nextword(&p);
+            if(w != NULL)
+                pixelsize = atoi(w);
+        }else if(strcmp(key, "FONTBOUNDINGBOX")==0){
+            if(sscanf(p, "%d %d %d %d", &s->bbw, &s->bbh, &s->bbx, &s->bby) != 4)
+                errexit("%s: broken FONTBOUNDINGBOX", fname);
+        }else if(strcmp(key, "COPYRIGHT")==0){
+            //"..." (a quote in it is written as "")
+            char *d = s->copyright;
+            char *end = s->copyright + sizeof(s->copyright) - 1;
+
+            while(*p == ' ')
+                p++;
+            if(*p == '"')
+                p++;
+            for(; *p && *p != '\n' && *p != '\r' && d < end; p++){
+                if(*p == '"' && p[1] != '"')
+                    break;
+                if(*p == '"')
+                    p++;
+                *d++ = *p;
+            }
+            *d = '\0';
+        }else if(strcmp(key, "STARTCHAR")==0){
+            char *name = nextword(&p);
+
+            if(s->n == alloc){
+                alloc = alloc ? alloc * 2 : 256;
+                if((s->glyphs=realloc(s->glyphs, sizeof(bdfglyph) * alloc))==NULL)
+                    errexit("realloc");
+            }
+            g = &s->glyphs[s->n++];
+            memset(g, 0x00, sizeof(bdfglyph));
+            g->encoding = -1;
+            g->advance = -1;
+            if((g->name=malloc(strlen(name ? name : "") + 1))==NULL)
+                errexit("malloc");
+            strcpy(g->name, name ? name : "");
+        }else if(g == NULL){
+            continue; //header
+        }else if(strcmp(key, "ENCODING")==0){
+            char *w = nextword(&p);
+            if(w != NULL)
+                g->encoding = atol(w);
+            if(g->encoding < 0)
+                g->encoding = -1;
+        }else if(strcmp(key, "DWIDTH")==0){
+            char *w = nextword(&p);
+            if(w != NULL)
+                g->advance = atoi(w);
+        }else if(strcmp(key, "BBX")==0){
+            if(sscanf(p, "%d %d %d %d", &g->width, &g->height, &g->offsetx, &g->offsety) != 4
+               || g->width < 0 || g->height < 0)
+                errexit("%s: broken BBX of '%s'", fname, g->name);
+        }else if(strcmp(key, "BITMAP")==0){
+            if((g->bits=calloc((size_t)((g->width + 7) / 8) * g->height + 1, 1))==NULL)
+                errexit("calloc");
+            row = 0;
+        }else if(strcmp(key, "ENDCHAR")==0){
+            if(g->bits == NULL && (g->bits=calloc(1, 1))==NULL)
+                errexit("calloc");
+            if(g->advance < 0)
+                g->advance = g->width;
+            row = -1;
+        }
+    }
+    fclose(fp);
+
+    if(pixelsize > 0)
+        s->ppem = pixelsize;
+    if(s->ppem <= 0 || s->ppem > 255)
+        errexit("%s: size (ppem) is not known", fname);
+    if(s->n == 0)
+        errexit("%s: no glyph", fname);
+}
+
+
+/*
+ * a word of a line (separated by spaces)
+ * in:  (for in and out) position in the line
+ * out: the word ('\0'-terminated in the line), NULL==no more word
+ */
+char *nextword(char **p){
+    char *w;
+
+    while(**p == ' ' || **p == '\t')
+        (*p)++;
+    if(**p == '\0' || **p == '\n' || **p == '\r')
+        return NULL;
+    w = *p;
+    while(**p && **p != ' ' && **p != '\t' && **p != '\n' && **p != '\r')
+        (*p)++;
+    if(**p){
+        **p = '\0';
+        (*p)++;
+    }
+    return w;
+}
+
+
+/*
+ * give glyphIDs to glyphs of all strikes
+ *   a glyph has the same glyphID in all strikes:  glyphs with a character
+ *   code are numbered in order of codes (from 1,  0 is .notdef),
+ *   then glyphs without a code in order of their names
+ *   glyphs of each strike are sorted by glyphID
+ * in:  (for in and out) strikes
+ *      number of strikes
+ *      (for out) keys of glyphs (in order of glyphIDs, malloc()ed)
+ * out: number of glyphs (without .notdef)
+ */
+int numberGlyphs(bdfstrike *strikes, int nstrike, glyphkey **keys){
+    glyphkey *k;
+    int n = 0, total = 0;
+    int i, j;
+
+    for(i=0; i<nstrike; i++)
+        total += strikes[i].n;
+    if((k=malloc(sizeof(glyphkey) * (total + 1)))==NULL)
+        errexit("malloc");
+    for(i=0; i<nstrike; i++){
+        for(j=0; j<strikes[i].n; j++){
+            k[n].encoding = strikes[i].glyphs[j].encoding;
+            k[n].name = strikes[i].glyphs[j].name;
+            n++;
+        }
+    }
+    qsort(k, n, sizeof(glyphkey), cmpKey);
+
+    //one key for the same glyph of strikes
+    for(i=0, j=0; i<n; i++){
+        if(j > 0 && cmpKey(&k[j-1], &k[i]) == 0)
+            continue;
+        k[j] = k[i];
+        k[j].id = j + 1;
+        j++;
+    }
+    n = j;
+    if(n > 65535)
+        errexit("too many glyphs (%d)", n);
+
+    for(i=0; i<nstrike; i++){
+        bdfstrike *s = &strikes[i];
+
+        for(j=0; j<s->n; j++){
+            glyphkey key, *found;
+
+            key.encoding = s->glyphs[j].encoding;
+            key.name = s->glyphs[j].name;
+            found = bsearch(&key, k, n, sizeof(glyphkey), cmpKey);
+            s->glyphs[j].id = found->id;
+        }
+        qsort(s->glyphs, s->n, sizeof(bdfglyph), cmpGlyph);
+        for(j=1; j<s->n; j++){
+            if(s->glyphs[j].id == s->glyphs[j-1].id)
+                errexit("%s: two glyphs '%s'", s->fname, s->glyphs[j].name);
+        }
+    }
+    *keys = k;
+    return n;
+}
+
+
+/*
+ * compare for qsort(): glyphs with a code first (in order of codes),
+ *   then glyphs without a code (in order of names)
+ */
+int cmpKey(const void *a, const void *b){
+    const glyphkey *x = a, *y = b;
+
+    if(x->encoding >= 0 && y->encoding >= 0)
+        return (x->encoding > y->encoding) - (x->encoding < y->encoding);
+    if(x->encoding >= 0 || y->encoding >= 0)
+        return (x->encoding >= 0) ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+
+/*
+ * compare for qsort(): in order of glyphIDs
+ */
+int cmpGlyph(const void *a, const void *b){
+    const bdfglyph *x = a, *y = b;
+
+    return (int)x->id - (int)y->id;
+}
+
+
+/*
+ * compare for qsort(): smaller strike first
+ */
+int cmpStrike(const void *a, const void *b){
+    const bdfstrike *x = a, *y = b;
+
+    return x->ppem - y->ppem;
+}
+
+
+/*
+ * choose indexSubTables of a strike to make EBLC/EBDT smallest
+ *   glyphs are split into runs,  each run is written with one index
+ *   format.  the cost of each format is its size:
+ *     1: 4 bytes an entry (also for glyphIDs not in the strike)
+ *     3: 2 bytes an entry (images up to 64KB)
+ *     4: 4 bytes a glyph (images up to 64KB)
+ *     2: no entry,  metrics once (the same metrics, no missing glyphID)
+ *     5: 2 bytes a glyph,  metrics once (the same metrics)
+ *   formats 1, 3, 4 have metrics (5 bytes) in each image,  2 and 5 don't.
+ *   the best run for each glyph and format is found from the glyph
+ *   before it (a new run,  or the run continued)
+ * in:  the strike
+ *      (for out) indexSubTables (malloc()ed)
+ * out: number of indexSubTables
+ */
+int chooseFormats(bdfstrike *s, subtable **subs){
+    static const ulong fixcost[6] = {0, COST_FIX1, COST_FIX2, COST_FIX3, COST_FIX4, COST_FIX5};
+    static const ulong entrycost[6] = {0, 4, 0, 2, 4, 2}; //(byte) an entry
+    int n = s->n;
+    ulong (*cost)[6]; //least size up to a glyph,  in a run of a format
+    int (*start)[6];  //first glyph of the run
+    ulong (*data)[6]; //(byte) images of the run
+    char (*prev)[6];  //format of the run before (0==the run is continued)
+    int i, f, pf, best;
+    int nsub;
+
+    if((cost=malloc(sizeof(*cost) * n))==NULL || (start=malloc(sizeof(*start) * n))==NULL
+       || (data=malloc(sizeof(*data) * n))==NULL || (prev=malloc(sizeof(*prev) * n))==NULL)
+        errexit("malloc");
+
+    for(i=0; i<n; i++){
+        bdfglyph *g = &s->glyphs[i];
+        ulong image = bitsize(g); //bit-aligned is not larger than byte-aligned
+        ulong before = ~0UL; //least size of glyphs before this
+        int beforef = 0;
+
+        if(i > 0){
+            for(pf=1; pf<=5; pf++){
+                if(cost[i-1][pf] < before){
+                    before = cost[i-1][pf];
+                    beforef = pf;
+                }
+            }
+        }
+        for(f=1; f<=5; f++){
+            ulong own = (f==1 || f==3 || f==4) ? 5 + image : image;
+            ulong newcost = (i > 0 ? before : 0) + fixcost[f] + entrycost[f] + own;
+            int cont = 0;
+            ulong contcost = ~0UL;
+
+            //entries of formats 3 and 5 padded to 4 bytes are ignored here
+            if(i > 0){
+                bdfglyph *first = &s->glyphs[start[i-1][f]];
+                int gap = g->id - s->glyphs[i-1].id;
+
+                switch (f){
+                case 1:
+                    //glyphIDs not in the strike have entries
+                    cont = 1;
+                    contcost = cost[i-1][f] + entrycost[f] * gap + own;
+                    break;
+                case 3:
+                    cont = (data[i-1][f] + own <= MAXSEGDATA);
+                    contcost = cost[i-1][f] + entrycost[f] * gap + own;
+                    break;
+                case 4:
+                    cont = (data[i-1][f] + own <= MAXSEGDATA);
+                    contcost = cost[i-1][f] + entrycost[f] + own;
+                    break;
+                case 2:
+                    cont = (gap == 1 && sameMetrics(first, g));
+                    contcost = cost[i-1][f] + own;
+                    break;
+                case 5:
+                    cont = sameMetrics(first, g);
+                    contcost = cost[i-1][f] + entrycost[f] + own;
+                    break;
+                }
+            }
+            if(cont && contcost <= newcost){
+                cost[i][f] = contcost;
+                start[i][f] = start[i-1][f];
+                data[i][f] = data[i-1][f] + own;
+                prev[i][f] = 0;
+            }else{
+                cost[i][f] = newcost;
+                start[i][f] = i;
+                data[i][f] = own;
+                prev[i][f] = beforef;
+            }
+        }
+    }
+
+    /*
+     * runs from the last glyph
+     */
+    best = 1;
+    for(f=2; f<=5; f++){
+        if(cost[n-1][f] < cost[n-1][best])
+            best = f;
+    }
+    nsub = 0;
+    for(i=n-1, f=best; i>=0; ){
+        int first = start[i][f];
+        int pfmt = prev[first][f];
+
+        nsub++;
+        i = first - 1;
+        f = pfmt;
+    }
+    if((*subs=malloc(sizeof(subtable) * nsub))==NULL)
+        errexit("malloc");
+    for(i=n-1, f=best, pf=nsub; i>=0; ){
+        subtable *st = &(*subs)[--pf];
+        int first = start[i][f];
+        ulong bits = 0, bytes = 0;
+        int k;
+
+        st->from = first;
+        st->to = i + 1;
+        st->indexFormat = f;
+        //formats 1, 3, 4:  byte-aligned if it is not larger (faster to read)
+        for(k=first; k<=i; k++){
+            bits += bitsize(&s->glyphs[k]);
+            bytes += bytesize(&s->glyphs[k]);
+        }
+        if(f == 2 || f == 5)
+            st->imageFormat = 5;
+        else
+            st->imageFormat = (bytes <= bits) ? 1 : 2;
+        i = first - 1;
+        f = prev[first][f];
+    }
+
+    free(cost);
+    free(start);
+    free(data);
+    free(prev);
+    return nsub;
+}
+
+
+/*
+ * two glyphs have the same metrics or not
+ * in:  glyphs
+ * out: 1==the same, 0==not
+ */
+int sameMetrics(bdfglyph *a, bdfglyph *b){
+    return a->width == b->width && a->height == b->height
+        && a->offsetx == b->offsetx && a->offsety == b->offsety
+        && a->advance == b->advance;
+}
+
+
+/*
+ * (byte) size of a bit-aligned image
+ */
+ulong bitsize(bdfglyph *g){
+    return ((ulong)g->width * g->height + 7) / 8;
+}
+
+
+/*
+ * (byte) size of a byte-aligned image
+ */
+ulong bytesize(bdfglyph *g){
+    return (ulong)((g->width + 7) / 8) * g->height;
+}
+
+
+/*
+ * write a strike:  its bitmapSizeTable,  indexSubTableArray and
+ *   indexSubTables in EBLC,  and images in EBDT
+ * in:  the strike
+ *      indexSubTables
+ *      number of indexSubTables
+ *      EBLC
+ *      EBDT
+ *      (byte) offset of the bitmapSizeTable from top of EBLC
+ *      (for in and out) (byte) size of the naive layout:  one
+ *      indexSubTable of format 1,  images of format 1
+ * out: nothing
+ */
+void putstrike(bdfstrike *s, subtable *subs, int nsub, outbuf *eblc, outbuf *ebdt,
+               ulong sizeoff, ulong *naive){
+    ulong arrayoff = eblc->len; //top of indexSubTableArray
+    outbuf size; //bitmapSizeTable
+    int i, k;
+
+    //indexSubTableArray (set later)
+    ob_write(eblc, NULL, 8 * nsub);
+
+    for(i=0; i<nsub; i++){
+        subtable *st = &subs[i];
+        bdfglyph *g = s->glyphs;
+        ulong subtableoff = eblc->len;
+        ulong imageoff = ebdt->len;
+        ushort first = g[st->from].id, last = g[st->to - 1].id;
+
+        //indexSubTableArray: firstGlyphIndex, lastGlyphIndex, additionalOffsetToIndexSubtable
+        set16(eblc, arrayoff + 8*i, first);
+        set16(eblc, arrayoff + 8*i + 2, last);
+        set32(eblc, arrayoff + 8*i + 4, subtableoff - arrayoff);
+
+        //indexSubHeader
+        put16(eblc, st->indexFormat);
+        put16(eblc, st->imageFormat);
+        put32(eblc, imageoff);
+
+        switch (st->indexFormat){
+        case 1: //proportional with 4byte offset
+        case 3: //proportional with 2byte offset
+            {
+                int id = first;
+
+                for(k=st->from; k<st->to; k++){
+                    //glyphIDs not in the strike:  no image
+                    for(; id <= g[k].id; id++){
+                        if(st->indexFormat == 1)
+                            put32(eblc, ebdt->len - imageoff);
+                        else
+                            put16(eblc, ebdt->len - imageoff);
+                    }
+                    putimage(ebdt, &g[k], st->imageFormat);
+                }
+                if(st->indexFormat == 1)
+                    put32(eblc, ebdt->len - imageoff);
+                else
+                    put16(eblc, ebdt->len - imageoff);
+            }
+            break;
+        case 4: //proportional with sparse codes
+            put32(eblc, st->to - st->from);
+            for(k=st->from; k<st->to; k++){
+                put16(eblc, g[k].id);
+                put16(eblc, ebdt->len - imageoff);
+                putimage(ebdt, &g[k], st->imageFormat);
+            }
+            put16(eblc, 0);
+            put16(eblc, ebdt->len - imageoff);
+            break;
+        case 2: //monospaced with close codes
+        case 5: //monospaced with sparse codes
+            put32(eblc, bitsize(&g[st->from])); //imageSize
+            putbigmetrics(eblc, &g[st->from]);
+            if(st->indexFormat == 5){
+                put32(eblc, st->to - st->from);
+                for(k=st->from; k<st->to; k++)
+                    put16(eblc, g[k].id);
+            }
+            for(k=st->from; k<st->to; k++)
+                putimage(ebdt, &g[k], 5);
+            break;
+        }
+        pad4(eblc);
+    }
+
+    /*
+     * bitmapSizeTable
+     */
+    ob_init(&size);
+    put32(&size, arrayoff);
+    put32(&size, eblc->len - arrayoff); //indexTablesSize
+    put32(&size, nsub);
+    put32(&size, 0); //colorRef
+    putlinemetrics(&size, s); //hori
+    putlinemetrics(&size, s); //vert
+    put16(&size, s->glyphs[0].id); //startGlyphIndex
+    put16(&size, s->glyphs[s->n - 1].id); //endGlyphIndex
+    put8(&size, s->ppem); //ppemX
+    put8(&size, s->ppem); //ppemY
+    put8(&size, 1); //bitDepth
+    put8(&size, 1); //flags: horizontal
+    memcpy(eblc->buf + sizeoff, size.buf, 48);
+    ob_free(&size);
+
+    //naive layout:  bitmapSizeTable, indexSubTableArray, indexSubHeader,
+    //  offsets of all glyphIDs first..last (and the end),  images
+    *naive += 48 + 8 + 8 + 4 * ((ulong)s->glyphs[s->n - 1].id - s->glyphs[0].id + 2);
+    for(k=0; k<s->n; k++)
+        *naive += 5 + bytesize(&s->glyphs[k]);
+}
+
+
+/*
+ * write an image of a glyph in EBDT
+ * in:  EBDT
+ *      the glyph
+ *      imageFormat (1: byte-aligned, small-metric,
+ *                   2: bit-aligned, small-metric,  5: bit-aligned only)
+ * out: nothing
+ */
+void putimage(outbuf *ob, bdfglyph *g, int imageFormat){
+    if(imageFormat != 5){
+        //smallGlyphMetrics
+        if(g->width > 255 || g->height > 255 || g->advance < 0 || g->advance > 255)
+            errexit("glyph '%s' is too large", g->name);
+        put8(ob, g->height);
+        put8(ob, g->width);
+        put8(ob, int8(g->offsetx, "bearingX", g));
+        put8(ob, int8(g->offsety + g->height, "bearingY", g));
+        put8(ob, g->advance);
+    }
+    putbits(ob, g, imageFormat != 1);
+}
+
+
+/*
+ * write a bitmap of a glyph in EBDT
+ * in:  EBDT
+ *      the glyph
+ *      1==bit-aligned (rows follow without padding), 0==byte-aligned
+ * out: nothing
+ */
+void putbits(outbuf *ob, bdfglyph *g, int bitAligned){
+    int rowbytes = (g->width + 7) / 8;
+    ulong acc = 0; //bits not written yet (from the lowest bit)
+    int nbits = 0;
+    int x, y;
+
+    if(!bitAligned){
+        ob_write(ob, g->bits, bytesize(g));
+        return;
+    }
+    for(y=0; y<g->height; y++){
+        uchar *row = g->bits + y * rowbytes;
+
+        for(x=0; x + 8 <= g->width; x+=8){
+            acc = (acc << 8) | row[x/8];
+            put8(ob, (acc >> nbits) & 0xff);
+        }
+        if(x < g->width){
+            int rest = g->width - x;
+
+            acc = (acc << rest) | (row[x/8] >> (8 - rest));
+            nbits += rest;
+            if(nbits >= 8){
+                nbits -= 8;
+                put8(ob, (acc >> nbits) & 0xff);
+            }
+        }
+    }
+    if(nbits > 0)
+        put8(ob, (acc << (8 - nbits)) & 0xff);
+}
+
+
+/*
+ * write bigGlyphMetrics (of index formats 2 and 5) in EBLC
+ *   vertical metrics are not known:  the glyph is put under the origin
+ * in:  EBLC
+ *      a glyph with the metrics
+ * out: nothing
+ */
+void putbigmetrics(outbuf *ob, bdfglyph *g){
+    if(g->width > 255 || g->height > 255 || g->advance < 0 || g->advance > 255)
+        errexit("glyph '%s' is too large", g->name);
+    put8(ob, g->height);
+    put8(ob, g->width);
+    put8(ob, int8(g->offsetx, "bearingX", g));
+    put8(ob, int8(g->offsety + g->height, "bearingY", g));
+    put8(ob, g->advance);
+    put8(ob, int8(-g->width / 2, "vertBearingX", g));
+    put8(ob, 0); //vertBearingY
+    put8(ob, g->height); //vertAdvance
+}
+
+
+/*
+ * write sbitLineMetrics of a strike
+ *   the inverse of see_sbitLineMetrics() of sbitget:  the bounding box
+ *   of the strike (FONTBOUNDINGBOX) is kept
+ * in:  bitmapSizeTable
+ *      the strike
+ * out: nothing
+ */
+void putlinemetrics(outbuf *ob, bdfstrike *s){
+    int minAdvanceSB = 0;
+    int k;
+
+    for(k=0; k<s->n; k++){
+        bdfglyph *g = &s->glyphs[k];
+        int sb = g->advance - (g->offsetx + g->width);
+
+        if(k == 0 || sb < minAdvanceSB)
+            minAdvanceSB = sb;
+    }
+    put8(ob, int8(s->bbh + s->bby, "ascender", NULL));
+    put8(ob, int8(s->bby, "descender", NULL));
+    if(s->bbw < 0 || s->bbw > 255)
+        errexit("%s: FONTBOUNDINGBOX is too large", s->fname);
+    put8(ob, s->bbw); //widthMax
+    put8(ob, 1); //caretSlopeNumerator
+    put8(ob, 0); //caretSlopeDenominator
+    put8(ob, 0); //caretOffset
+    put8(ob, int8(s->bbx, "minOriginSB", NULL));
+    put8(ob, int8(minAdvanceSB, "minAdvanceSB", NULL));
+    put8(ob, int8(s->bbh + s->bby, "maxBeforeBL", NULL));
+    put8(ob, int8(s->bby, "minAfterBL", NULL));
+    put8(ob, 0); //pad1
+    put8(ob, 0); //pad2
+}
+
+
+/*
+ * write 'head' table
+ *   the font has no outline:  the bounding box is of the largest strike
+ * in:  'head'
+ *      strikes (smaller first)
+ *      number of strikes
+ * out: nothing
+ */
+void puthead(outbuf *ob, bdfstrike *strikes, int nstrike){
+    bdfstrike *big = &strikes[nstrike - 1];
+    long scale = UNITSPEREM / big->ppem;
+
+    put32(ob, 0x00010000); //version
+    put32(ob, 0x00010000); //fontRevision
+    put32(ob, 0); //checkSumAdjustment (set in writesfnt())
+    put32(ob, 0x5F0F3CF5); //magicNumber
+    put16(ob, 0x000B); //flags: baseline at y=0, lsb at x=0, integer ppem
+    put16(ob, UNITSPEREM);
+    put32(ob, 0); put32(ob, 0); //created
+    put32(ob, 0); put32(ob, 0); //modified
+    put16(ob, (ushort)(big->bbx * scale)); //xMin
+    put16(ob, (ushort)(big->bby * scale)); //yMin
+    put16(ob, (ushort)((big->bbx + big->bbw) * scale)); //xMax
+    put16(ob, (ushort)((big->bby + big->bbh) * scale)); //yMax
+    put16(ob, 0); //macStyle
+    put16(ob, strikes[0].ppem); //lowestRecPPEM
+    put16(ob, 2); //fontDirectionHint
+    put16(ob, 0); //indexToLocFormat
+    put16(ob, 0); //glyphDataFormat
+}
+
+
+/*
+ * write 'cmap' table:  one Unicode subtable
+ *   format 4 (BMP) when all codes are under 0x10000,  or format 12.
+ *   glyphIDs are numbered in order of codes,  so a segment is a run of
+ *   codes with glyphIDs in a row
+ * in:  'cmap'
+ *      keys of glyphs (in order of glyphIDs,  glyphs with a code first)
+ *      number of glyphs
+ * out: nothing
+ */
+void putcmap(outbuf *ob, glyphkey *keys, int nkey){
+    int ncode, nseg;
+    int i, k;
+    int bmp;
+
+    for(ncode=0; ncode<nkey && keys[ncode].encoding >= 0; ncode++)
+        ;
+    bmp = (ncode == 0 || keys[ncode-1].encoding < 0xffff);
+    nseg = 0;
+    for(i=0; i<ncode; i++){
+        if(i == 0 || keys[i].encoding != keys[i-1].encoding + 1)
+            nseg++;
+    }
+
+    put16(ob, 0); //version
+    put16(ob, 1); //numTables
+    put16(ob, 3); //platformID: Microsoft
+    put16(ob, bmp ? 1 : 10); //encodingID: Unicode BMP, UCS-4
+    put32(ob, 12); //offset
+
+    if(bmp){
+        ulong range;
+        int segX2 = (nseg + 1) * 2; //and the last segment 0xffff
+        int entry = 0;
+        size_t top = ob->len;
+
+        for(range=2; range*2 <= (ulong)segX2; )
+            range *= 2;
+        for(k=range; k>2; k/=2)
+            entry++;
+        put16(ob, 4); //format
+        put16(ob, 0); //length (set later)
+        put16(ob, 0); //language
+        put16(ob, segX2);
+        put16(ob, range); //searchRange
+        put16(ob, entry); //entrySelector
+        put16(ob, segX2 - range); //rangeShift
+        for(i=0; i<ncode; i++){
+            if(i+1 == ncode || keys[i+1].encoding != keys[i].encoding + 1)
+                put16(ob, keys[i].encoding); //endCode
+        }
+        put16(ob, 0xffff);
+        put16(ob, 0); //reservedPad
+        for(i=0; i<ncode; i++){
+            if(i == 0 || keys[i].encoding != keys[i-1].encoding + 1)
+                put16(ob, keys[i].encoding); //startCode
+        }
+        put16(ob, 0xffff);
+        for(i=0; i<ncode; i++){
+            if(i == 0 || keys[i].encoding != keys[i-1].encoding + 1)
+                put16(ob, (keys[i].id - keys[i].encoding) & 0xffff); //idDelta
+        }
+        put16(ob, 1);
+        for(i=0; i<=nseg; i++)
+            put16(ob, 0); //idRangeOffset
+        set16(ob, top + 2, ob->len - top);
+    }else{
+        put16(ob, 12); //format
+        put16(ob, 0); //reserved
+        put32(ob, 16 + 12 * nseg); //length
+        put32(ob, 0); //language
+        put32(ob, nseg);
+        for(i=0; i<ncode; i++){
+            if(i == 0 || keys[i].encoding != keys[i-1].encoding + 1){
+                put32(ob, keys[i].encoding); //startCharCode
+                for(k=i; k+1<ncode && keys[k+1].encoding == keys[k].encoding + 1; k++)
+                    ;
+                put32(ob, keys[k].encoding); //endCharCode
+                put32(ob, keys[i].id); //startGlyphID
+            }
+        }
+    }
+}
+
+
+/*
+ * write 'name' table:  copyright and names of the font (Microsoft, English)
+ * in:  'name'
+ *      a strike (with the names)
+ * out: nothing
+ */
+void putname(outbuf *ob, bdfstrike *s){
+    outbuf rec, str;
+    int n;
+
+    ob_init(&rec);
+    ob_init(&str);
+    if(strcmp(s->copyright, STRUNKNOWN) != 0)
+        putnamestr(&rec, &str, 0, s->copyright);
+    putnamestr(&rec, &str, 1, s->fontname); //family
+    putnamestr(&rec, &str, 2, "Regular"); //subfamily
+    putnamestr(&rec, &str, 4, s->fontname); //full fontname
+    putnamestr(&rec, &str, 6, s->fontname); //fontname (postscript)
+    n = rec.len / 12;
+    put16(ob, 0); //format
+    put16(ob, n);
+    put16(ob, 6 + rec.len); //offset to string storage
+    ob_write(ob, rec.buf, rec.len);
+    ob_write(ob, str.buf, str.len);
+    ob_free(&rec);
+    ob_free(&str);
+}
+
+
+/*
+ * write a string in 'name' (UTF-16BE of ASCII)
+ * in:  nameRecords
+ *      string storage
+ *      nameID
+ *      the string
+ * out: nothing
+ */
+void putnamestr(outbuf *rec, outbuf *str, int nameid, const char *s){
+    size_t len = strlen(s);
+    size_t i;
+
+    if(len > 1000)
+        len = 1000;
+    put16(rec, 3); //platformID: Microsoft
+    put16(rec, 1); //encodingID: Unicode BMP
+    put16(rec, 0x0409); //languageID: English
+    put16(rec, nameid);
+    put16(rec, len * 2);
+    put16(rec, str->len);
+    for(i=0; i<len; i++)
+        put16(str, (uchar)s[i]);
+}
+
+
+/*
+ * write a TrueType font file
+ *   table directory,  and tables padded to 4 bytes.
+ *   checkSumAdjustment of 'head' is set
+ * in:  filename
+ *      tables (sorted by tag)
+ *      tags of tables
+ *      number of tables
+ * out: nothing
+ */
+void writesfnt(char *fname, outbuf *tables, ulong *tags, int ntable){
+    outbuf file;
+    ulong range, entry;
+    size_t headoff = 0;
+    int i;
+
+    for(range=1, entry=0; range*2 <= (ulong)ntable; range*=2)
+        entry++;
+    ob_init(&file);
+    put32(&file, 0x00010000); //version
+    put16(&file, ntable);
+    put16(&file, range * 16); //searchRange
+    put16(&file, entry); //entrySelector
+    put16(&file, ntable * 16 - range * 16); //rangeShift
+    ob_write(&file, NULL, 16 * ntable);
+
+    for(i=0; i<ntable; i++){
+        size_t off = file.len;
+        size_t len = tables[i].len; //padding is not in the length
+
+        pad4(&tables[i]);
+        set32(&file, 12 + 16*i, tags[i]);
+        set32(&file, 12 + 16*i + 4, checksum(tables[i].buf, tables[i].len));
+        set32(&file, 12 + 16*i + 8, off);
+        set32(&file, 12 + 16*i + 12, len);
+        ob_write(&file, tables[i].buf, tables[i].len);
+        if(tags[i] == TAG('h','e','a','d'))
+            headoff = off;
+    }
+    set32(&file, headoff + 8, (0xB1B0AFBAUL - checksum(file.buf, file.len)) & 0xffffffffUL);
+
+    {
+        FILE *fp;
+
+        if((fp=fopen(fname, "wb"))==NULL)
+            errexit("cannot open '%s'", fname);
+        if(fwrite(file.buf, 1, file.len, fp) != file.len || fclose(fp) != 0){
+            remove(fname);
+            errexit("cannot write '%s'", fname);
+        }
+    }
+    ob_free(&file);
+}
+
+
+/*
+ * checksum of a table (sum of big-endian 32-bit numbers)
+ * in:  on-memory location: top of the table
+ *      (byte) length (a multiple of 4)
+ * out: the checksum
+ */
+ulong checksum(uchar *p, size_t len){
+    ulong sum = 0;
+    size_t i;
+
+    for(i=0; i+4<=len; i+=4)
+        sum += ((ulong)p[i]<<24) | ((ulong)p[i+1]<<16) | ((ulong)p[i+2]<<8) | p[i+3];
+    return sum & 0xffffffffUL;
+}
+
+
+/*
+ * on-memory output
+ *   ob_write() with NULL writes zeros
+ */
+void ob_init(outbuf *ob){
+    ob->buf = NULL;
+    ob->len = 0;
+    ob->alloc = 0;
+}
+
+void ob_reserve(outbuf *ob, size_t n){
+    if(ob->len + n <= ob->alloc)
+        return;
+    while(ob->len + n > ob->alloc)
+        ob->alloc = ob->alloc ? ob->alloc * 2 : 4096;
+    if((ob->buf=realloc(ob->buf, ob->alloc))==NULL)
+        errexit("realloc");
+}
+
+void ob_write(outbuf *ob, const void *s, size_t n){
+    ob_reserve(ob, n);
+    if(s != NULL)
+        memcpy(ob->buf + ob->len, s, n);
+    else
+        memset(ob->buf + ob->len, 0x00, n);
+    ob->len += n;
+}
+
+void ob_free(outbuf *ob){
+    free(ob->buf);
+    ob_init(ob);
+}
+
+
+/*
+ * write big-endian numbers
+ * in:  on-memory output
+ *      (position to overwrite)
+ *      the number
+ * out: nothing
+ */
+void put8(outbuf *ob, int v){
+    ob_reserve(ob, 1);
+    ob->buf[ob->len++] = (uchar)v;
+}
+
+void put16(outbuf *ob, ulong v){
+    put8(ob, (v >> 8) & 0xff);
+    put8(ob, v & 0xff);
+}
+
+void put32(outbuf *ob, ulong v){
+    put16(ob, (v >> 16) & 0xffff);
+    put16(ob, v & 0xffff);
+}
+
+void set16(outbuf *ob, size_t pos, ulong v){
+    ob->buf[pos] = (v >> 8) & 0xff;
+    ob->buf[pos+1] = v & 0xff;
+}
+
+void set32(outbuf *ob, size_t pos, ulong v){
+    set16(ob, pos, (v >> 16) & 0xffff);
+    set16(ob, pos+2, v & 0xffff);
+}
+
+
+/*
+ * pad a table to 4 bytes
+ * in:  on-memory output
+ * out: nothing
+ */
+void pad4(outbuf *ob){
+    while(ob->len & 3)
+        put8(ob, 0);
+}
+
+
+/*
+ * a metric in a signed byte
+ * in:  the value
+ *      name of the metric
+ *      the glyph (NULL==a metric of the strike)
+ * out: the value
+ */
+int int8(int v, const char *what, bdfglyph *g){
+    if(v < -128 || v > 127){
+        if(g != NULL)
+            errexit("%s of glyph '%s' is out of range (%d)", what, g->name, v);
+        errexit("%s of a strike is out of range (%d)", what, v);
+    }
+    return v;
+}
+
+
+/*
+ * print an error message, and exit
+ */
+void errexit(char *fmt, ...){
+        va_list ap;
+        va_start(ap, fmt);
+        fprintf(stderr, "  Error: ");
+        vfprintf(stderr, fmt, ap);
+        fprintf(stderr, "\n");
+        va_end(ap);
+
+        exit(EXIT_FAILURE);
+}